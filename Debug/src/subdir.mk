@@ -4,16 +4,91 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
+../src/ble_central.c \
+../src/ble_midi.c \
 ../src/bt_daemon.c \
-../src/midi.c 
+../src/event_merge.c \
+../src/event_queue.c \
+../src/jitter.c \
+../src/link_policy.c \
+../src/link_tune.c \
+../src/log.c \
+../src/midi.c \
+../src/midi_ctrl.c \
+../src/midi_filter.c \
+../src/midi_link.c \
+../src/midi_out.c \
+../src/midi_out_rawmidi.c \
+../src/midi_out_seq.c \
+../src/midi_params.c \
+../src/midi_player.c \
+../src/midi_recorder.c \
+../src/midi_stream.c \
+../src/midi_wire.c \
+../src/reactor.c \
+../src/seq_engine.c \
+../src/slot_table.c \
+../src/stats.c \
+../src/stream_buf.c \
+../src/sysex_pool.c 
 
 OBJS += \
+./src/ble_central.o \
+./src/ble_midi.o \
 ./src/bt_daemon.o \
-./src/midi.o 
+./src/event_merge.o \
+./src/event_queue.o \
+./src/jitter.o \
+./src/link_policy.o \
+./src/link_tune.o \
+./src/log.o \
+./src/midi.o \
+./src/midi_ctrl.o \
+./src/midi_filter.o \
+./src/midi_link.o \
+./src/midi_out.o \
+./src/midi_out_rawmidi.o \
+./src/midi_out_seq.o \
+./src/midi_params.o \
+./src/midi_player.o \
+./src/midi_recorder.o \
+./src/midi_stream.o \
+./src/midi_wire.o \
+./src/reactor.o \
+./src/seq_engine.o \
+./src/slot_table.o \
+./src/stats.o \
+./src/stream_buf.o \
+./src/sysex_pool.o 
 
 C_DEPS += \
+./src/ble_central.d \
+./src/ble_midi.d \
 ./src/bt_daemon.d \
-./src/midi.d 
+./src/event_merge.d \
+./src/event_queue.d \
+./src/jitter.d \
+./src/link_policy.d \
+./src/link_tune.d \
+./src/log.d \
+./src/midi.d \
+./src/midi_ctrl.d \
+./src/midi_filter.d \
+./src/midi_link.d \
+./src/midi_out.d \
+./src/midi_out_rawmidi.d \
+./src/midi_out_seq.d \
+./src/midi_params.d \
+./src/midi_player.d \
+./src/midi_recorder.d \
+./src/midi_stream.d \
+./src/midi_wire.d \
+./src/reactor.d \
+./src/seq_engine.d \
+./src/slot_table.d \
+./src/stats.d \
+./src/stream_buf.d \
+./src/sysex_pool.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
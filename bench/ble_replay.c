@@ -0,0 +1,256 @@
+/*
+ * ble_replay.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ *
+ *  Stands in for a BLE-MIDI controller: replays recorded BLE-MIDI packets,
+ *  each wrapped in an ATT notification, over a SOCK_SEQPACKET socketpair
+ *  (in place of the L2CAP ATT socket) into the real link, reactor and
+ *  engine code, and counts what reaches the null output backend. Built
+ *  by "make bench" in the Debug folder, run as
+ *      ./ble_replay [recording]
+ *  A recording has one packet per line, the milliseconds since the first
+ *  one and the packet bytes in hex from the header on:
+ *      140 81 8C F0 7E 7F 06 01
+ *  '#' starts a comment. Without a file the built-in recording plays and
+ *  the exit status tells whether everything came out as expected.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <alsa/asoundlib.h>
+
+#include "midi_link.h"
+#include "ble_central.h"
+#include "stats.h"
+#include "midi_out.h"
+
+#define REPLAY_VALUE_HANDLE				0x0012
+#define REPLAY_LINE_LENGTH				1024
+#define REPLAY_SETTLE_NS				200000000ULL
+
+typedef struct {
+	uint32_t unNoteOn;
+	uint32_t unNoteOff;
+	uint32_t unOther;
+	uint32_t unSysEx;			// chunks
+	uint32_t unSysExBytes;
+}replay_count_t;
+
+/* Running status, a timestamp wrap inside a packet, realtime inside a
+ * message, SysEx continued in the next packet and one packet that is no
+ * BLE-MIDI at all */
+static const char* BUILTIN_RECORDING[] = {
+	"0   80 80 90 3C 64 3E 64",
+	"10  80 8A 80 3C 00 8A 3E 00",
+	"126 80 FE 90 40 50 82 80 40 00",
+	"133 81 85 90 43 85 F8 60",
+	"140 81 8C F0 7E 7F 06 01",
+	"141 81 41 42 43 8D F7",
+	"142 00 90 3C",
+	"144 81 90 B0 07 64 90 E0 00 40",
+	"150 81 96 80 43 00",
+};
+static const replay_count_t BUILTIN_EXPECTED = {4, 4, 3, 1, 9};
+#define BUILTIN_MALFORMED				1
+
+static reactor_t tReactor;
+static seq_engine_t tEngine;
+static midi_link_table_t tLinkTable;
+static daemon_stats_t tStats;
+static midi_out_t tMidiOut;
+static midi_params_t tParams;
+static replay_count_t tCount;
+static uint32_t unOut;
+
+/* Engine thread, once per batch */
+static void onBatch(const snd_seq_event_t* pEvents, int32_t nCount, void* pContext)
+{
+	replay_count_t* pCount = (replay_count_t*)pContext;
+	int32_t nIndex;
+
+	for (nIndex = 0; nIndex < nCount; nIndex++){
+		switch (pEvents[nIndex].type){
+		case SND_SEQ_EVENT_NOTEON:
+			pCount->unNoteOn++;
+			break;
+		case SND_SEQ_EVENT_NOTEOFF:
+			pCount->unNoteOff++;
+			break;
+		case SND_SEQ_EVENT_SYSEX:
+			pCount->unSysEx++;
+			pCount->unSysExBytes += pEvents[nIndex].data.ext.len;
+			break;
+		default:
+			pCount->unOther++;
+			break;
+		}
+	}
+	__atomic_add_fetch(&unOut, nCount, __ATOMIC_RELEASE);
+}
+
+static void* reactorThread(void* pReactor)
+{
+	reactorRun((reactor_t*)pReactor);
+	return NULL;
+}
+
+/* "<ms> <hex bytes>" into a notification. Returns its length, 0 for a
+ * line without a packet, -1 if it cannot be read. */
+static int32_t nParseLine(const char* pLine, uint32_t* pAtMs, uint8_t* pPdu, int32_t nSize)
+{
+	char cHex[REPLAY_LINE_LENGTH];
+	char* pEnd;
+	int32_t nHex = 0;
+
+	while (isspace((unsigned char)*pLine)){
+		pLine++;
+	}
+	if (('\0' == *pLine) || ('#' == *pLine)){
+		return 0;
+	}
+	*pAtMs = strtoul(pLine, &pEnd, 10);
+	for (pLine = pEnd; ('\0' != *pLine) && ('#' != *pLine); pLine++){
+		if (!isspace((unsigned char)*pLine)){
+			cHex[nHex++] = *pLine;
+		}
+	}
+	if ((0 == nHex) || (nHex & 1) || ((ATT_NOTIFY_HEADER + nHex / 2) > nSize)){
+		return (-1);
+	}
+	pPdu[0] = ATT_OP_NOTIFY;
+	pPdu[1] = REPLAY_VALUE_HANDLE & 0xFF;
+	pPdu[2] = REPLAY_VALUE_HANDLE >> 8;
+	if (nMidiWireDecodeHex(cHex, pPdu + ATT_NOTIFY_HEADER, nHex / 2) < 0){
+		return (-1);
+	}
+	return ATT_NOTIFY_HEADER + nHex / 2;
+}
+
+/* Sends a packet at its recorded time after ullStartNs */
+static int32_t nReplayLine(int32_t nFd, const char* pLine, uint64_t ullStartNs)
+{
+	uint8_t unPdu[BLE_CENTRAL_ATT_MTU];
+	struct timespec tAt;
+	uint64_t ullAtNs;
+	uint32_t unAtMs = 0;
+	int32_t nLen;
+
+	nLen = nParseLine(pLine, &unAtMs, unPdu, sizeof(unPdu));
+	if (nLen <= 0){
+		if (nLen < 0){
+			printf("Unreadable line skipped: %s", pLine);
+		}
+		return nLen;
+	}
+	ullAtNs = ullStartNs + unAtMs * 1000000ULL;
+	tAt.tv_sec = ullAtNs / 1000000000ULL;
+	tAt.tv_nsec = ullAtNs % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tAt, NULL) == EINTR);
+	if (send(nFd, unPdu, nLen, 0) != nLen){
+		perror("Send notification failed");
+		return (-1);
+	}
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	char cLine[REPLAY_LINE_LENGTH];
+	char cStats[STATS_REPORT_SIZE];
+	pthread_t tReactorThread, tEngineThread;
+	midi_link_t* pLink;
+	FILE* pRecording = NULL;
+	uint64_t ullStartNs;
+	uint32_t unPackets = 0, unMalformed, unSeen;
+	int32_t nFd[2], nIndex, nFailed = 0;
+
+	if ((argc > 1) && (NULL == (pRecording = fopen(argv[1], "r")))){
+		perror("Open recording failed");
+		return 1;
+	}
+	if ((nMidiOutOpen(&tMidiOut, &MIDI_OUT_NULL, NULL) < 0) ||
+			(nStatsInit(&tStats, 1) < 0) || (nReactorInit(&tReactor) < 0) ||
+			(nSeqEngineInit(&tEngine, &tMidiOut, 1, SEQ_ENGINE_DEFAULT_WINDOW_US, SEQ_ENGINE_DEFAULT_CAP_US) < 0) ||
+			(nLinkTableInit(&tLinkTable, &tReactor, &tEngine, &tStats, 1) < 0)){
+		return 1;
+	}
+	tMidiOut.pRecord = onBatch;
+	tMidiOut.pRecordContext = &tCount;
+	seqEngineAttachStats(&tEngine, &tStats);
+	midiParamsInit(&tParams);
+	seqEngineAttachParams(&tEngine, &tParams);
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, nFd) < 0){
+		perror("Create socketpair failed");
+		return 1;
+	}
+	pLink = pLinkOpen(&tLinkTable, nFd[1], "ble-replay", 0);
+	if (NULL == pLink){
+		return 1;
+	}
+	linkSetBleMidi(pLink, REPLAY_VALUE_HANDLE);
+	if ((pthread_create(&tEngineThread, NULL, seqEngineService, &tEngine) != 0) ||
+			(pthread_create(&tReactorThread, NULL, reactorThread, &tReactor) != 0)){
+		perror("Start replay threads failed");
+		return 1;
+	}
+
+	ullStartNs = ullStatsNowNs();
+	if (NULL == pRecording){
+		for (nIndex = 0; nIndex < sizeof(BUILTIN_RECORDING) / sizeof(BUILTIN_RECORDING[0]); nIndex++){
+			if (nReplayLine(nFd[0], BUILTIN_RECORDING[nIndex], ullStartNs) > 0){
+				unPackets++;
+			}
+		}
+	}else{
+		while (NULL != fgets(cLine, sizeof(cLine), pRecording)){
+			if (nReplayLine(nFd[0], cLine, ullStartNs) > 0){
+				unPackets++;
+			}
+		}
+		fclose(pRecording);
+	}
+
+	// done once nothing more comes out for a while
+	do{
+		unSeen = __atomic_load_n(&unOut, __ATOMIC_ACQUIRE);
+		usleep(REPLAY_SETTLE_NS / 1000);
+	}while (unSeen != __atomic_load_n(&unOut, __ATOMIC_ACQUIRE));
+	unMalformed = __atomic_load_n(&(pStatsForSource(&tStats, 0)->unMalformed), __ATOMIC_RELAXED);
+
+	reactorStop(&tReactor);
+	pthread_join(tReactorThread, NULL);
+	seqEngineStop(&tEngine);
+	pthread_join(tEngineThread, NULL);
+
+	printf("packets:%u note_on:%u note_off:%u other:%u sysex_chunks:%u sysex_bytes:%u malformed:%u\n",
+			unPackets, tCount.unNoteOn, tCount.unNoteOff, tCount.unOther,
+			tCount.unSysEx, tCount.unSysExBytes, unMalformed);
+	if ((argc < 2) && ((memcmp(&tCount, &BUILTIN_EXPECTED, sizeof(tCount)) != 0) ||
+			(unMalformed != BUILTIN_MALFORMED))){
+		printf("Built-in recording expected note_on:%u note_off:%u other:%u sysex_chunks:%u "
+				"sysex_bytes:%u malformed:%u\n", BUILTIN_EXPECTED.unNoteOn, BUILTIN_EXPECTED.unNoteOff,
+				BUILTIN_EXPECTED.unOther, BUILTIN_EXPECTED.unSysEx, BUILTIN_EXPECTED.unSysExBytes,
+				BUILTIN_MALFORMED);
+		nFailed = 1;
+	}
+	nStatsReport(&tStats, cStats, sizeof(cStats));
+	printf("\nDaemon side:\n%s", cStats);
+
+	close(nFd[0]);
+	linkTableRelease(&tLinkTable);
+	reactorRelease(&tReactor);
+	seqEngineRelease(&tEngine);
+	statsRelease(&tStats);
+	midiOutClose(&tMidiOut);
+	return nFailed;
+}
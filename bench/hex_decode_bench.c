@@ -0,0 +1,86 @@
+/*
+ * hex_decode_bench.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ *
+ *  Compares the old sscanf("%2hhx") frame decoding with nMidiWireDecodeHex.
+ *  Built by "make bench" in the Debug folder, run as
+ *      ./hex_decode_bench [frames]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <alsa/asoundlib.h>
+
+#include "midi_wire.h"
+
+#define BENCH_FRAME_DATA_NUMBER			4
+#define BENCH_FRAME_LENGTH				(BENCH_FRAME_DATA_NUMBER * 2 + 1)
+#define BENCH_DEFAULT_FRAMES			1000000
+#define BENCH_DISTINCT_FRAMES			4096
+
+static int32_t nDecodeSscanf(const char* pHex, uint8_t* pData, int32_t nBytes)
+{
+	int32_t nIndex;
+	for (nIndex = 0; nIndex < nBytes; nIndex++)
+		sscanf(pHex + nIndex * 2, "%2hhx", pData + nIndex);
+	return 0;
+}
+
+static double dNow(void)
+{
+	struct timespec tNow;
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	return tNow.tv_sec + tNow.tv_nsec / 1e9;
+}
+
+static double dRun(int32_t (*pDecode)(const char*, uint8_t*, int32_t),
+		char (*pFrames)[BENCH_FRAME_LENGTH], long lFrames, uint32_t* pChecksum)
+{
+	uint8_t unData[BENCH_FRAME_DATA_NUMBER];
+	uint32_t unSum = 0;
+	double dStart;
+	long lIndex;
+
+	dStart = dNow();
+	for (lIndex = 0; lIndex < lFrames; lIndex++){
+		pDecode(pFrames[lIndex % BENCH_DISTINCT_FRAMES], unData, BENCH_FRAME_DATA_NUMBER);
+		unSum += unData[0] + unData[1] + unData[2] + unData[3];
+	}
+	*pChecksum = unSum;
+	return (dNow() - dStart) * 1e9 / lFrames;
+}
+
+int main(int argc, char *argv[])
+{
+	static char cFrames[BENCH_DISTINCT_FRAMES][BENCH_FRAME_LENGTH];
+	long lFrames = (argc > 1) ? atol(argv[1]) : BENCH_DEFAULT_FRAMES;
+	uint32_t unSumSscanf, unSumTable;
+	double dSscanf, dTable;
+	int32_t nIndex;
+
+	if (lFrames <= 0){
+		lFrames = BENCH_DEFAULT_FRAMES;
+	}
+	srand(1);
+	for (nIndex = 0; nIndex < BENCH_DISTINCT_FRAMES; nIndex++){
+		snprintf(cFrames[nIndex], BENCH_FRAME_LENGTH, (nIndex & 1) ? "%02x%02x%02x%02x" : "%02X%02X%02X%02X",
+				6 + (rand() & 1), rand() & 0x0F, rand() & 0x7F, rand() & 0x7F);
+	}
+
+	dSscanf = dRun(nDecodeSscanf, cFrames, lFrames, &unSumSscanf);
+	dTable = dRun(nMidiWireDecodeHex, cFrames, lFrames, &unSumTable);
+
+	printf("frames:  %ld\n", lFrames);
+	printf("sscanf:  %8.1f ns/frame\n", dSscanf);
+	printf("table:   %8.1f ns/frame\n", dTable);
+	printf("speedup: %8.1fx\n", dSscanf / dTable);
+	if (unSumSscanf != unSumTable){
+		printf("Decoders disagree, checksum %u vs %u.\n", unSumSscanf, unSumTable);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,348 @@
+/*
+ * loopback_bench.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ *
+ *  Drives the real link, reactor and engine code over a socketpair (in
+ *  place of RFCOMM) and a pty (in place of the UART), into the null
+ *  output backend. For text and binary framing it reports sustained
+ *  notes/s, send-to-drain latency percentiles and the CPU the reactor and
+ *  engine threads spent per note. Built by "make bench" in the Debug
+ *  folder, run as
+ *      ./loopback_bench [notes]
+ *  "ping" keeps one note in flight and shows bare latency, "flood" keeps
+ *  the pipe full and shows throughput and latency under load.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pty.h>
+#include <termios.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <alsa/asoundlib.h>
+
+#include "midi_link.h"
+#include "stats.h"
+#include "midi_out.h"
+
+#define BENCH_DEFAULT_NOTES				20000
+#define BENCH_LINKS						2
+#define BENCH_FLOOD_IN_FLIGHT			256
+#define BENCH_FLOOD_BURST				16
+#define BENCH_TEXT_NOTE_LENGTH			(NOTE_FRAME_LENGTH)		// frame + '\n'
+#define BENCH_BINARY_NOTE_LENGTH		4						// [3][status][note][velocity]
+#define BENCH_DRAIN_TIMEOUT_NS			5000000000ULL
+
+typedef enum {
+	BENCH_TEXT = 0,
+	BENCH_BINARY
+}bench_framing_t;
+
+typedef enum {
+	BENCH_SOCKETPAIR = 0,
+	BENCH_PTY
+}bench_transport_t;
+
+typedef struct {
+	uint64_t* pSentNs;
+	uint64_t* pDoneNs;
+	uint32_t unNotes;
+	uint32_t unDrained;		// published by the engine thread
+}bench_run_t;
+
+static reactor_t tReactor;
+static seq_engine_t tEngine;
+static midi_link_table_t tLinkTable;
+static daemon_stats_t tStats;
+static midi_out_t tMidiOut;
+static midi_params_t tParams;
+static bench_run_t tRun;
+static FILE* pReport;
+
+/* Engine thread, once per batch */
+static void onBatch(const snd_seq_event_t* pEvents, int32_t nCount, void* pContext)
+{
+	bench_run_t* pRun = (bench_run_t*)pContext;
+	uint64_t ullNow = ullStatsNowNs();
+	uint32_t unDone = pRun->unDrained;
+	int32_t nIndex;
+
+	for (nIndex = 0; (nIndex < nCount) && (unDone < pRun->unNotes); nIndex++){
+		if (SND_SEQ_EVENT_NOTEON == pEvents[nIndex].type){
+			pRun->pDoneNs[unDone++] = ullNow;
+		}
+	}
+	__atomic_store_n(&(pRun->unDrained), unDone, __ATOMIC_RELEASE);
+}
+
+static void* reactorThread(void* pReactor)
+{
+	reactorRun((reactor_t*)pReactor);
+	return NULL;
+}
+
+/* Same line discipline the daemon puts on /dev/ttyS1, see tGetUART_Config() */
+static void setUartDiscipline(int32_t nFd)
+{
+	struct termios tSerial;
+
+	memset(&tSerial, 0, sizeof(tSerial));
+	tSerial.c_cflag = CS8 | CLOCAL | CREAD;
+	tSerial.c_iflag = IGNPAR | ICRNL;
+	tSerial.c_lflag = ICANON;
+	tSerial.c_cc[VEOF] = 4;
+	tSerial.c_cc[VMIN] = 1;
+	tcsetattr(nFd, TCSANOW, &tSerial);
+}
+
+/* Returns the player end, the daemon end is handed to a link */
+static int32_t nOpenLink(bench_transport_t tTransport)
+{
+	int32_t nFd[2];
+
+	if (BENCH_SOCKETPAIR == tTransport){
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, nFd) < 0){
+			perror("Create socketpair failed");
+			return (-1);
+		}
+	}else{
+		if (openpty(nFd, nFd + 1, NULL, NULL, NULL) < 0){
+			perror("Open pty failed");
+			return (-1);
+		}
+		setUartDiscipline(nFd[1]);
+	}
+	if (NULL == pLinkOpen(&tLinkTable, nFd[1], (BENCH_PTY == tTransport) ? "pty" : "socketpair", 0)){
+		close(nFd[0]);
+		return (-1);
+	}
+	return nFd[0];
+}
+
+static int32_t nWriteAll(int32_t nFd, const uint8_t* pData, int32_t nLen)
+{
+	int32_t nWritten;
+
+	while (nLen > 0){
+		nWritten = write(nFd, pData, nLen);
+		if (nWritten < 0){
+			if (EINTR == errno){
+				continue;
+			}
+			return (-1);
+		}
+		pData += nWritten;
+		nLen -= nWritten;
+	}
+	return 0;
+}
+
+static int32_t nHello(int32_t nFd)
+{
+	uint8_t unHello[2] = {MIDI_WIRE_HELLO, NOTE_FRAME_END_SYMBOL};
+	uint8_t unAck = 0;
+
+	if ((nWriteAll(nFd, unHello, sizeof(unHello)) < 0) ||
+			(read(nFd, &unAck, 1) != 1) || (unAck != MIDI_WIRE_HELLO)){
+		printf("Binary framing not acknowledged.\n");
+		return (-1);
+	}
+	return 0;
+}
+
+static int32_t nEncodeNote(bench_framing_t tFraming, uint32_t unIndex, uint8_t* pData)
+{
+	uint8_t unNote = unIndex & 0x7F;
+	uint8_t unVelocity = 1 + (unIndex % 127);
+
+	if (BENCH_TEXT == tFraming){
+		snprintf((char*)pData, BENCH_TEXT_NOTE_LENGTH + 1, "%02X%02X%02X%02X\n",
+				SND_SEQ_EVENT_NOTEON, 0, unNote, unVelocity);
+		return BENCH_TEXT_NOTE_LENGTH;
+	}
+	pData[0] = 3;
+	pData[1] = 0x90;
+	pData[2] = unNote;
+	pData[3] = unVelocity;
+	return BENCH_BINARY_NOTE_LENGTH;
+}
+
+static uint64_t ullThreadCpuNs(pthread_t tThread)
+{
+	struct timespec tCpu;
+	clockid_t tClock;
+
+	if ((pthread_getcpuclockid(tThread, &tClock) != 0) || (clock_gettime(tClock, &tCpu) < 0)){
+		return 0;
+	}
+	return (uint64_t)tCpu.tv_sec * 1000000000ULL + tCpu.tv_nsec;
+}
+
+static int nCompareU64(const void* pA, const void* pB)
+{
+	uint64_t ullA = *(const uint64_t*)pA, ullB = *(const uint64_t*)pB;
+	return (ullA > ullB) - (ullA < ullB);
+}
+
+static double dPercentileUs(const uint64_t* pSorted, uint32_t unCount, double dRank)
+{
+	uint32_t unIndex = (uint32_t)(dRank * unCount);
+	if (0 == unCount){
+		return 0;
+	}
+	if (unIndex >= unCount){
+		unIndex = unCount - 1;
+	}
+	return pSorted[unIndex] / 1000.0;
+}
+
+static void runOne(bench_framing_t tFraming, bench_transport_t tTransport, uint32_t unInFlight,
+		pthread_t tReactorThread, pthread_t tEngineThread)
+{
+	uint8_t cBurst[BENCH_FLOOD_BURST * BENCH_TEXT_NOTE_LENGTH + 1];
+	uint64_t ullStartNs, ullEndNs, ullCpuStart, ullDeadline;
+	uint32_t unSent = 0, unDrained = 0, unBurst, unIndex;
+	int32_t nFd, nLen;
+
+	__atomic_store_n(&(tRun.unDrained), 0, __ATOMIC_RELEASE);
+	nFd = nOpenLink(tTransport);
+	if ((nFd < 0) || ((BENCH_BINARY == tFraming) && (nHello(nFd) < 0))){
+		return;
+	}
+
+	ullCpuStart = ullThreadCpuNs(tReactorThread) + ullThreadCpuNs(tEngineThread);
+	ullStartNs = ullStatsNowNs();
+	while (unSent < tRun.unNotes){
+		unDrained = __atomic_load_n(&(tRun.unDrained), __ATOMIC_ACQUIRE);
+		if ((unSent - unDrained) >= unInFlight){
+			sched_yield();
+			continue;
+		}
+		unBurst = unInFlight - (unSent - unDrained);
+		if (unBurst > BENCH_FLOOD_BURST){
+			unBurst = BENCH_FLOOD_BURST;
+		}
+		if (unBurst > (tRun.unNotes - unSent)){
+			unBurst = tRun.unNotes - unSent;
+		}
+		nLen = 0;
+		for (unIndex = 0; unIndex < unBurst; unIndex++){
+			nLen += nEncodeNote(tFraming, unSent + unIndex, cBurst + nLen);
+		}
+		ullEndNs = ullStatsNowNs();
+		for (unIndex = 0; unIndex < unBurst; unIndex++){
+			tRun.pSentNs[unSent + unIndex] = ullEndNs;
+		}
+		if (nWriteAll(nFd, cBurst, nLen) < 0){
+			perror("Write to link failed");
+			break;
+		}
+		unSent += unBurst;
+	}
+	ullDeadline = ullStatsNowNs() + BENCH_DRAIN_TIMEOUT_NS;
+	while ((unDrained = __atomic_load_n(&(tRun.unDrained), __ATOMIC_ACQUIRE)) < unSent){
+		if (ullStatsNowNs() > ullDeadline){
+			break;
+		}
+		sched_yield();
+	}
+	ullEndNs = ullStatsNowNs();
+	ullCpuStart = ullThreadCpuNs(tReactorThread) + ullThreadCpuNs(tEngineThread) - ullCpuStart;
+
+	close(nFd);
+	while (__atomic_load_n(&(tLinkTable.nActive), __ATOMIC_ACQUIRE) > 0){
+		sched_yield();
+	}
+
+	for (unIndex = 0; unIndex < unDrained; unIndex++){
+		tRun.pDoneNs[unIndex] -= tRun.pSentNs[unIndex];
+	}
+	qsort(tRun.pDoneNs, unDrained, sizeof(uint64_t), nCompareU64);
+	fprintf(pReport, "%-6s %-10s %-5s notes:%u notes_per_s:%.0f p50_us:%.1f p99_us:%.1f p999_us:%.1f "
+			"max_us:%.1f cpu_ns_per_note:%.0f lost:%u\n",
+			(BENCH_TEXT == tFraming) ? "text" : "binary",
+			(BENCH_PTY == tTransport) ? "pty" : "socketpair",
+			(1 == unInFlight) ? "ping" : "flood",
+			unDrained, unDrained * 1e9 / (ullEndNs - ullStartNs),
+			dPercentileUs(tRun.pDoneNs, unDrained, 0.50),
+			dPercentileUs(tRun.pDoneNs, unDrained, 0.99),
+			dPercentileUs(tRun.pDoneNs, unDrained, 0.999),
+			dPercentileUs(tRun.pDoneNs, unDrained, 1.0),
+			(unDrained > 0) ? (double)ullCpuStart / unDrained : 0.0,
+			unSent - unDrained);
+}
+
+int main(int argc, char *argv[])
+{
+	static const uint32_t IN_FLIGHT[] = {1, BENCH_FLOOD_IN_FLIGHT};
+	char cStats[STATS_REPORT_SIZE];
+	pthread_t tReactorThread, tEngineThread;
+	long lNotes = (argc > 1) ? atol(argv[1]) : BENCH_DEFAULT_NOTES;
+	int32_t nFraming, nTransport, nMode;
+
+	if (lNotes <= 0){
+		lNotes = BENCH_DEFAULT_NOTES;
+	}
+	tRun.unNotes = lNotes;
+	tRun.pSentNs = calloc(lNotes, sizeof(uint64_t));
+	tRun.pDoneNs = calloc(lNotes, sizeof(uint64_t));
+	if ((NULL == tRun.pSentNs) || (NULL == tRun.pDoneNs)){
+		perror("Allocate time stamps failed");
+		return 1;
+	}
+
+	// the daemon chats on stdout per frame, keep that cost but not the noise
+	pReport = fdopen(dup(STDOUT_FILENO), "w");
+	if ((NULL == pReport) || (NULL == freopen("/dev/null", "w", stdout))){
+		perror("Redirect daemon output failed");
+		return 1;
+	}
+
+	if ((nMidiOutOpen(&tMidiOut, &MIDI_OUT_NULL, NULL) < 0) ||
+			(nStatsInit(&tStats, BENCH_LINKS) < 0) || (nReactorInit(&tReactor) < 0) ||
+			(nSeqEngineInit(&tEngine, &tMidiOut, BENCH_LINKS, SEQ_ENGINE_DEFAULT_WINDOW_US, SEQ_ENGINE_DEFAULT_CAP_US) < 0) ||
+			(nLinkTableInit(&tLinkTable, &tReactor, &tEngine, &tStats, BENCH_LINKS) < 0)){
+		return 1;
+	}
+	tMidiOut.pRecord = onBatch;
+	tMidiOut.pRecordContext = &tRun;
+	seqEngineAttachStats(&tEngine, &tStats);
+	midiParamsInit(&tParams);
+	seqEngineAttachParams(&tEngine, &tParams);
+	if ((pthread_create(&tEngineThread, NULL, seqEngineService, &tEngine) != 0) ||
+			(pthread_create(&tReactorThread, NULL, reactorThread, &tReactor) != 0)){
+		perror("Start bench threads failed");
+		return 1;
+	}
+
+	for (nFraming = BENCH_TEXT; nFraming <= BENCH_BINARY; nFraming++){
+		for (nTransport = BENCH_SOCKETPAIR; nTransport <= BENCH_PTY; nTransport++){
+			for (nMode = 0; nMode < sizeof(IN_FLIGHT) / sizeof(IN_FLIGHT[0]); nMode++){
+				runOne(nFraming, nTransport, IN_FLIGHT[nMode], tReactorThread, tEngineThread);
+			}
+		}
+	}
+
+	reactorStop(&tReactor);
+	pthread_join(tReactorThread, NULL);
+	seqEngineStop(&tEngine);
+	pthread_join(tEngineThread, NULL);
+
+	nStatsReport(&tStats, cStats, sizeof(cStats));
+	fprintf(pReport, "\nDaemon side, all runs:\n%s", cStats);
+	linkTableRelease(&tLinkTable);
+	reactorRelease(&tReactor);
+	seqEngineRelease(&tEngine);
+	statsRelease(&tStats);
+	midiOutClose(&tMidiOut);
+	fclose(pReport);
+	return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * mock_seq.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ *
+ *  Stand-in for the alsa-lib calls the sequencer engine links against
+ *  for its playout queue, so benches run without libasound. There is no
+ *  queue here, the engine stays on direct output. Link it instead of
+ *  midi.c and -lasound, together with the null output backend.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <alsa/asoundlib.h>
+
+int nCheckSnd(const char *operation, int err)
+{
+	if (err < 0){
+		printf("  Mock sequencer cannot %s.\n", operation);
+		return (-1);
+	}
+	return 0;
+}
+
+int snd_seq_drain_output(snd_seq_t *handle)
+{
+	return 0;
+}
+
+int snd_seq_alloc_named_queue(snd_seq_t *handle, const char *name)
+{
+	return (-ENOSYS);
+}
+
+int snd_seq_free_queue(snd_seq_t *handle, int q)
+{
+	return (-ENOSYS);
+}
+
+int snd_seq_control_queue(snd_seq_t *handle, int q, int type, int value, snd_seq_event_t *ev)
+{
+	return (-ENOSYS);
+}
+
+int snd_seq_get_queue_timer(snd_seq_t *handle, int q, snd_seq_queue_timer_t *timer)
+{
+	return (-ENOSYS);
+}
+
+int snd_seq_set_queue_timer(snd_seq_t *handle, int q, snd_seq_queue_timer_t *timer)
+{
+	return (-ENOSYS);
+}
+
+size_t snd_seq_queue_timer_sizeof(void)
+{
+	return 64;
+}
+
+size_t snd_timer_id_sizeof(void)
+{
+	return 64;
+}
+
+void snd_seq_queue_timer_set_id(snd_seq_queue_timer_t *info, const snd_timer_id_t *id)
+{
+}
+
+void snd_timer_id_set_class(snd_timer_id_t *id, int dev_class)
+{
+}
+
+void snd_timer_id_set_sclass(snd_timer_id_t *id, int dev_sclass)
+{
+}
+
+void snd_timer_id_set_card(snd_timer_id_t *id, int card)
+{
+}
+
+void snd_timer_id_set_device(snd_timer_id_t *id, int device)
+{
+}
+
+void snd_timer_id_set_subdevice(snd_timer_id_t *id, int subdevice)
+{
+}
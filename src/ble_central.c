@@ -0,0 +1,261 @@
+/*
+ * ble_central.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ *
+ *  Just enough of a GATT client to take notes from a BLE-MIDI controller:
+ *  connect an L2CAP socket to its ATT channel, which makes the kernel
+ *  create the LE link, find the MIDI I/O characteristic, enable its
+ *  notifications and ask for the shortest connection interval. Runs at
+ *  start up and blocks; afterwards the socket is just another link that
+ *  delivers one ATT PDU per read.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "lib/bluetooth.h"
+#include "lib/hci.h"
+#include "lib/hci_lib.h"
+#include "lib/l2cap.h"
+
+#include "log.h"
+#include "ble_central.h"
+
+#define GATT_CHARACTERISTIC_UUID		0x2803
+#define GATT_CLIENT_CONFIG_UUID			0x2902
+#define GATT_CHARACTERISTIC_ENTRY		21		// declaration handle, properties, value handle, 128 bit UUID
+
+/* 7772E5DB-3868-4112-A1A9-F2669D106BF3, in ATT byte order */
+static const uint8_t BLE_MIDI_CHARACTERISTIC[16] = {
+	0xF3, 0x6B, 0x10, 0x9D, 0x66, 0xF2, 0xA9, 0xA1,
+	0x12, 0x41, 0x68, 0x38, 0xDB, 0xE5, 0x72, 0x77
+};
+
+static void putLe16(uint8_t* pData, uint16_t unValue)
+{
+	pData[0] = unValue & 0xFF;
+	pData[1] = unValue >> 8;
+}
+
+static uint16_t unGetLe16(const uint8_t* pData)
+{
+	return pData[0] | (pData[1] << 8);
+}
+
+/* Send a request and wait for its response, notifications that arrive
+ * meanwhile are dropped. Returns the response length, or -1 on failure,
+ * timeout or an ATT error response. */
+static int32_t nAttRequest(int32_t nFd, const uint8_t* pRequest, int32_t nRequestLen,
+		uint8_t* pResponse, int32_t nResponseSize)
+{
+	struct pollfd tPoll;
+	int32_t nLen;
+
+	if (write(nFd, pRequest, nRequestLen) != nRequestLen){
+		LOG_E("Send ATT request %02X failed: %m", pRequest[0]);
+		return (-1);
+	}
+	tPoll.fd = nFd;
+	tPoll.events = POLLIN;
+	while (1){
+		if (poll(&tPoll, 1, BLE_CENTRAL_ATT_TIMEOUT_MS) <= 0){
+			LOG_E("ATT request %02X got no answer.", pRequest[0]);
+			return (-1);
+		}
+		nLen = read(nFd, pResponse, nResponseSize);
+		if (nLen <= 0){
+			LOG_E("Read ATT response failed: %m");
+			return (-1);
+		}
+		if (ATT_OP_NOTIFY == pResponse[0]){
+			continue;
+		}
+		if (ATT_OP_ERROR == pResponse[0]){
+			LOG_D("ATT request %02X refused with error %02X.", pRequest[0],
+					(nLen >= 5) ? pResponse[4] : 0);
+			return (-1);
+		}
+		return nLen;
+	}
+}
+
+/* Walk the characteristic declarations until the MIDI one shows up. A
+ * response that does not move the walk on ends it, or a broken
+ * peripheral would get the same request forever. */
+static int32_t nFindMidiCharacteristic(int32_t nFd, uint16_t* pValueHandle)
+{
+	uint8_t unRequest[7], unResponse[BLE_CENTRAL_ATT_MTU];
+	uint16_t unStart = 0x0001, unDeclaration, unPrevious;
+	int32_t nLen, nEntry, nOffset;
+
+	while (unStart != 0){
+		unPrevious = unStart;
+		unRequest[0] = ATT_OP_READ_BY_TYPE_REQ;
+		putLe16(unRequest + 1, unStart);
+		putLe16(unRequest + 3, 0xFFFF);
+		putLe16(unRequest + 5, GATT_CHARACTERISTIC_UUID);
+		nLen = nAttRequest(nFd, unRequest, sizeof(unRequest), unResponse, sizeof(unResponse));
+		if ((nLen < 2) || (unResponse[0] != ATT_OP_READ_BY_TYPE_RSP) || (unResponse[1] < 7)){
+			return (-1);	// attribute not found, the end of the table
+		}
+		nEntry = unResponse[1];
+		for (nOffset = 2; (nOffset + nEntry) <= nLen; nOffset += nEntry){
+			unDeclaration = unGetLe16(unResponse + nOffset);
+			if ((GATT_CHARACTERISTIC_ENTRY == nEntry) &&
+					(0 == memcmp(unResponse + nOffset + 5, BLE_MIDI_CHARACTERISTIC, 16))){
+				*pValueHandle = unGetLe16(unResponse + nOffset + 3);
+				return 0;
+			}
+			unStart = (0xFFFF == unDeclaration) ? 0 : (unDeclaration + 1);
+		}
+		if ((unStart != 0) && (unStart <= unPrevious)){
+			LOG_W("Characteristic discovery made no progress at handle %u.", unPrevious);
+			return (-1);
+		}
+	}
+	return (-1);
+}
+
+/* The client configuration descriptor follows the value, usually right behind it */
+static uint16_t unFindClientConfig(int32_t nFd, uint16_t unValueHandle)
+{
+	uint8_t unRequest[5], unResponse[BLE_CENTRAL_ATT_MTU];
+	int32_t nLen, nOffset;
+
+	unRequest[0] = ATT_OP_FIND_INFO_REQ;
+	putLe16(unRequest + 1, unValueHandle + 1);
+	putLe16(unRequest + 3, unValueHandle + 3);
+	nLen = nAttRequest(nFd, unRequest, sizeof(unRequest), unResponse, sizeof(unResponse));
+	if ((nLen >= 2) && (ATT_OP_FIND_INFO_RSP == unResponse[0]) && (1 == unResponse[1])){
+		for (nOffset = 2; (nOffset + 4) <= nLen; nOffset += 4){
+			if (GATT_CLIENT_CONFIG_UUID == unGetLe16(unResponse + nOffset + 2)){
+				return unGetLe16(unResponse + nOffset);
+			}
+		}
+	}
+	return unValueHandle + 1;
+}
+
+static int32_t nEnableNotifications(ble_central_conn_t* pConn)
+{
+	uint8_t unRequest[5], unResponse[BLE_CENTRAL_ATT_MTU];
+
+	// longer notifications if the controller can, the default 23 bytes work as well
+	unRequest[0] = ATT_OP_MTU_REQ;
+	putLe16(unRequest + 1, BLE_CENTRAL_ATT_MTU);
+	nAttRequest(pConn->nFd, unRequest, 3, unResponse, sizeof(unResponse));
+
+	if (nFindMidiCharacteristic(pConn->nFd, &(pConn->unValueHandle)) < 0){
+		LOG_E("No BLE-MIDI characteristic found.");
+		return (-1);
+	}
+	unRequest[0] = ATT_OP_WRITE_REQ;
+	putLe16(unRequest + 1, unFindClientConfig(pConn->nFd, pConn->unValueHandle));
+	putLe16(unRequest + 3, 0x0001);
+	if (nAttRequest(pConn->nFd, unRequest, 5, unResponse, sizeof(unResponse)) < 1){
+		LOG_E("Enable BLE-MIDI notifications failed.");
+		return (-1);
+	}
+	return 0;
+}
+
+/* The controller the socket got bound to on connect, the connection
+ * handle is only valid there */
+static int32_t nLinkDevId(int32_t nFd, bdaddr_t* pRemote)
+{
+	struct sockaddr_l2 tLocal;
+	socklen_t tLen = sizeof(tLocal);
+	char cLocal[18];
+	int32_t nDevId = -1;
+
+	if (0 == getsockname(nFd, (struct sockaddr*)&tLocal, &tLen)){
+		ba2str(&(tLocal.l2_bdaddr), cLocal);
+		nDevId = hci_devid(cLocal);
+	}
+	return (nDevId < 0) ? hci_get_route(pRemote) : nDevId;
+}
+
+/* Ask for the shortest interval with no slave latency, so a note waits
+ * at most 7.5 ms for its connection event. A refusal is not fatal. */
+static void requestShortInterval(ble_central_conn_t* pConn, bdaddr_t* pRemote)
+{
+	int32_t nDd;
+
+	pConn->nDevId = nLinkDevId(pConn->nFd, pRemote);
+	nDd = hci_open_dev(pConn->nDevId);
+	if (nDd < 0){
+		LOG_W("Open HCI device %d failed: %m", pConn->nDevId);
+		return;
+	}
+	if (hci_le_conn_update(nDd, pConn->unConnHandle, BLE_CENTRAL_INTERVAL_MIN, BLE_CENTRAL_INTERVAL_MAX,
+			BLE_CENTRAL_LATENCY, BLE_CENTRAL_SUPERVISION, BLE_CENTRAL_HCI_TIMEOUT_MS) < 0){
+		LOG_W("Connection update refused, keeping the controller's interval: %m");
+	}
+	hci_close_dev(nDd);
+}
+
+/* pAddress is XX:XX:XX:XX:XX:XX, with "/random" for a random address.
+ * Returns 0 with pConn->nFd ready for pLinkOpen(). */
+int32_t nBleCentralConnect(ble_central_conn_t* pConn, const char* pAddress)
+{
+	struct sockaddr_l2 tAddr;
+	struct l2cap_conninfo tInfo;
+	socklen_t tLen = sizeof(tInfo);
+	char cAddress[18];
+	const char* pType = strchr(pAddress, '/');
+
+	memset(pConn, 0, sizeof(ble_central_conn_t));
+	pConn->nFd = -1;
+	snprintf(cAddress, sizeof(cAddress), "%s", pAddress);
+	if (bachk(cAddress) < 0){
+		LOG_E("%s is no Bluetooth address.", pAddress);
+		return (-1);
+	}
+	pConn->nFd = socket(PF_BLUETOOTH, SOCK_SEQPACKET | SOCK_CLOEXEC, BTPROTO_L2CAP);
+	if (pConn->nFd < 0){
+		LOG_E("Open L2CAP socket failed: %m");
+		return (-1);
+	}
+
+	memset(&tAddr, 0, sizeof(tAddr));
+	tAddr.l2_family = AF_BLUETOOTH;
+	bacpy(&(tAddr.l2_bdaddr), BDADDR_ANY);
+	tAddr.l2_cid = htobs(BLE_CENTRAL_ATT_CID);
+	tAddr.l2_bdaddr_type = BDADDR_LE_PUBLIC;
+	if (bind(pConn->nFd, (struct sockaddr*)&tAddr, sizeof(tAddr)) < 0){
+		LOG_E("Bind ATT socket failed: %m");
+		goto error;
+	}
+	str2ba(cAddress, &(tAddr.l2_bdaddr));
+	tAddr.l2_bdaddr_type = ((pType != NULL) && (0 == strcmp(pType, "/random"))) ?
+			BDADDR_LE_RANDOM : BDADDR_LE_PUBLIC;
+	LOG_I("Connecting to BLE-MIDI controller %s.", pAddress);
+	if (connect(pConn->nFd, (struct sockaddr*)&tAddr, sizeof(tAddr)) < 0){
+		LOG_E("Connect %s failed: %m", pAddress);
+		goto error;
+	}
+	if (getsockopt(pConn->nFd, SOL_L2CAP, L2CAP_CONNINFO, &tInfo, &tLen) < 0){
+		LOG_E("Get LE connection handle failed: %m");
+		goto error;
+	}
+	pConn->unConnHandle = tInfo.hci_handle;
+
+	if (nEnableNotifications(pConn) < 0){
+		goto error;
+	}
+	requestShortInterval(pConn, &(tAddr.l2_bdaddr));
+	LOG_I("BLE-MIDI controller %s connected, handle %u, characteristic %u.", pAddress,
+			pConn->unConnHandle, pConn->unValueHandle);
+	return 0;
+
+error:
+	close(pConn->nFd);
+	pConn->nFd = -1;
+	return (-1);
+}
@@ -0,0 +1,46 @@
+/*
+ * ble_central.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#ifndef BLE_CENTRAL_H_
+#define BLE_CENTRAL_H_
+
+#include <stdint.h>
+
+#define BLE_CENTRAL_MAX_DEVICES			4
+#define BLE_CENTRAL_ATT_CID				4
+#define BLE_CENTRAL_ATT_MTU				247		// asked for, SysEx moves faster in long packets
+#define BLE_CENTRAL_ATT_TIMEOUT_MS		3000
+#define BLE_CENTRAL_HCI_TIMEOUT_MS		2000
+#define BLE_CENTRAL_INTERVAL_MIN		6		// 1.25 ms units, 7.5 ms is the least LE allows
+#define BLE_CENTRAL_INTERVAL_MAX		12		// 15 ms
+#define BLE_CENTRAL_LATENCY				0		// the controller may skip no connection event
+#define BLE_CENTRAL_SUPERVISION			200		// 10 ms units, 2 s
+
+#define ATT_OP_ERROR					0x01
+#define ATT_OP_MTU_REQ					0x02
+#define ATT_OP_MTU_RSP					0x03
+#define ATT_OP_FIND_INFO_REQ			0x04
+#define ATT_OP_FIND_INFO_RSP			0x05
+#define ATT_OP_READ_BY_TYPE_REQ			0x08
+#define ATT_OP_READ_BY_TYPE_RSP			0x09
+#define ATT_OP_WRITE_REQ				0x12
+#define ATT_OP_WRITE_RSP				0x13
+#define ATT_OP_NOTIFY					0x1B
+#define ATT_NOTIFY_HEADER				3		// opcode and attribute handle
+
+/* A connected BLE-MIDI controller, notifications of its MIDI I/O
+ * characteristic enabled */
+typedef struct {
+	int32_t nFd;				// L2CAP socket on the ATT channel
+	uint16_t unConnHandle;		// HCI handle of the LE link
+	uint16_t unValueHandle;		// notifications of the MIDI characteristic carry this
+	int32_t nDevId;
+}ble_central_conn_t;
+
+int32_t nBleCentralConnect(ble_central_conn_t* pConn, const char* pAddress);
+
+#endif /* BLE_CENTRAL_H_ */
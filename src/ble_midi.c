@@ -0,0 +1,88 @@
+/*
+ * ble_midi.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <alsa/asoundlib.h>
+
+#include "ble_midi.h"
+
+void bleMidiParserInit(ble_midi_parser_t* pParser)
+{
+	memset(pParser, 0, sizeof(ble_midi_parser_t));
+}
+
+/* Take the header of a new packet. Returns the bytes it used, the rest
+ * goes to nBleMidiDecode(), or -1, counted as malformed, for a packet
+ * that is no BLE-MIDI. */
+int32_t nBleMidiPacketStart(ble_midi_parser_t* pParser, midi_stream_parser_t* pStream,
+		const uint8_t* pPacket, int32_t nLen)
+{
+	if ((nLen < 2) || (0x80 != (pPacket[0] & 0xC0))){
+		pStream->unMalformed++;
+		return (-1);
+	}
+	pParser->unHigh = pPacket[0] & 0x3F;
+	pParser->unLastLow = 0;
+	pParser->nAfterStamp = 0;
+	pParser->unPackets++;
+	return 1;
+}
+
+/* A timestamp byte, moves the unfolded sender clock on */
+static void takeStamp(ble_midi_parser_t* pParser, uint8_t unByte)
+{
+	uint16_t unStampMs;
+
+	if ((unByte & 0x7F) < pParser->unLastLow){
+		pParser->unHigh = (pParser->unHigh + 1) & 0x3F;
+	}
+	pParser->unLastLow = unByte & 0x7F;
+	unStampMs = (pParser->unHigh << 7) | pParser->unLastLow;
+	if (0 == pParser->nStarted){
+		pParser->nStarted = 1;
+		pParser->unSenderUs = unStampMs * 1000;
+	}else{
+		pParser->unSenderUs += ((unStampMs - pParser->unStampMs) & BLE_MIDI_STAMP_MASK) * 1000;
+	}
+	pParser->unStampMs = unStampMs;
+	pParser->nAfterStamp = 1;
+}
+
+/* Decode the rest of a packet. Returns the number of events produced,
+ * each with its sender time in pSenderUs, *pUsed tells how many bytes
+ * were consumed. Like nMidiStreamDecode() it stops at a complete SysEx
+ * chunk, the caller takes it and feeds the rest again. */
+int32_t nBleMidiDecode(ble_midi_parser_t* pParser, midi_stream_parser_t* pStream,
+		const uint8_t* pData, int32_t nLen, snd_seq_event_t* pEvents, uint32_t* pSenderUs,
+		int32_t nMaxEvents, int32_t* pUsed)
+{
+	int32_t nIndex = 0, nEvents = 0;
+	int32_t nNew, nByteUsed;
+
+	while ((nIndex < nLen) && (nEvents < nMaxEvents)){
+		if ((pData[nIndex] & 0x80) && (0 == pParser->nAfterStamp)){
+			takeStamp(pParser, pData[nIndex++]);
+			continue;
+		}
+		pParser->nAfterStamp = 0;
+		nNew = nMidiStreamDecode(pStream, pData + nIndex, 1,
+				pEvents + nEvents, nMaxEvents - nEvents, &nByteUsed);
+		for (; nNew > 0; nNew--){
+			pSenderUs[nEvents++] = pParser->unSenderUs;
+		}
+		if (0 == nByteUsed){
+			pParser->nAfterStamp = 1;	// SysEx ended by this status, it comes again
+		}
+		nIndex += nByteUsed;
+		if (1 == pStream->nSysExReady){
+			break;
+		}
+	}
+	*pUsed = nIndex;
+	return nEvents;
+}
@@ -0,0 +1,52 @@
+/*
+ * ble_midi.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ *
+ *  BLE-MIDI packets, as they arrive in notifications of the MIDI I/O
+ *  characteristic:
+ *
+ *      [header 10hhhhhh] ([timestamp 1lllllll] [status] [data...] | [data...])...
+ *
+ *  The header carries the high 6 and each timestamp byte the low 7 bits
+ *  of the sender's 13 bit millisecond clock; a low part smaller than the
+ *  one before means the high part moved on by one. A status byte always
+ *  follows a timestamp byte, data bytes without one continue under running
+ *  status. SysEx continues over packets, a continuation packet starts
+ *  with its data right after the header.
+ */
+
+#ifndef BLE_MIDI_H_
+#define BLE_MIDI_H_
+
+#include <stdint.h>
+
+#include "midi_stream.h"
+
+#define BLE_MIDI_STAMP_MASK				0x1FFF
+#define BLE_MIDI_STAMP_WRAP_US			((BLE_MIDI_STAMP_MASK + 1) * 1000)
+
+/* Timestamp state, the MIDI bytes go to a midi_stream_parser_t. The
+ * sender clock is unfolded into 32 bits of microseconds, which is what
+ * a jitter_clock_t maps onto ours. */
+typedef struct {
+	uint8_t unHigh;
+	uint8_t unLastLow;
+	int32_t nAfterStamp;		// the next byte with bit 7 set is a status, not a timestamp
+	uint16_t unStampMs;			// 13 bit timestamp of the current message
+	int32_t nStarted;
+	uint32_t unSenderUs;
+	uint32_t unPackets;
+}ble_midi_parser_t;
+
+void bleMidiParserInit(ble_midi_parser_t* pParser);
+
+int32_t nBleMidiPacketStart(ble_midi_parser_t* pParser, midi_stream_parser_t* pStream,
+		const uint8_t* pPacket, int32_t nLen);
+
+int32_t nBleMidiDecode(ble_midi_parser_t* pParser, midi_stream_parser_t* pStream,
+		const uint8_t* pData, int32_t nLen, snd_seq_event_t* pEvents, uint32_t* pSenderUs,
+		int32_t nMaxEvents, int32_t* pUsed);
+
+#endif /* BLE_MIDI_H_ */
@@ -41,6 +41,8 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/un.h>
+#include <sys/epoll.h>
+#include <linux/serial.h>
 #include <pthread.h>
 
 #include "lib/bluetooth.h"
@@ -51,187 +53,122 @@
 #include <alsa/asoundlib.h>
 
 #include "midi.h"
+#include "seq_engine.h"
+#include "reactor.h"
+#include "midi_link.h"
+#include "stats.h"
+#include "midi_params.h"
+#include "midi_ctrl.h"
+#include "log.h"
+#include "midi_player.h"
+#include "ble_central.h"
+#include "link_tune.h"
+#include "link_policy.h"
 
 #define MAX_CLIENT_SOCKET_CNT			10
-#define NOTE_FRAME_LENGTH				sizeof("0601AE2C")	// type+channel+note+velocity
-#define NOTE_FRAME_DATA_NUMBER			((NOTE_FRAME_LENGTH - 1)/2)
-#define NOTE_FRAME_END_SYMBOL			'\n'
 #define EMPTY_PID						((pid_t)0)
 #define EMPTY_TID						((pthread_t)0)
-#define EMPTY_SOCKET					((int32_t)0)
 #define SERIAL_PORT_BAUDRATE 			B115200
+#define UNIX_CMD_STATS					"stats"
 
-typedef struct  {
-  int32_t nVolume;
-}midi_para_t;
-
-pthread_mutex_t tMidiAttrMutex = PTHREAD_MUTEX_INITIALIZER;
 static int32_t __io_canceled = 0;
-static int32_t nSocketList[MAX_CLIENT_SOCKET_CNT];
-static midi_para_t tMidiPara = {.nVolume = 50};
+static midi_params_t tMidiParams;
+static midi_filter_t tMidiFilter;
+static midi_recorder_t tMidiRecorder;
+static midi_player_t tMidiPlayer;
+static seq_engine_t tSeqEngine;
+static reactor_t tReactor;
+static reactor_t tCtrlReactor;
+static midi_link_table_t tLinkTable;
+static daemon_stats_t tStats;
+static link_tune_t tLinkTune;
+static midi_out_t tMidiOut;
 char cSndPort[128];
 
-int32_t nProgramChange(snd_seq_t *pSeq, int32_t nMyPortID, int32_t nChannel,
+int32_t nProgramChange(seq_engine_t *pEngine, int32_t nChannel,
 		int32_t nProgram, int32_t nUseless1, int32_t nUseless2);
-int32_t nSetVolume(snd_seq_t *pSeq, int32_t nMyPortID, int32_t nVolume,
+int32_t nSetVolume(seq_engine_t *pEngine, int32_t nVolume,
 		int32_t nUseless1, int32_t nUseless2, int32_t nUseless3);
-
-
-// Something interesting:
-const char* MIDI_EVENT_UNIX_FORMAT[] = {"channel:%d,instrument:%d,EMPTY_PARA_1:%d,EMPTY_PARA_2:%d\n",
-		"volume:%d,EMPTY_PARA_1:%d,EMPTY_PARA_2:%d,EMPTY_PARA_3:%d\n"};
-int32_t (*MIDI_EVENT_UNIX_FUNCTION[])() = {nProgramChange, nSetVolume};
+int32_t nSetChannelVolume(seq_engine_t *pEngine, int32_t nChannel,
+		int32_t nVolume, int32_t nUseless1, int32_t nUseless2);
+int32_t nSetTranspose(seq_engine_t *pEngine, int32_t nChannel,
+		int32_t nSemitones, int32_t nUseless1, int32_t nUseless2);
+int32_t nSetVelocityCurve(seq_engine_t *pEngine, int32_t nChannel,
+		int32_t nCurve, int32_t nUseless1, int32_t nUseless2);
+int32_t nSetVelocityKnee(seq_engine_t *pEngine, int32_t nChannel,
+		int32_t nKneeIn, int32_t nKneeOut, int32_t nUseless1);
+
+
+static int32_t nReportStats(void* pContext, char* pBuff, int32_t nSize);
+
+// Opcode is the index, text clients send the format as one line
+static const midi_ctrl_command_t MIDI_EVENT_UNIX_COMMAND[MIDI_CTRL_OP_CNT] = {
+	[MIDI_CTRL_OP_PROGRAM] = {"channel:%d,instrument:%d,EMPTY_PARA_1:%d,EMPTY_PARA_2:%d\n", 4, nProgramChange, NULL},
+	[MIDI_CTRL_OP_VOLUME] = {"volume:%d,EMPTY_PARA_1:%d,EMPTY_PARA_2:%d,EMPTY_PARA_3:%d\n", 4, nSetVolume, NULL},
+	[MIDI_CTRL_OP_CHANNEL_VOLUME] = {"channel:%d,volume:%d,EMPTY_PARA_1:%d,EMPTY_PARA_2:%d\n", 4, nSetChannelVolume, NULL},
+	[MIDI_CTRL_OP_TRANSPOSE] = {"channel:%d,transpose:%d,EMPTY_PARA_1:%d,EMPTY_PARA_2:%d\n", 4, nSetTranspose, NULL},
+	[MIDI_CTRL_OP_VELOCITY_CURVE] = {"channel:%d,velocity_curve:%d,EMPTY_PARA_1:%d,EMPTY_PARA_2:%d\n", 4, nSetVelocityCurve, NULL},
+	[MIDI_CTRL_OP_VELOCITY_KNEE] = {"channel:%d,velocity_knee:%d,knee_out:%d,EMPTY_PARA_1:%d\n", 4, nSetVelocityKnee, NULL},
+	[MIDI_CTRL_OP_STATS] = {UNIX_CMD_STATS, 0, NULL, nReportStats}
+};
 
 static void sig_term(int32_t sig)
 {
 	__io_canceled = 1;
+	reactorStop(&tReactor);
+	reactorStop(&tCtrlReactor);
 }
 
-int32_t getFreeClient(int32_t* pSocketList, int32_t nSocketListLen)
+int32_t nSetVolume(seq_engine_t *pEngine, int32_t nVolume,
+		int32_t nUseless1, int32_t nUseless2, int32_t nUseless3)
 {
-	while (nSocketListLen > 0){
-		nSocketListLen--;
-		if (EMPTY_SOCKET == pSocketList[nSocketListLen]){
-			return nSocketListLen;
-		}
-	}
-	return (-1);
+	LOG_I("Set volume to %d.", nVolume);
+	return nMidiParamsSetVolume(&tMidiParams, MIDI_PARAMS_ALL_CHANNELS, nVolume);
 }
-void setSocketSlotFree(int32_t* pSocketList, int32_t nSocketListLen, int32_t nSporeSocket)
+int32_t nSetChannelVolume(seq_engine_t *pEngine, int32_t nChannel,
+		int32_t nVolume, int32_t nUseless1, int32_t nUseless2)
 {
-	while (nSocketListLen > 0){
-		nSocketListLen--;
-		if (nSporeSocket == pSocketList[nSocketListLen]){
-			pSocketList[nSocketListLen] = EMPTY_SOCKET;
-		}
-	}
+	LOG_I("Set channel %d's volume to %d.", nChannel, nVolume);
+	return nMidiParamsSetVolume(&tMidiParams, nChannel, nVolume);
 }
-
-int32_t nSetVolume(snd_seq_t *pSeq, int32_t nMyPortID, int32_t nVolume,
-		int32_t nUseless1, int32_t nUseless2, int32_t nUseless3)
+int32_t nSetTranspose(seq_engine_t *pEngine, int32_t nChannel,
+		int32_t nSemitones, int32_t nUseless1, int32_t nUseless2)
 {
-	printf("  Set volume to %d.\n", nVolume);
-	pthread_mutex_lock(&tMidiAttrMutex);
-	tMidiPara.nVolume = nVolume;
-	pthread_mutex_unlock(&tMidiAttrMutex);
-	return 0;
+	LOG_I("Transpose channel %d by %d.", nChannel, nSemitones);
+	return nMidiParamsSetTranspose(&tMidiParams, nChannel, nSemitones);
 }
-int32_t nProgramChange(snd_seq_t *pSeq, int32_t nMyPortID, int32_t nChannel,
+int32_t nSetVelocityCurve(seq_engine_t *pEngine, int32_t nChannel,
+		int32_t nCurve, int32_t nUseless1, int32_t nUseless2)
+{
+	LOG_I("Set channel %d's velocity curve to %d.", nChannel, nCurve);
+	return nMidiParamsSetCurve(&tMidiParams, nChannel, nCurve);
+}
+int32_t nSetVelocityKnee(seq_engine_t *pEngine, int32_t nChannel,
+		int32_t nKneeIn, int32_t nKneeOut, int32_t nUseless1)
+{
+	LOG_I("Set channel %d's velocity knee to %d:%d.", nChannel, nKneeIn, nKneeOut);
+	return nMidiParamsSetKneeCurve(&tMidiParams, nChannel, nKneeIn, nKneeOut);
+}
+int32_t nProgramChange(seq_engine_t *pEngine, int32_t nChannel,
 		int32_t nProgram, int32_t nUseless1, int32_t nUseless2)
 {
 	snd_seq_event_t tSndSeqEvent;
-	printf("  Set channel %d's program to %d.\n", nChannel, nProgram);
+	LOG_I("Set channel %d's program to %d.", nChannel, nProgram);
+	if (nMidiParamsSetProgram(&tMidiParams, nChannel, nProgram) < 0){
+		return (-1);
+	}
 	snd_seq_ev_clear(&tSndSeqEvent);
-    snd_seq_ev_set_source(&tSndSeqEvent, nMyPortID);
-    snd_seq_ev_set_subs(&tSndSeqEvent);
-    snd_seq_ev_set_direct(&tSndSeqEvent);
-	snd_seq_ev_set_fixed(&tSndSeqEvent);
-
 	tSndSeqEvent.type = SND_SEQ_EVENT_PGMCHANGE;
 	tSndSeqEvent.data.control.channel = nChannel;
 	tSndSeqEvent.data.control.value = nProgram;
-	snd_seq_event_output(pSeq, &tSndSeqEvent);
-	snd_seq_drain_output(pSeq);
-	return 0;
+	return nSeqEngineSubmit(pEngine, &tSndSeqEvent);
 }
 
-int32_t executeCmdFromUnixSocket(const char* pBuff, int32_t nRc, snd_seq_t *pSeq, int32_t nMyPortID)
+static int32_t nReportStats(void* pContext, char* pBuff, int32_t nSize)
 {
-	int32_t nIndex;
-	int32_t nPara1, nPara2, nPara3, nPara4;
-	printf("  Received: %s", pBuff);
-	for (nIndex = 0; nIndex < sizeof(MIDI_EVENT_UNIX_FORMAT); nIndex++){
-		if (4 == sscanf(pBuff, MIDI_EVENT_UNIX_FORMAT[nIndex], &nPara1, &nPara2, &nPara3, &nPara4)){
-			return MIDI_EVENT_UNIX_FUNCTION[nIndex](pSeq, nMyPortID, nPara1, nPara2, nPara3, nPara4);
-		}
-	}
-	return (-1);
-}
+	int32_t nLen = nStatsReport(&tStats, pBuff, nSize);
 
-static int32_t handleReceivedDataCrossTwoFrame(char* pBuff, int32_t nAlreadyReadLength, int32_t nBuffLen)
-{
-	int32_t nEndSymbolPos;
-	static char cTemp[32];
-	// if this situation happened "/0/0/0/0/0", it is also OK
-	// Every time one new char will be red into buff and the first /0 will be removed
-	// and then one new char will be red into buff...
-	for (nEndSymbolPos = 0; nEndSymbolPos < nAlreadyReadLength; nEndSymbolPos++){
-		if (NOTE_FRAME_END_SYMBOL == pBuff[nEndSymbolPos]){
-			if (nEndSymbolPos == (nBuffLen - 1)){
-				return nBuffLen;
-			}else{
-				memset(cTemp, 0, sizeof(cTemp));
-				memcpy(cTemp, pBuff + nEndSymbolPos + 1, nAlreadyReadLength - nEndSymbolPos - 1);
-				memset(pBuff, 0, nBuffLen);
-				memcpy(pBuff, cTemp, nAlreadyReadLength - nEndSymbolPos - 1);
-				return nAlreadyReadLength - nEndSymbolPos - 1;
-			}
-		}
-	}
-	if (nAlreadyReadLength == nBuffLen){
-		perror("Buffer is full but no end symbol.");
-		memset(pBuff, 0, nBuffLen);
-		return 0;
-	}else{
-		return nAlreadyReadLength;
-	}
-
-}
-
-typedef struct{
-	snd_seq_t *pSeq;
-	snd_seq_addr_t *pPorts;
-	int32_t nClientID;
-	int32_t nPortCount;
-	int32_t nMyPortID;
-}SeqForThread_t;
-
-int32_t prepareSeqInforForThread(SeqForThread_t* pSeqInfor)
-{
-	pSeqInfor->nClientID = nInitSeq(&(pSeqInfor->pSeq));
-	if ((pSeqInfor->nClientID < 0) || (NULL == pSeqInfor->pSeq)){
-		perror("Initialize sequencer failed.");
-		if (pSeqInfor->pSeq != NULL){
-			snd_seq_close(pSeqInfor->pSeq);
-		}
-		return(-1);
-	}
-
-	pSeqInfor->nPortCount = nParsePorts(cSndPort, &(pSeqInfor->pPorts), pSeqInfor->pSeq);
-	if (pSeqInfor->nPortCount < 1) {
-		perror("Please specify at least one port.");
-		return(-1);
-	}
-
-	pSeqInfor->nMyPortID = pCreateSourcePort(pSeqInfor->pSeq);
-	if (pSeqInfor->nMyPortID < 0){
-		perror("Create source port.");
-		return(-1);
-	}
-
-	if (nConnectPorts(pSeqInfor->pSeq, pSeqInfor->nPortCount, pSeqInfor->pPorts) < 0){
-		perror("Connect to port.");
-		return(-1);
-	}
-	return 0;
-}
-
-int32_t generateEventContent(snd_seq_event_t* pSndSeqEvent, char* pEventString)
-{
-	int32_t nIndex;
-	uint8_t unEventData[NOTE_FRAME_DATA_NUMBER];
-	for (nIndex = 0; nIndex < NOTE_FRAME_DATA_NUMBER; nIndex++)
-	    sscanf(pEventString + nIndex * 2, "%2hhx", unEventData + nIndex);
-
-//	printf("  Type is: %u, Channel is: %u, Note is: %u, velocity is: %u.\n",
-//			unEventData[0], unEventData[1], unEventData[2], unEventData[3]);
-	pSndSeqEvent->type = unEventData[0];
-	pSndSeqEvent->data.note.channel = unEventData[1];
-	pSndSeqEvent->data.note.note = unEventData[2];
-//				pthread_mutex_lock(&tMidiAttrMutex);
-	pSndSeqEvent->data.note.velocity = unEventData[3];	//tMidiPara.nVolume;
-//				pthread_mutex_unlock(&tMidiAttrMutex);
-	return 0;
+	return nLen + nLinkTuneReport(&tLinkTune, pBuff + nLen, nSize - nLen);
 }
 
 struct termios tGetUART_Config(void)
@@ -292,443 +229,236 @@ struct termios tGetUART_Config(void)
 	return tSerialTemp;
 }
 
-void* UART_clientService(void* pSerialPort)
+/* Plain MIDI, 8N1 with no line discipline: every byte is readable as
+ * soon as it arrives, nothing is mapped or swallowed. */
+static struct termios tGetUART_MidiConfig(void)
 {
-	int32_t nBytesRead;
-	snd_seq_event_t tSndSeqEvent;
-	SeqForThread_t tSeqInfo;
-	char cBuff[NOTE_FRAME_LENGTH];
-	int32_t nSerialPortFd;
-	struct termios tSerial;
-
-	printf("  Start to monitor port %s.\n", (char *)pSerialPort);
-	nSerialPortFd = open(pSerialPort, O_RDWR | O_NOCTTY);
-
-    if (nSerialPortFd < 0) {
-    	perror("Open serial port failed");
-        return NULL;
-    }
-
-//    if (tcgetattr(nSerialPortFd, &tSerial) < 0) {
-//        perror("Getting serial configuration failed");
-//        return NULL;
-//    }
-    tSerial = tGetUART_Config();
+	struct termios tSerialTemp;
 
-    /*
-      now clean the modem line and activate the settings for the port
-    */
-    tcflush(nSerialPortFd, TCIFLUSH);
-    tcsetattr(nSerialPortFd, TCSANOW, &tSerial);
+	memset(&tSerialTemp, 0, sizeof(tSerialTemp));
+	tSerialTemp.c_cflag = CS8 | CLOCAL | CREAD;
+	tSerialTemp.c_iflag = IGNBRK;
+	tSerialTemp.c_oflag = 0;
+	tSerialTemp.c_lflag = 0;
+	tSerialTemp.c_cc[VTIME] = 0;
+	tSerialTemp.c_cc[VMIN] = 1;
+	return tSerialTemp;
+}
 
-    memset(&tSeqInfo, 0, sizeof(tSeqInfo));
-    if (prepareSeqInforForThread(&tSeqInfo) < 0){
-    	goto UART_HANDLER_EXIT;
-    }
-	printf("  Sequencer target port connected by UART handler.\n");
+static const struct {
+	uint32_t unBaud;
+	speed_t tSpeed;
+}UART_SPEED[] = {
+	{9600, B9600}, {19200, B19200}, {38400, B38400}, {57600, B57600},
+	{115200, B115200}, {230400, B230400}, {460800, B460800}, {921600, B921600}
+};
+
+/* A standard rate goes into the termios, anything else, MIDI's 31250,
+ * is made from 38400 with a custom divisor of the UART clock */
+static int32_t nSetUART_Speed(int32_t nFd, struct termios* pSerial, uint32_t unBaud)
+{
+	struct serial_struct tSerialInfo;
+	int32_t nIndex;
 
-	snd_seq_ev_clear(&tSndSeqEvent);
-	snd_seq_ev_set_source(&tSndSeqEvent, tSeqInfo.nMyPortID);
-	snd_seq_ev_set_subs(&tSndSeqEvent);
-	snd_seq_ev_set_direct(&tSndSeqEvent);
-	snd_seq_ev_set_fixed(&tSndSeqEvent);
-
-	memset(cBuff, 0, sizeof(cBuff));
-
-	while(0 == __io_canceled){
-		/* read blocks program execution until a line terminating character is
-		input, even if more than 255 chars are input. If the number
-		of characters read is smaller than the number of chars available,
-		subsequent reads will return the remaining chars. res will be set
-		to the actual number of characters actually read */
-		nBytesRead = read(nSerialPortFd, cBuff, sizeof(cBuff));
-		if (nBytesRead < 0){
-			printf("Read serial port failed with error number %d.\n", errno);
-			perror("Read serial port failed");
-			break;
+	for (nIndex = 0; nIndex < sizeof(UART_SPEED) / sizeof(UART_SPEED[0]); nIndex++){
+		if (UART_SPEED[nIndex].unBaud == unBaud){
+			cfsetispeed(pSerial, UART_SPEED[nIndex].tSpeed);
+			cfsetospeed(pSerial, UART_SPEED[nIndex].tSpeed);
+			return 0;
 		}
-		cBuff[sizeof(cBuff) - 1] = '\0';             /* set end of string, so we can printf */
-		printf(":%s:%d\n", cBuff, nBytesRead);
-		generateEventContent(&tSndSeqEvent, cBuff);
-		snd_seq_event_output(tSeqInfo.pSeq, &tSndSeqEvent);
-		snd_seq_drain_output(tSeqInfo.pSeq);
 	}
-	printf("  UART handler end.\n");
-UART_HANDLER_EXIT:
-	if (tSeqInfo.pPorts != NULL){
-		free(tSeqInfo.pPorts);
+	if (ioctl(nFd, TIOCGSERIAL, &tSerialInfo) < 0){
+		perror("Get serial port information failed");
+		return (-1);
 	}
-	if (tSeqInfo.nMyPortID >= 0){
-		snd_seq_delete_port(tSeqInfo.pSeq, tSeqInfo.nMyPortID);
+	if (tSerialInfo.baud_base <= 0){
+		printf("  Serial port has no clock for %u baud.\n", unBaud);
+		return (-1);
 	}
-	if (tSeqInfo.pSeq != NULL){
-		snd_seq_close(tSeqInfo.pSeq);
+	tSerialInfo.flags = (tSerialInfo.flags & ~ASYNC_SPD_MASK) | ASYNC_SPD_CUST;
+	tSerialInfo.custom_divisor = (tSerialInfo.baud_base + unBaud / 2) / unBaud;
+	if (ioctl(nFd, TIOCSSERIAL, &tSerialInfo) < 0){
+		perror("Set serial port divisor failed");
+		return (-1);
 	}
-	return NULL;
+	printf("  Serial port runs at %d baud for %u.\n",
+			tSerialInfo.baud_base / tSerialInfo.custom_divisor, unBaud);
+	cfsetispeed(pSerial, B38400);
+	cfsetospeed(pSerial, B38400);
+	return 0;
 }
 
-void* BT_clientService(void* pSporeSocket)
+/* RFCOMM listen socket became readable, take every pending connection */
+static void onRfcommAccept(reactor_handler_t* pHandler, uint32_t unEvents)
 {
-//	struct sigaction tSignalAction;
-	int32_t nBytesRead;
-	snd_seq_event_t tSndSeqEvent;
-	SeqForThread_t tSeqInfo;
-//	snd_seq_ev_note_t tNoteEvent;
-	char cBuff[NOTE_FRAME_LENGTH];
-	int32_t nNeedToReadByte;
-	int32_t nSporeSocket = *((int32_t*)pSporeSocket);
-//
-//	int32_t i;
-    if (prepareSeqInforForThread(&tSeqInfo) < 0){
-    	goto BT_HANDLER_EXIT;
-    }
-	printf("  Sequencer target port connected by new BT connection.\n");
+	struct sockaddr_rc tRemoteAddr;
+	socklen_t tAddrLen;
+	int32_t nSporeSocket;
+	link_policy_target_t tTarget;
+	midi_link_t* pLink;
+	char cDst[18];
 
-	snd_seq_ev_clear(&tSndSeqEvent);
-    snd_seq_ev_set_source(&tSndSeqEvent, tSeqInfo.nMyPortID);
-    snd_seq_ev_set_subs(&tSndSeqEvent);
-    snd_seq_ev_set_direct(&tSndSeqEvent);
-	snd_seq_ev_set_fixed(&tSndSeqEvent);
-
-	nPlayConnectedMidi(tSeqInfo.pSeq, tSeqInfo.nMyPortID);
-
-	nNeedToReadByte = NOTE_FRAME_LENGTH;
-	memset(cBuff, 0, sizeof(cBuff));
-	while(0 == __io_canceled){
-		nBytesRead = recv(nSporeSocket, cBuff + (NOTE_FRAME_LENGTH - nNeedToReadByte), nNeedToReadByte, 0);	//&tNoteEvent, sizeof(tNoteEvent), 0);
-		if(nBytesRead < 0){	//sizeof(snd_seq_event_t)) {
-			printf("  Received error with code %d.\n", errno);
-			goto BT_HANDLER_EXIT;
-		}else if (0 == nBytesRead) {
-			perror("Received empty.");
-		}else{
-			// tricky, I tried my best to explain
-//			for (i = 0 ; i < nBytesRead; i++){
-//				printf("  %02X, ", cBuff[NOTE_FRAME_LENGTH - nNeedToReadByte + i]);
-//				printf ("\n");
-//			}
-			nNeedToReadByte -= nBytesRead;
-			nNeedToReadByte = NOTE_FRAME_LENGTH - handleReceivedDataCrossTwoFrame(cBuff,
-					NOTE_FRAME_LENGTH - nNeedToReadByte, NOTE_FRAME_LENGTH);
-
-			if (0 == nNeedToReadByte){
-				printf("  BT received: %s\n", cBuff);
-				generateEventContent(&tSndSeqEvent, cBuff);
-				snd_seq_event_output(tSeqInfo.pSeq, &tSndSeqEvent);
-				snd_seq_drain_output(tSeqInfo.pSeq);
-				nNeedToReadByte = NOTE_FRAME_LENGTH;
-				memset(cBuff, 0, sizeof(cBuff));
+	while (1){
+		tAddrLen = sizeof(tRemoteAddr);
+		nSporeSocket = accept(pHandler->nFd, (struct sockaddr *) &tRemoteAddr, &tAddrLen);
+		if (nSporeSocket < 0){
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)){
+				LOG_E("Accept RFCOMM connection failed: %m");
 			}
+			return;
+		}
+		ba2str(&(tRemoteAddr.rc_bdaddr), cDst);
+		LOG_I("Client %s connected.", cDst);
+		pLink = pLinkOpen(&tLinkTable, nSporeSocket, cDst, 1);
+		// the profile takes HCI round trips, the tuner thread waits for them instead of every link
+		if ((pLink != NULL) && (0 == nLinkPolicyLocate(nSporeSocket, &(tRemoteAddr.rc_bdaddr), &tTarget))){
+			nLinkTuneProfile(&tLinkTune, &tTarget, pLink->pStats, cDst);
 		}
 	}
-
-BT_HANDLER_EXIT:
-	close(nSporeSocket);
-	setSocketSlotFree(nSocketList, MAX_CLIENT_SOCKET_CNT, nSporeSocket);
-	if (tSeqInfo.pPorts != NULL){
-		free(tSeqInfo.pPorts);
-	}
-	if (tSeqInfo.nMyPortID >= 0){
-		snd_seq_delete_port(tSeqInfo.pSeq, tSeqInfo.nMyPortID);
-	}
-	if (tSeqInfo.pSeq != NULL){
-		snd_seq_close(tSeqInfo.pSeq);
-	}
-	return NULL;
-//	exit(0);
 }
 
-#define UPDATE_MIDI_ATTR_SOCK_PATH 		"/tmp/.midi-unix"
-
-void* updateMidiAttr(void* pWhatEver)
+/* The UART is just another link, opened once at start up. unMidiBaud 0
+ * keeps the text frames, otherwise the port carries raw MIDI at that rate. */
+static int32_t nOpenUART_Link(const char* pSerialPort, uint32_t unMidiBaud)
 {
-	snd_seq_t *pSeq = NULL;
-	int32_t nClientID;
-	int32_t nPortCount;
-	int32_t nMyPortID = 0;
-	snd_seq_addr_t *pPorts = NULL;
-	int32_t nFdIndex, nRc, nOptVal = 1;
-	int32_t nServerSocket, nMaxSocketFd, nClientSocket;
-	int32_t nReadyFd;
-	uint32_t nLen;
-	uint8_t unCloseConn;
-	char cBuff[128];
-	struct sockaddr_un tServerSocketAddr, tClientSocketAddr;
-	fd_set tMasterFdSet, tWorkingFdSet;
-
-	nClientID = nInitSeq(&pSeq);
-	if ((nClientID < 0) || (NULL == pSeq)){
-		perror("Initialize sequencer failed in IPC server.");
-		if (pSeq != NULL){
-			snd_seq_close(pSeq);
-		}
-		return NULL;	//exit(1);
-	}
-	printf("  Sequencer initialized by IPC server.\n");
+	int32_t nSerialPortFd;
+	struct termios tSerial;
+	midi_link_t* pLink;
 
-	nPortCount = nParsePorts(cSndPort, &pPorts, pSeq);
-	if (nPortCount < 1) {
-		printf("  Please specify at least one port.\n");
-		goto RELEASE_IPC_SEQ;
+	printf("  Start to monitor port %s.\n", pSerialPort);
+	nSerialPortFd = open(pSerialPort, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (nSerialPortFd < 0) {
+		perror("Open serial port failed");
+		return (-1);
 	}
-	printf("  Sequencer ports parsed by IPC server.\n");
 
-	nMyPortID = pCreateSourcePort(pSeq);
-	if (nMyPortID < 0){
-		goto RELEASE_IPC_SEQ;
-	}
-	printf("  Sequencer source port created by IPC server.\n");
-	if (nConnectPorts(pSeq, nPortCount, pPorts) < 0){
-		goto RELEASE_IPC_SEQ;
+	if (0 == unMidiBaud){
+		tSerial = tGetUART_Config();
+	}else{
+		tSerial = tGetUART_MidiConfig();
+		if (nSetUART_Speed(nSerialPortFd, &tSerial, unMidiBaud) < 0){
+			close(nSerialPortFd);
+			return (-1);
+		}
 	}
-	printf("  Sequencer target port connected by IPC server.\n");
-
 
-	/* ----==== All Sequencer initialize stuff ends here ====----*/
+	/*
+	  now clean the modem line and activate the settings for the port
+	*/
+	tcflush(nSerialPortFd, TCIFLUSH);
+	tcsetattr(nSerialPortFd, TCSANOW, &tSerial);
 
-	nServerSocket = socket(AF_UNIX, SOCK_STREAM, 0);
-	if (nServerSocket < 0){
-		perror("Create Unix server socket failed.");
-		goto RELEASE_IPC_SEQ;
+	pLink = pLinkOpen(&tLinkTable, nSerialPortFd, "UART", 0);
+	if (NULL == pLink){
+		return (-1);
 	}
-
-	/*************************************************************/
-	/* Allow socket descriptor to be reuseable                   */
-	/*************************************************************/
-	nRc = setsockopt(nServerSocket, SOL_SOCKET, SO_REUSEADDR, (char *)&nOptVal, sizeof(nOptVal));
-	if (nRc < 0){
-		perror("Set server socket reusable failed");
-		close(nServerSocket);
-		goto RELEASE_IPC_SEQ;
+	if (unMidiBaud > 0){
+		linkSetRawMidi(pLink);
 	}
+	return 0;
+}
 
-	/*************************************************************/
-	/* Set server socket to be nonblocking. All of the sockets for */
-	/* the incoming connections will also be nonblocking since  */
-	/* they will inherit that state from the listening socket.   */
-	/*************************************************************/
-	nRc = ioctl(nServerSocket, FIONBIO, (char *)&nOptVal);
-	if (nRc < 0){
-		perror("Set server socket non-blocking failed");
-		close(nServerSocket);
-		goto RELEASE_IPC_SEQ;
-	}
+/* A BLE-MIDI controller is a link as well, connected once at start up */
+static int32_t nOpenBLE_Link(const char* pAddress)
+{
+	ble_central_conn_t tConn;
+	midi_link_t* pLink;
 
-	memset(&tServerSocketAddr, 0, sizeof(tServerSocketAddr));
-	tServerSocketAddr.sun_family = AF_UNIX;
-	strcpy(tServerSocketAddr.sun_path, UPDATE_MIDI_ATTR_SOCK_PATH);
-	unlink(tServerSocketAddr.sun_path);
-	nLen = strlen(tServerSocketAddr.sun_path) + sizeof(tServerSocketAddr.sun_family);
-	nRc = bind(nServerSocket, (struct sockaddr *)&tServerSocketAddr, nLen);
-	if (nRc < 0){
-		perror("Server socket bind failed");
-		close(nServerSocket);
-		goto RELEASE_IPC_SEQ;
+	if (nBleCentralConnect(&tConn, pAddress) < 0){
+		return (-1);
 	}
-	chmod(UPDATE_MIDI_ATTR_SOCK_PATH, S_IRWXU|S_IRWXG);
-	nRc = listen(nServerSocket, 8);
-	if (nRc < 0){
-		perror("Listen failed");
-		close(nServerSocket);
-		goto RELEASE_IPC_SEQ;
+	pLink = pLinkOpen(&tLinkTable, tConn.nFd, pAddress, 0);
+	if (NULL == pLink){
+		return (-1);
 	}
+	linkSetBleMidi(pLink, tConn.unValueHandle);
+	nLinkTuneAdd(&tLinkTune, &tConn, pAddress);
+	return 0;
+}
 
-	/*************************************************************/
-	/* Initialize the master fd_set                              */
-	/*************************************************************/
-	FD_ZERO(&tMasterFdSet);
-	nMaxSocketFd = nServerSocket;
-	FD_SET(nServerSocket, &tMasterFdSet);
-
-
-	/*************************************************************/
-	/* Loop waiting for incoming connects or for incoming data   */
-	/* on any of the connected sockets.                          */
-	/*************************************************************/
-	do{
-		memcpy(&tWorkingFdSet, &tMasterFdSet, sizeof(tMasterFdSet));
+#define UPDATE_MIDI_ATTR_SOCK_PATH 		"/tmp/.midi-unix"
 
-		printf("  Waiting on select()...\n");
-		nRc = select(nMaxSocketFd + 1, &tWorkingFdSet, NULL, NULL, NULL);
-		if (nRc <= 0){
-			perror("Select failed");
-			break;
-		}
+/* Control clients get their own reactor, so a burst of parameter changes
+ * never delays the links' reactor in the main thread */
+void* updateMidiAttr(void* pSeqEngine)
+{
+	midi_ctrl_server_t tServer;
 
-		/**********************************************************/
-		/* One or more descriptors are readable.  Need to         */
-		/* determine which ones they are.                         */
-		/**********************************************************/
-		nReadyFd = nRc;	// nRc here is the total count of ready Fd
-		for (nFdIndex = 0; nFdIndex <= nMaxSocketFd  &&  nReadyFd > 0; ++nFdIndex){
-			if (FD_ISSET(nFdIndex, &tWorkingFdSet)){
-				nReadyFd -= 1;
-
-				/****************************************************/
-				/* Check to see if this is the listening socket     */
-				/****************************************************/
-				if (nFdIndex == nServerSocket){
-					printf("  Someone want to connect.\n");
-					/*************************************************/
-					/* Accept all incoming connections that are      */
-					/* queued up on the listening socket before we   */
-					/* loop back and call select again.              */
-					/*************************************************/
-					do{
-						/**********************************************/
-						/* Accept each incoming connection.  If       */
-						/* accept fails with EWOULDBLOCK, then we     */
-						/* have accepted all of them.  Any other      */
-						/* failure on accept will cause us to end the */
-						/* server.                                    */
-						/**********************************************/
-						nClientSocket = accept(nServerSocket, (struct sockaddr *)&tClientSocketAddr, &nLen);
-						if (nClientSocket < 0){
-							if (errno != EWOULDBLOCK){
-								perror("Accept failed and it is not because all connection has been handled.");
-								kill(getpid(), SIGINT);
-							}
-							break;
-						}
-						/**********************************************/
-						/* Add the new incoming connection to the     */
-						/* master read set                            */
-						/**********************************************/
-						printf("  New incoming connection - %d\n", nClientSocket);
-						FD_SET(nClientSocket, &tMasterFdSet);
-						if (nClientSocket > nMaxSocketFd)
-							nMaxSocketFd = nClientSocket;
-
-					/**********************************************/
-					/* Loop back up and accept another incoming   */
-					/* connection                                 */
-					/**********************************************/
-					} while (nClientSocket != -1);
-				}else{
-					/****************************************************/
-					/* This is not the listening socket, therefore an   */
-					/* existing connection must be readable             */
-					/****************************************************/
-					printf("  Client %d did something.\n", nFdIndex);
-					unCloseConn = 0;
-					/*************************************************/
-					/* Receive all incoming data on this socket      */
-					/* before we loop back and call select again.    */
-					/*************************************************/
-					do{
-						/**********************************************/
-						/* Receive data on this connection until the  */
-						/* recv fails with EWOULDBLOCK.  If any other */
-						/* failure occurs, we will close the          */
-						/* connection.                                */
-						/**********************************************/
-						nRc = recv(nFdIndex, cBuff, sizeof(cBuff), 0);
-						if (nRc < 0){
-							if (errno != EWOULDBLOCK){
-								perror("recv() failed");
-								unCloseConn = 1;
-							}
-							break;
-						}
-
-						/**********************************************/
-						/* Check to see if the connection has been    */
-						/* closed by the client                       */
-						/**********************************************/
-						if (nRc == 0){
-							printf("  Connection closed\n");
-							unCloseConn = 1;
-							break;
-						}
-
-						/**********************************************/
-						/* Data was received                          */
-						/**********************************************/
-						cBuff[nRc] = '\0';
-						executeCmdFromUnixSocket(cBuff, nRc, pSeq, nMyPortID);
-					} while (1);
-
-					/*************************************************/
-					/* If the close_conn flag was turned on, we need */
-					/* to clean up this active connection.  This     */
-					/* clean up process includes removing the        */
-					/* descriptor from the master set and            */
-					/* determining the new maximum descriptor value  */
-					/* based on the bits that are still turned on in */
-					/* the master set.                               */
-					/*************************************************/
-					if (1 == unCloseConn){
-						close(nFdIndex);
-						FD_CLR(nFdIndex, &tMasterFdSet);
-						if (nFdIndex == nMaxSocketFd){
-							while (FD_ISSET(nMaxSocketFd, &tMasterFdSet) == 0)
-								nMaxSocketFd -= 1;
-						}
-					}
-				} /* End of existing connection is readable */
-			} /* End of if (FD_ISSET(i, &working_set)) */
-		} /* End of loop through selectable descriptors */
-	} while (0 == __io_canceled);
-
-	/*************************************************************/
-	/* Clean up all of the sockets that are open                 */
-	/* Including the server socket				                 */
-	/*************************************************************/
-	for (nFdIndex = 0; nFdIndex <= nMaxSocketFd; ++nFdIndex){
-		if (FD_ISSET(nFdIndex, &tMasterFdSet))
-		close(nFdIndex);
-	}
-
-	RELEASE_IPC_SEQ:
-	if (pPorts != NULL){
-		free(pPorts);
-	}
-	if (nMyPortID >= 0){
-		snd_seq_delete_port(pSeq, nMyPortID);
-	}
-	if (pSeq != NULL){
-		snd_seq_close(pSeq);
+	if (nReactorInit(&tCtrlReactor) < 0){
+		return NULL;
 	}
+	if (nMidiCtrlServerInit(&tServer, &tCtrlReactor, UPDATE_MIDI_ATTR_SOCK_PATH,
+			MIDI_EVENT_UNIX_COMMAND, MIDI_CTRL_OP_CNT, pSeqEngine) < 0){
+		reactorRelease(&tCtrlReactor);
+		return NULL;
+	}
+	reactorRun(&tCtrlReactor);
+	midiCtrlServerRelease(&tServer);
+	reactorRelease(&tCtrlReactor);
 	return NULL;
 }
 
 int32_t main(int32_t argc, char *argv[])
 {
 	struct sigaction tSignalAction;
-	static pthread_t tThreadList[MAX_CLIENT_SOCKET_CNT];
-	static pthread_t tUpdateMidiAttrThread, tUART_Thread;
-	int32_t nFreeSocketSlot;
+	static pthread_t tUpdateMidiAttrThread, tSeqEngineThread;
 	int32_t nRSTL;
 	pthread_attr_t tAttr;
 
 	// bt related
-	int32_t nServerSocket, nSporeSocket;
-	struct sockaddr_rc tLocalAddr, tRemoteAddr;
-	socklen_t tAddrLen;
-	char cDst[18];
+	int32_t nServerSocket;
+	struct sockaddr_rc tLocalAddr;
+	reactor_handler_t tRfcommListener;
+	int32_t nMaxClients = MAX_CLIENT_SOCKET_CNT;
 
 	// midi related
-	static const char sShortOptions[] = "hVlp:";
+	static const char sShortOptions[] = "hVlfjp:o:b:B:c:s:L:D:r:d:u:E:";
+	static const midi_out_backend_t* MIDI_OUT_BACKENDS[] = {&MIDI_OUT_SEQ, &MIDI_OUT_RAWMIDI, &MIDI_OUT_NULL};
 	static const struct option tLongOptions[] = {
 		{"help", 0, NULL, 'h'},
 		{"listVersion", 0, NULL, 'V'},
 		{"list", 0, NULL, 'l'},
 		{"port", 1, NULL, 'p'},
+		{"output", 1, NULL, 'o'},
+		{"batch-window", 1, NULL, 'b'},
+		{"batch-cap", 1, NULL, 'B'},
+		{"max-clients", 1, NULL, 'c'},
+		{"schedule", 1, NULL, 's'},
+		{"log-level", 1, NULL, 'L'},
+		{"filter", 0, NULL, 'f'},
+		{"drop-policy", 1, NULL, 'D'},
+		{"record", 1, NULL, 'r'},
+		{"journal", 0, NULL, 'j'},
+		{"delay", 1, NULL, 'd'},
+		{"uart-midi", 1, NULL, 'u'},
+		{"ble", 1, NULL, 'E'},
 		{}
 	};
-	int32_t nOpt;
+	uint32_t unBatchWindowUs = SEQ_ENGINE_DEFAULT_WINDOW_US;
+	uint32_t unBatchCapUs = SEQ_ENGINE_DEFAULT_CAP_US;
+	int32_t nPlayoutDelayUs = -1;
+	int32_t nLogStartLevel = LOG_LEVEL_INFO;
+	int32_t nOpt, nIndex;
 	snd_seq_t *pSeq = NULL;
-	int32_t nClientID;
-	int32_t nPortCount;
-	int32_t nMyPortID = 0;
 	int32_t nDoList = 0;
-	snd_seq_addr_t *pPorts = NULL;
+	int32_t nFilter = 0;
+	int32_t nDropPolicy = EVENT_MERGE_DROP_TAIL;
+	const char* pRecordPath = NULL;
+	midi_recorder_format_t tRecordFormat = MIDI_RECORDER_SMF;
+	uint32_t unSongDelaySec = 0;
+	uint32_t unUartMidiBaud = 0;
+	const char* pBleAddress[BLE_CENTRAL_MAX_DEVICES];
+	int32_t nBle = 0;
+	const midi_out_backend_t* pBackend = &MIDI_OUT_SEQ;
 
 	printf("  MIDI daemon start.\n");
 
-	memset(nSocketList, EMPTY_SOCKET, sizeof(nSocketList));
-	memset(tThreadList, EMPTY_TID, sizeof(tThreadList));
+	// the signal handler stops the reactor, so it has to exist first
+	if (nReactorInit(&tReactor) < 0){
+		exit(EXIT_FAILURE);
+	}
 
+	memset(&tSignalAction, 0, sizeof(tSignalAction));
 	tSignalAction.sa_handler = sig_term;
 	sigaction(SIGINT,  &tSignalAction, NULL);
 	printf("  Signal registration done.\n");
@@ -745,23 +475,6 @@ int32_t main(int32_t argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	nRSTL = pthread_create(&tUpdateMidiAttrThread, &tAttr, updateMidiAttr, NULL);
-	if(nRSTL)
-	{
-		perror("Start update midi attribute thread failed.");
-		exit(EXIT_FAILURE);
-	}
-
-	nClientID = nInitSeq(&pSeq);
-	if ((nClientID < 0) || (NULL == pSeq)){
-		perror("Initialize sequencer failed.");
-		if (pSeq != NULL){
-			snd_seq_close(pSeq);
-		}
-		exit(1);
-	}
-	printf("  Sequencer initialized.\n");
-
 	while ((nOpt = getopt_long(argc, argv, sShortOptions, tLongOptions, NULL)) != -1) {
 		switch (nOpt) {
 		case 'h':
@@ -773,10 +486,79 @@ int32_t main(int32_t argc, char *argv[])
 		case 'l':
 			nDoList = 1;
 			break;
+		case 'f':
+			nFilter = 1;
+			break;
+		case 'r':
+			pRecordPath = optarg;
+			break;
+		case 'j':
+			tRecordFormat = MIDI_RECORDER_JOURNAL;
+			break;
+		case 'd':
+			unSongDelaySec = strtoul(optarg, NULL, 0);
+			break;
+		case 'u':
+			unUartMidiBaud = strtoul(optarg, NULL, 0);
+			if (0 == unUartMidiBaud){
+				listUsage(argv[0]);
+				exit(0);
+			}
+			break;
+		case 'E':
+			if (BLE_CENTRAL_MAX_DEVICES == nBle){
+				listUsage(argv[0]);
+				exit(0);
+			}
+			pBleAddress[nBle++] = optarg;
+			break;
 		case 'p':
-			strcpy(cSndPort, optarg);
-			nPortCount = nParsePorts(cSndPort, &pPorts, pSeq);
-			printf("Sequencer ports parsed. \n");
+			snprintf(cSndPort, sizeof(cSndPort), "%s", optarg);
+			break;
+		case 'o':
+			pBackend = NULL;
+			for (nIndex = 0; nIndex < sizeof(MIDI_OUT_BACKENDS) / sizeof(MIDI_OUT_BACKENDS[0]); nIndex++){
+				if (0 == strcmp(optarg, MIDI_OUT_BACKENDS[nIndex]->pName)){
+					pBackend = MIDI_OUT_BACKENDS[nIndex];
+				}
+			}
+			if (NULL == pBackend){
+				listUsage(argv[0]);
+				exit(0);
+			}
+			break;
+		case 'b':
+			unBatchWindowUs = strtoul(optarg, NULL, 0);
+			break;
+		case 'B':
+			unBatchCapUs = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			nPlayoutDelayUs = atoi(optarg);
+			break;
+		case 'D':
+			for (nDropPolicy = 0; nDropPolicy < EVENT_MERGE_POLICY_CNT; nDropPolicy++){
+				if (0 == strcmp(optarg, EVENT_MERGE_POLICY_NAME[nDropPolicy])){
+					break;
+				}
+			}
+			if (EVENT_MERGE_POLICY_CNT == nDropPolicy){
+				listUsage(argv[0]);
+				exit(0);
+			}
+			break;
+		case 'L':
+			nLogStartLevel = atoi(optarg);
+			if ((nLogStartLevel < LOG_LEVEL_ERROR) || (nLogStartLevel > LOG_LEVEL_DEBUG)){
+				listUsage(argv[0]);
+				exit(0);
+			}
+			break;
+		case 'c':
+			nMaxClients = atoi(optarg);
+			if (nMaxClients < 1){
+				nMaxClients = MAX_CLIENT_SOCKET_CNT;
+			}
 			break;
 		default:
 			listUsage(argv[0]);
@@ -785,91 +567,130 @@ int32_t main(int32_t argc, char *argv[])
 	}
 
 	if (1 == nDoList) {
+		if ((nInitSeq(&pSeq) < 0) || (NULL == pSeq)){
+			perror("Initialize sequencer failed.");
+			exit(EXIT_FAILURE);
+		}
 		listPorts(pSeq);
+		snd_seq_close(pSeq);
 		exit(0);
-	} else {
-		if (nPortCount < 1) {
-			printf("  Please specify at least one port.\n");
-			erroExitHandler(pSeq, pPorts, nMyPortID);
-		}
+	}
 
-		nMyPortID = pCreateSourcePort(pSeq);
-		if (nMyPortID < 0){
-			erroExitHandler(pSeq, pPorts, nMyPortID);
-		}
-		printf("Source sequencer port created.\n");
-		if (nConnectPorts(pSeq, nPortCount, pPorts) < 0){
-			erroExitHandler(pSeq, pPorts, nMyPortID);
-		}
-		printf("Target sequencer port connected.\n");
-		nPlayReadyMidi(pSeq, nMyPortID);
+	if (nMidiOutOpen(&tMidiOut, pBackend, cSndPort) < 0){
+		exit(EXIT_FAILURE);
 	}
+	nPlayReadyMidi(&tMidiOut);
 	// midi ready
 
-	// Spore serial receiver
-	nRSTL = pthread_create(&tUART_Thread, &tAttr, UART_clientService, "/dev/ttyS1");
+	// one statistics slot per link slot, +1 for the UART, one per BLE controller, +1 for the player
+	if (nStatsInit(&tStats, nMaxClients + nBle + 2) < 0){
+		erroExitHandler(&tMidiOut);
+	}
+
+	// From now on only the engine thread touches the output, one merge queue per link slot
+	if (nSeqEngineInit(&tSeqEngine, &tMidiOut, nMaxClients + nBle + 2, unBatchWindowUs, unBatchCapUs) < 0){
+		erroExitHandler(&tMidiOut);
+	}
+	seqEngineAttachStats(&tSeqEngine, &tStats);
+	seqEngineSetDropPolicy(&tSeqEngine, nDropPolicy);
+	midiParamsInit(&tMidiParams);
+	seqEngineAttachParams(&tSeqEngine, &tMidiParams);
+	if (1 == nFilter){
+		midiFilterInit(&tMidiFilter);
+		seqEngineAttachFilter(&tSeqEngine, &tMidiFilter);
+	}
+	if ((nPlayoutDelayUs >= 0) && (nSeqEngineEnableQueue(&tSeqEngine, pMidiOutSeq(&tMidiOut), nPlayoutDelayUs) < 0)){
+		printf("  Scheduled mode unavailable, events go out direct.\n");
+	}
+
+	// from here on threads only log through the writer
+	if (nLogInit(nLogStartLevel) < 0){
+		erroExitHandler(&tMidiOut);
+	}
+	if (pRecordPath != NULL){
+		if (nMidiRecorderOpen(&tMidiRecorder, pRecordPath, tRecordFormat) < 0){
+			erroExitHandler(&tMidiOut);
+		}
+		seqEngineAttachRecorder(&tSeqEngine, &tMidiRecorder);
+	}
+	nRSTL = pthread_create(&tSeqEngineThread, NULL, seqEngineService, &tSeqEngine);
 	if(nRSTL){
-		perror("Start serial port handler thread failed.");
+		LOG_E("Start sequencer engine thread failed: %m");
+		erroExitHandler(&tMidiOut);
+	}
+
+	nRSTL = pthread_create(&tUpdateMidiAttrThread, &tAttr, updateMidiAttr, &tSeqEngine);
+	if(nRSTL)
+	{
+		LOG_E("Start update midi attribute thread failed: %m");
 		exit(EXIT_FAILURE);
 	}
 
+	// +1 for the UART and one per BLE controller, they share the table with the BT clients
+	if (nLinkTableInit(&tLinkTable, &tReactor, &tSeqEngine, &tStats, nMaxClients + nBle + 1) < 0){
+		erroExitHandler(&tMidiOut);
+	}
+
+	// Spore serial receiver
+	nOpenUART_Link("/dev/ttyS1", unUartMidiBaud);
+	linkTuneInit(&tLinkTune);
+	for (nIndex = 0; nIndex < nBle; nIndex++){
+		nOpenBLE_Link(pBleAddress[nIndex]);
+	}
+	nLinkTuneStart(&tLinkTune);
+
+	// songs on the command line play on the slot after the links, live input on top
+	if (optind < argc){
+		statsLinkOpen(&tStats, nMaxClients + nBle + 1, "player");
+		if (nMidiPlayerStart(&tMidiPlayer, &tSeqEngine, nMaxClients + nBle + 1,
+				argv + optind, argc - optind, unSongDelaySec) < 0){
+			LOG_W("Playback unavailable, serving live input only.");
+		}
+	}
+
 	// Prepare bluetooth connection
 	tLocalAddr.rc_family = AF_BLUETOOTH;
 	bacpy(&tLocalAddr.rc_bdaddr, BDADDR_ANY);
 	tLocalAddr.rc_channel = 1;	//(argc < 2) ? 1 : atoi(argv[1]);
 
-	nServerSocket = socket(AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
+	nServerSocket = socket(AF_BLUETOOTH, SOCK_STREAM | SOCK_NONBLOCK, BTPROTO_RFCOMM);
 	if (nServerSocket < 0) {
-		perror("Can't open RFCOMM control socket");
-		erroExitHandler(pSeq, pPorts, nMyPortID);
+		LOG_E("Can't open RFCOMM control socket: %m");
+		erroExitHandler(&tMidiOut);
 	}
-	printf("  Server BT port created.\n");
+	LOG_I("Server BT port created.");
 
 	if (bind(nServerSocket, (struct sockaddr *)&tLocalAddr, sizeof(tLocalAddr)) < 0) {
-		perror("Can't bind RFCOMM socket");
+		LOG_E("Can't bind RFCOMM socket: %m");
 		close(nServerSocket);
-		erroExitHandler(pSeq, pPorts, nMyPortID);
+		erroExitHandler(&tMidiOut);
 	}
-	printf("  Server BT port binded to RFCOMM.\n");
-
-	listen(nServerSocket, MAX_CLIENT_SOCKET_CNT);
+	LOG_I("Server BT port binded to RFCOMM.");
 
-	tAddrLen = sizeof(tRemoteAddr);
-	while(0 == __io_canceled){
-		printf("  Waiting for connection from client...\n");
-		nSporeSocket = accept(nServerSocket, (struct sockaddr *) &tRemoteAddr, &tAddrLen);
-		ba2str(&(tRemoteAddr.rc_bdaddr), cDst);
-		printf("  Client %s connected.\n", cDst);
-		nFreeSocketSlot = getFreeClient(nSocketList, MAX_CLIENT_SOCKET_CNT);
-		if ((-1) == nFreeSocketSlot){
-			close(nSporeSocket);
-			perror("Threads are fully powered, don't push me too hard.");
-			printf("  Socket %d nSporeSocket closed by server.\n", nSporeSocket);
-			continue;
-		}
-		nSocketList[nFreeSocketSlot] = nSporeSocket;
-		nRSTL = pthread_create(tThreadList + nFreeSocketSlot, &tAttr, BT_clientService, &nSporeSocket);
-		if(nRSTL)
-		{
-			close(nServerSocket);
-//			kill(getpid(), SIGINT);
-			perror("Create thread failed.");
-			erroExitHandler(pSeq, pPorts, nMyPortID);
-		}
+	listen(nServerSocket, nMaxClients);
 
-		usleep(100000);
+	tRfcommListener.nFd = nServerSocket;
+	tRfcommListener.pOnEvent = onRfcommAccept;
+	tRfcommListener.pContext = NULL;
+	if (nReactorAdd(&tReactor, &tRfcommListener, EPOLLIN) < 0){
+		close(nServerSocket);
+		erroExitHandler(&tMidiOut);
 	}
 
+	LOG_I("Waiting for connection from client...");
+	reactorRun(&tReactor);
+
+	midiPlayerStop(&tMidiPlayer);
+	linkTuneStop(&tLinkTune);
+	linkTableRelease(&tLinkTable);
+	reactorRelease(&tReactor);
 	close(nServerSocket);
 
-	if (pPorts != NULL){
-		free(pPorts);
-	}
-	if (nMyPortID >= 0){
-		snd_seq_delete_port(pSeq, nMyPortID);
-	}
-	if (pSeq != NULL){
-		snd_seq_close(pSeq);
-	}
+	seqEngineStop(&tSeqEngine);
+	pthread_join(tSeqEngineThread, NULL);
+	midiRecorderClose(&tMidiRecorder);
+	seqEngineRelease(&tSeqEngine);
+	statsRelease(&tStats);
+	midiOutClose(&tMidiOut);
 	exit(EXIT_SUCCESS);
 }
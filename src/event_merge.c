@@ -0,0 +1,202 @@
+/*
+ * event_merge.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <alsa/asoundlib.h>
+
+#include "log.h"
+#include "event_merge.h"
+
+const char* EVENT_MERGE_POLICY_NAME[EVENT_MERGE_POLICY_CNT] = {
+	"tail", "notes"
+};
+
+static int32_t nSourceInit(event_merge_source_t* pSource, uint32_t unSize, int32_t nWeight)
+{
+	if (nEventQueueInit(&(pSource->tQueue), unSize) < 0){
+		return (-1);
+	}
+	pSource->nWeight = nWeight;
+	__atomic_store_n(&(pSource->nReady), 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int32_t nEventMergeInit(event_merge_t* pMerge, int32_t nMaxSources)
+{
+	memset(pMerge, 0, sizeof(event_merge_t));
+	if (nSlotTableInit(&(pMerge->tSources), sizeof(event_merge_source_t), nMaxSources) < 0){
+		return (-1);
+	}
+	if (nSourceInit(&(pMerge->tOther), EVENT_MERGE_OTHER_QUEUE_SIZE, EVENT_MERGE_OTHER_WEIGHT) < 0){
+		slotTableRelease(&(pMerge->tSources));
+		return (-1);
+	}
+	pMerge->tPolicy = EVENT_MERGE_DROP_TAIL;
+	pMerge->nCurrent = EVENT_MERGE_SOURCE_OTHER;
+	return 0;
+}
+
+void eventMergeRelease(event_merge_t* pMerge)
+{
+	event_merge_source_t* pSource;
+	int32_t nIndex;
+
+	for (nIndex = 0; nIndex < nSlotTableSlots(&(pMerge->tSources)); nIndex++){
+		pSource = pSlotTableGet(&(pMerge->tSources), nIndex);
+		if (1 == pSource->nReady){
+			eventQueueRelease(&(pSource->tQueue));
+		}
+	}
+	eventQueueRelease(&(pMerge->tOther.tQueue));
+	slotTableRelease(&(pMerge->tSources));
+}
+
+/* Called by the thread that will push for nSource, before its first event.
+ * The queue is kept when the source goes away; whatever it still holds is
+ * played, and the next link in the slot reuses it. */
+int32_t nEventMergeOpenSource(event_merge_t* pMerge, int32_t nSource, int32_t nWeight,
+		link_stats_t* pStats)
+{
+	event_merge_source_t* pSource;
+
+	if (nWeight < 1){
+		nWeight = EVENT_MERGE_DEFAULT_WEIGHT;
+	}
+	nSlotTableGrowTo(&(pMerge->tSources), nSource + 1);
+	pSource = pSlotTableGet(&(pMerge->tSources), nSource);
+	if (NULL == pSource){
+		LOG_E("No merge queue for source %d.", nSource);
+		return (-1);
+	}
+	__atomic_store_n(&(pSource->pStats), pStats, __ATOMIC_RELAXED);
+	if (1 == __atomic_load_n(&(pSource->nReady), __ATOMIC_ACQUIRE)){
+		__atomic_store_n(&(pSource->nWeight), nWeight, __ATOMIC_RELAXED);
+		return 0;
+	}
+	return nSourceInit(pSource, EVENT_MERGE_SOURCE_QUEUE_SIZE, nWeight);
+}
+
+/* NULL for an id that was never opened */
+static event_merge_source_t* pSourceOf(event_merge_t* pMerge, int32_t nSource)
+{
+	event_merge_source_t* pSource;
+
+	if (EVENT_MERGE_SOURCE_OTHER == nSource){
+		return &(pMerge->tOther);
+	}
+	pSource = pSlotTableGet(&(pMerge->tSources), nSource);
+	if ((NULL == pSource) || (0 == __atomic_load_n(&(pSource->nReady), __ATOMIC_ACQUIRE))){
+		return NULL;
+	}
+	return pSource;
+}
+
+/* What a synth can lose under overload without hanging notes or
+ * losing state: a new note, and pressure that the next message repeats. */
+static int32_t nIsSheddable(const snd_seq_event_t* pEvent)
+{
+	switch (pEvent->type){
+	case SND_SEQ_EVENT_NOTEON:
+		return (pEvent->data.note.velocity > 0) ? 1 : 0;
+	case SND_SEQ_EVENT_KEYPRESS:
+	case SND_SEQ_EVENT_CHANPRESS:
+	case SND_SEQ_EVENT_PITCHBEND:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/* Safe from any thread. Returns -1 when the event was refused, full
+ * queue or shed by the drop policy; it is counted against the source. */
+int32_t nEventMergePush(event_merge_t* pMerge, const snd_seq_event_t* pEvent,
+		int32_t nSource, uint64_t ullStampNs)
+{
+	event_merge_source_t* pSource = pSourceOf(pMerge, nSource);
+	link_stats_t* pStats;
+	uint32_t unDepth;
+
+	if (NULL == pSource){
+		pSource = &(pMerge->tOther);
+	}
+	pStats = __atomic_load_n(&(pSource->pStats), __ATOMIC_RELAXED);
+	unDepth = unEventQueueDepth(&(pSource->tQueue));
+	if ((EVENT_MERGE_SHED_NOTES == pMerge->tPolicy) &&
+			(unDepth >= (pSource->tQueue.unMask + 1) / 4 * 3) && (1 == nIsSheddable(pEvent))){
+		if (pStats != NULL){
+			statsCount(&(pStats->unShed), 1);
+		}
+		return (-1);
+	}
+	if (nEventQueuePush(&(pSource->tQueue), pEvent, nSource, ullStampNs) < 0){
+		if (pStats != NULL){
+			statsCount(&(pStats->unShed), 1);
+		}
+		return (-1);
+	}
+	// racy between producers of the other source, good enough for a high-water mark
+	if ((pStats != NULL) && ((unDepth + 1) > __atomic_load_n(&(pStats->unQueuePeak), __ATOMIC_RELAXED))){
+		__atomic_store_n(&(pStats->unQueuePeak), unDepth + 1, __ATOMIC_RELAXED);
+	}
+	return 0;
+}
+
+/* Share of a turn pEvent uses up */
+static int32_t nEventCost(const snd_seq_event_t* pEvent)
+{
+	if (SND_SEQ_EVENT_SYSEX != pEvent->type){
+		return 1;
+	}
+	return 1 + pEvent->data.ext.len / EVENT_MERGE_SYSEX_TURN_BYTES;
+}
+
+/* Hand the turn to the next opened source after the current one,
+ * the other source sits between the last slot and the first. */
+static event_merge_source_t* pNextTurn(event_merge_t* pMerge, int32_t nSlots)
+{
+	event_merge_source_t* pSource;
+
+	do{
+		pMerge->nCurrent++;
+		if (pMerge->nCurrent >= nSlots){
+			pMerge->nCurrent = EVENT_MERGE_SOURCE_OTHER;
+		}
+		pSource = pSourceOf(pMerge, pMerge->nCurrent);
+	}while (NULL == pSource);
+	pSource->nDeficit += EVENT_MERGE_QUANTUM * __atomic_load_n(&(pSource->nWeight), __ATOMIC_RELAXED);
+	return pSource;
+}
+
+/* Engine thread only. Returns -1 when every source is empty. */
+int32_t nEventMergePop(event_merge_t* pMerge, snd_seq_event_t* pEvent,
+		int32_t* pSource, uint64_t* pStampNs)
+{
+	event_merge_source_t* pTurn = pSourceOf(pMerge, pMerge->nCurrent);
+	link_stats_t* pStats;
+	int32_t nSlots = nSlotTableSlots(&(pMerge->tSources));
+	int32_t nTurns;
+
+	// one turn for each source, plus finishing the current one
+	for (nTurns = 0; nTurns <= (nSlots + 1); nTurns++){
+		if ((pTurn != NULL) && (pTurn->nDeficit > 0)){
+			if (0 == nEventQueuePop(&(pTurn->tQueue), pEvent, pSource, pStampNs)){
+				pTurn->nDeficit -= nEventCost(pEvent);
+				return 0;
+			}
+			pTurn->nDeficit = 0;	// an idle source does not save up turns
+		}else if ((pTurn != NULL) && (unEventQueueDepth(&(pTurn->tQueue)) > 0)){
+			// used up its share with events still waiting
+			pStats = __atomic_load_n(&(pTurn->pStats), __ATOMIC_RELAXED);
+			if (pStats != NULL){
+				statsCount(&(pStats->unThrottled), 1);
+			}
+		}
+		pTurn = pNextTurn(pMerge, nSlots);
+	}
+	return (-1);
+}
@@ -0,0 +1,71 @@
+/*
+ * event_merge.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#ifndef EVENT_MERGE_H_
+#define EVENT_MERGE_H_
+
+#include <stdint.h>
+
+#include "event_queue.h"
+#include "slot_table.h"
+#include "stats.h"
+
+#define EVENT_MERGE_SOURCE_QUEUE_SIZE	1024	// several full reads of binary frames
+#define EVENT_MERGE_OTHER_QUEUE_SIZE	1024
+#define EVENT_MERGE_QUANTUM				16		// events per round and unit of weight
+#define EVENT_MERGE_DEFAULT_WEIGHT		1
+#define EVENT_MERGE_OTHER_WEIGHT		4		// control socket and jingles, small and urgent
+#define EVENT_MERGE_SYSEX_TURN_BYTES	32		// a SysEx chunk costs one event per this many bytes
+#define EVENT_MERGE_SOURCE_OTHER		STATS_SOURCE_OTHER
+
+typedef enum {
+	EVENT_MERGE_DROP_TAIL = 0,		// refuse whatever arrives at a full queue
+	EVENT_MERGE_SHED_NOTES,			// past 3/4 full refuse note ons and pressure, keep the rest
+	EVENT_MERGE_POLICY_CNT
+}event_merge_policy_t;
+
+extern const char* EVENT_MERGE_POLICY_NAME[EVENT_MERGE_POLICY_CNT];
+
+/* One bounded queue per source. The source's own thread pushes, the
+ * engine thread pops; nDeficit belongs to the engine thread. */
+typedef struct {
+	event_queue_t tQueue;
+	int32_t nReady;				// queue allocated, set once, never cleared
+	int32_t nWeight;
+	int32_t nDeficit;
+	link_stats_t* pStats;		// NULL when the daemon keeps no statistics
+}event_merge_source_t;
+
+/* Fair merge of all sources into the engine. Sources are served deficit
+ * round-robin: each turn a source may hand over nWeight * EVENT_MERGE_QUANTUM
+ * events, then the next one with something queued gets its turn. SysEx
+ * chunks are charged by size, so a dump moves a few chunks per turn and
+ * the notes of other sources go out in between. A source
+ * flooding the daemon only fills and overflows its own queue, the others
+ * keep their share. Source ids are link slots, anything else goes through
+ * the shared "other" source. */
+typedef struct {
+	slot_table_t tSources;		// of event_merge_source_t, by source id
+	event_merge_source_t tOther;
+	event_merge_policy_t tPolicy;
+	int32_t nCurrent;			// engine thread only, source whose turn it is
+}event_merge_t;
+
+int32_t nEventMergeInit(event_merge_t* pMerge, int32_t nMaxSources);
+
+void eventMergeRelease(event_merge_t* pMerge);
+
+int32_t nEventMergeOpenSource(event_merge_t* pMerge, int32_t nSource, int32_t nWeight,
+		link_stats_t* pStats);
+
+int32_t nEventMergePush(event_merge_t* pMerge, const snd_seq_event_t* pEvent,
+		int32_t nSource, uint64_t ullStampNs);
+
+int32_t nEventMergePop(event_merge_t* pMerge, snd_seq_event_t* pEvent,
+		int32_t* pSource, uint64_t* pStampNs);
+
+#endif /* EVENT_MERGE_H_ */
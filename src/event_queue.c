@@ -0,0 +1,113 @@
+/*
+ * event_queue.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ *
+ *  Bounded MPSC queue after Dmitry Vyukov's array based design: every cell
+ *  carries a sequence number telling producers and the consumer whose turn
+ *  it is, so neither side ever takes a lock.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <alsa/asoundlib.h>
+
+#include "event_queue.h"
+
+int32_t nEventQueueInit(event_queue_t* pQueue, uint32_t unSize)
+{
+	uint32_t unIndex;
+
+	memset(pQueue, 0, sizeof(event_queue_t));
+	/* size must be power of two so that position & mask gives the cell */
+	if ((unSize < 2) || (unSize & (unSize - 1))){
+		printf("Event queue size %u is not power of two.\n", unSize);
+		return (-1);
+	}
+
+	pQueue->pCells = calloc(unSize, sizeof(event_queue_cell_t));
+	if (NULL == pQueue->pCells){
+		perror("Allocate event queue failed");
+		return (-1);
+	}
+	for (unIndex = 0; unIndex < unSize; unIndex++){
+		pQueue->pCells[unIndex].unSequence = unIndex;
+	}
+	pQueue->unMask = unSize - 1;
+	return 0;
+}
+
+void eventQueueRelease(event_queue_t* pQueue)
+{
+	if (pQueue->pCells != NULL){
+		free(pQueue->pCells);
+		pQueue->pCells = NULL;
+	}
+}
+
+int32_t nEventQueuePush(event_queue_t* pQueue, const snd_seq_event_t* pEvent,
+		int32_t nSource, uint64_t ullStampNs)
+{
+	event_queue_cell_t* pCell;
+	uint32_t unPos, unSequence;
+	int32_t nDiff;
+
+	unPos = __atomic_load_n(&pQueue->unEnqueuePos, __ATOMIC_RELAXED);
+	for (;;){
+		pCell = &pQueue->pCells[unPos & pQueue->unMask];
+		unSequence = __atomic_load_n(&pCell->unSequence, __ATOMIC_ACQUIRE);
+		nDiff = (int32_t)(unSequence - unPos);
+		if (0 == nDiff){
+			/* cell is free for this position, try to claim it */
+			if (__atomic_compare_exchange_n(&pQueue->unEnqueuePos, &unPos, unPos + 1,
+					1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+				break;
+			}
+		}else if (nDiff < 0){
+			/* consumer has not freed this cell yet, queue is full */
+			return (-1);
+		}else{
+			unPos = __atomic_load_n(&pQueue->unEnqueuePos, __ATOMIC_RELAXED);
+		}
+	}
+
+	pCell->tEvent = *pEvent;
+	pCell->nSource = nSource;
+	pCell->ullStampNs = ullStampNs;
+	__atomic_store_n(&pCell->unSequence, unPos + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int32_t nEventQueuePop(event_queue_t* pQueue, snd_seq_event_t* pEvent,
+		int32_t* pSource, uint64_t* pStampNs)
+{
+	event_queue_cell_t* pCell;
+	uint32_t unPos, unSequence;
+
+	unPos = pQueue->unDequeuePos;
+	pCell = &pQueue->pCells[unPos & pQueue->unMask];
+	unSequence = __atomic_load_n(&pCell->unSequence, __ATOMIC_ACQUIRE);
+	if ((int32_t)(unSequence - (unPos + 1)) < 0){
+		/* empty, or producer claimed the cell but has not published yet */
+		return (-1);
+	}
+
+	*pEvent = pCell->tEvent;
+	*pSource = pCell->nSource;
+	*pStampNs = pCell->ullStampNs;
+	__atomic_store_n(&pCell->unSequence, unPos + pQueue->unMask + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&pQueue->unDequeuePos, unPos + 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/* Snapshot for producers deciding what to shed, may be off by the
+ * pushes and pops in flight. */
+uint32_t unEventQueueDepth(event_queue_t* pQueue)
+{
+	/* dequeue first, it never passes the enqueue position read after it */
+	uint32_t unDequeuePos = __atomic_load_n(&pQueue->unDequeuePos, __ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&pQueue->unEnqueuePos, __ATOMIC_RELAXED) - unDequeuePos;
+}
@@ -0,0 +1,46 @@
+/*
+ * event_queue.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#ifndef EVENT_QUEUE_H_
+#define EVENT_QUEUE_H_
+
+#include <stdint.h>
+
+#define EVENT_QUEUE_CACHE_LINE			64
+
+typedef struct {
+	uint32_t unSequence;
+	int32_t nSource;
+	uint64_t ullStampNs;
+	snd_seq_event_t tEvent;
+}event_queue_cell_t;
+
+/* Bounded multi-producer, single-consumer ring of sequencer events.
+ * Any number of threads may push, exactly one thread may pop. Each event
+ * travels with the id of its source and the time it was read. */
+typedef struct {
+	event_queue_cell_t* pCells;
+	uint32_t unMask;
+	char cPad0[EVENT_QUEUE_CACHE_LINE];
+	uint32_t unEnqueuePos;
+	char cPad1[EVENT_QUEUE_CACHE_LINE];
+	uint32_t unDequeuePos;
+}event_queue_t;
+
+int32_t nEventQueueInit(event_queue_t* pQueue, uint32_t unSize);
+
+void eventQueueRelease(event_queue_t* pQueue);
+
+int32_t nEventQueuePush(event_queue_t* pQueue, const snd_seq_event_t* pEvent,
+		int32_t nSource, uint64_t ullStampNs);
+
+int32_t nEventQueuePop(event_queue_t* pQueue, snd_seq_event_t* pEvent,
+		int32_t* pSource, uint64_t* pStampNs);
+
+uint32_t unEventQueueDepth(event_queue_t* pQueue);
+
+#endif /* EVENT_QUEUE_H_ */
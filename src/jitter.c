@@ -0,0 +1,47 @@
+/*
+ * jitter.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#include <string.h>
+
+#include "jitter.h"
+
+void jitterClockInit(jitter_clock_t* pClock)
+{
+	memset(pClock, 0, sizeof(jitter_clock_t));
+}
+
+/* Returns the local time, same base as llArrivalUs, the event should be
+ * treated as arrived at. Never later than llArrivalUs. */
+int64_t llJitterClockMap(jitter_clock_t* pClock, uint32_t unSenderUs, int64_t llArrivalUs)
+{
+	int64_t llOffset, llMin;
+
+	if (0 == pClock->nStarted){
+		pClock->nStarted = 1;
+		pClock->llSender = unSenderUs;
+		pClock->llWindowStart = llArrivalUs;
+		pClock->llMinOffset[0] = pClock->llMinOffset[1] = llArrivalUs - unSenderUs;
+	}else{
+		/* signed difference unfolds the 71 minute wrap of the sender clock */
+		pClock->llSender += (int32_t)(unSenderUs - pClock->unLastSender);
+	}
+	pClock->unLastSender = unSenderUs;
+
+	if ((llArrivalUs - pClock->llWindowStart) >= JITTER_WINDOW_US){
+		pClock->llMinOffset[1] = pClock->llMinOffset[0];
+		pClock->llMinOffset[0] = llArrivalUs - pClock->llSender;
+		pClock->llWindowStart = llArrivalUs;
+	}
+
+	llOffset = llArrivalUs - pClock->llSender;
+	if (llOffset < pClock->llMinOffset[0]){
+		pClock->llMinOffset[0] = llOffset;
+	}
+	llMin = (pClock->llMinOffset[0] < pClock->llMinOffset[1]) ?
+			pClock->llMinOffset[0] : pClock->llMinOffset[1];
+	return pClock->llSender + llMin;
+}
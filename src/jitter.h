@@ -0,0 +1,32 @@
+/*
+ * jitter.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#ifndef JITTER_H_
+#define JITTER_H_
+
+#include <stdint.h>
+
+#define JITTER_WINDOW_US				1000000
+
+/* Maps a sender's 32 bit microsecond clock onto our clock. The transit
+ * time of the fastest recent event is taken as the true offset, so an
+ * event held up in the link is placed where it would have arrived
+ * without the hold up. The minimum is kept over two rotating windows so
+ * the estimate follows clock drift between the two devices. */
+typedef struct {
+	int32_t nStarted;
+	uint32_t unLastSender;
+	int64_t llSender;			// sender clock with wraps unfolded
+	int64_t llWindowStart;
+	int64_t llMinOffset[2];		// [0] current window, [1] previous window
+}jitter_clock_t;
+
+void jitterClockInit(jitter_clock_t* pClock);
+
+int64_t llJitterClockMap(jitter_clock_t* pClock, uint32_t unSenderUs, int64_t llArrivalUs);
+
+#endif /* JITTER_H_ */
@@ -0,0 +1,125 @@
+/*
+ * link_policy.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ *
+ *  Keeps a classic Bluetooth MIDI link awake and under our control. Phones
+ *  like to put idle links into sniff mode, and the first note after a
+ *  pause then waits for the next sniff anchor, tens of milliseconds. So
+ *  every accepted RFCOMM link gets a policy without hold, sniff and park,
+ *  we take the master role, which also decides the polling, and a lost
+ *  player is noticed after 2 s instead of 20 s.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#include "lib/bluetooth.h"
+#include "lib/hci.h"
+#include "lib/hci_lib.h"
+#include "lib/rfcomm.h"
+
+#include "log.h"
+#include "link_policy.h"
+
+static int32_t nReadRole(int32_t nDd, const bdaddr_t* pRemote, int32_t* pMaster)
+{
+	struct hci_conn_info_req* pRequest;
+
+	pRequest = calloc(1, sizeof(struct hci_conn_info_req) + sizeof(struct hci_conn_info));
+	if (NULL == pRequest){
+		return (-1);
+	}
+	bacpy(&(pRequest->bdaddr), pRemote);
+	pRequest->type = ACL_LINK;
+	if (ioctl(nDd, HCIGETCONNINFO, (unsigned long)pRequest) < 0){
+		free(pRequest);
+		return (-1);
+	}
+	*pMaster = (pRequest->conn_info->link_mode & HCI_LM_MASTER) ? 1 : 0;
+	free(pRequest);
+	return 0;
+}
+
+/* Find the connection handle and the controller of the accepted RFCOMM
+ * socket nFd. Does not block. */
+int32_t nLinkPolicyLocate(int32_t nFd, const bdaddr_t* pRemote, link_policy_target_t* pTarget)
+{
+	struct rfcomm_conninfo tInfo;
+	struct sockaddr_rc tLocal;
+	socklen_t tLen = sizeof(tInfo);
+	char cLocal[18];
+
+	memset(pTarget, 0, sizeof(link_policy_target_t));
+	if (getsockopt(nFd, SOL_RFCOMM, RFCOMM_CONNINFO, &tInfo, &tLen) < 0){
+		LOG_W("Get RFCOMM connection handle failed: %m");
+		return (-1);
+	}
+	bacpy(&(pTarget->tRemote), pRemote);
+	pTarget->unConnHandle = tInfo.hci_handle;
+	pTarget->nDevId = -1;
+	tLen = sizeof(tLocal);
+	if (0 == getsockname(nFd, (struct sockaddr*)&tLocal, &tLen)){
+		ba2str(&(tLocal.rc_bdaddr), cLocal);
+		pTarget->nDevId = hci_devid(cLocal);
+	}
+	if (pTarget->nDevId < 0){
+		pTarget->nDevId = hci_get_route(&(pTarget->tRemote));
+	}
+	return 0;
+}
+
+/* Apply the profile to a located link and read back what the controller
+ * made of it. Blocks for up to LINK_POLICY_HCI_TIMEOUT_MS per command and
+ * longer for the role change, so it runs on the link tuning thread.
+ * Returns -1 if the link could not be looked at at all, it may be gone
+ * already; a refused step only clears pResult->nApplied. */
+int32_t nLinkPolicyApply(const link_policy_target_t* pTarget, link_policy_t* pResult)
+{
+	int32_t nDd, nMaster;
+
+	memset(pResult, 0, sizeof(link_policy_t));
+	nDd = hci_open_dev(pTarget->nDevId);
+	if (nDd < 0){
+		LOG_W("Open HCI device %d failed: %m", pTarget->nDevId);
+		return (-1);
+	}
+	if (nReadRole(nDd, &(pTarget->tRemote), &nMaster) < 0){
+		hci_close_dev(nDd);
+		return (-1);
+	}
+
+	pResult->nApplied = 1;
+	if (hci_write_link_policy(nDd, pTarget->unConnHandle, LINK_POLICY_ROLE_SWITCH, LINK_POLICY_HCI_TIMEOUT_MS) < 0){
+		LOG_W("Write link policy failed: %m");
+		pResult->nApplied = 0;
+	}
+	if ((0 == nMaster) && (hci_switch_role(nDd, (bdaddr_t*)&(pTarget->tRemote), 0x00, LINK_POLICY_HCI_TIMEOUT_MS) < 0)){
+		LOG_W("Switch to master role failed: %m");
+		pResult->nApplied = 0;
+	}else if (hci_write_link_supervision_timeout(nDd, pTarget->unConnHandle, LINK_POLICY_SUPERVISION,
+			LINK_POLICY_HCI_TIMEOUT_MS) < 0){
+		// only the master can write it
+		LOG_W("Write link supervision timeout failed: %m");
+		pResult->nApplied = 0;
+	}
+
+	if ((hci_read_link_policy(nDd, pTarget->unConnHandle, &(pResult->unPolicy), LINK_POLICY_HCI_TIMEOUT_MS) < 0) ||
+			(hci_read_link_supervision_timeout(nDd, pTarget->unConnHandle, &(pResult->unSupervision),
+					LINK_POLICY_HCI_TIMEOUT_MS) < 0) ||
+			(nReadRole(nDd, &(pTarget->tRemote), &(pResult->nMaster)) < 0)){
+		LOG_W("Read back link settings failed: %m");
+		pResult->nApplied = 0;
+	}else if ((pResult->unPolicy & (HCI_LP_HOLD | HCI_LP_SNIFF | HCI_LP_PARK)) ||
+			(0 == pResult->nMaster) || (pResult->unSupervision != LINK_POLICY_SUPERVISION)){
+		pResult->nApplied = 0;
+	}
+	hci_close_dev(nDd);
+	return 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * link_policy.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#ifndef LINK_POLICY_H_
+#define LINK_POLICY_H_
+
+#include <stdint.h>
+
+#define LINK_POLICY_ROLE_SWITCH			0x0001	// HCI_LP_RSWITCH, no hold, sniff or park
+#define LINK_POLICY_SUPERVISION			3200	// 0.625 ms slots, 2 s instead of the default 20 s
+#define LINK_POLICY_HCI_TIMEOUT_MS		500
+
+/* Where an accepted RFCOMM link lives, looked up on the reactor thread
+ * while the socket is surely open */
+typedef struct {
+	bdaddr_t tRemote;
+	uint16_t unConnHandle;
+	int32_t nDevId;				// controller that carries the link
+}link_policy_target_t;
+
+/* The latency profile of an RFCOMM link as read back from the controller
+ * after applying it */
+typedef struct {
+	int32_t nApplied;			// every command accepted
+	uint16_t unPolicy;			// HCI_LP_* bits
+	uint16_t unSupervision;		// 0.625 ms slots
+	int32_t nMaster;
+}link_policy_t;
+
+int32_t nLinkPolicyLocate(int32_t nFd, const bdaddr_t* pRemote, link_policy_target_t* pTarget);
+
+int32_t nLinkPolicyApply(const link_policy_target_t* pTarget, link_policy_t* pResult);
+
+#endif /* LINK_POLICY_H_ */
@@ -0,0 +1,328 @@
+/*
+ * link_tune.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "lib/bluetooth.h"
+#include "lib/hci.h"
+#include "lib/hci_lib.h"
+
+#include "log.h"
+#include "link_tune.h"
+
+/* Connection intervals tried, 1.25 ms units: 7.5, 10, 15, 20 and 30 ms */
+static const uint16_t LINK_TUNE_INTERVAL[LINK_TUNE_STEPS] = {
+	6, 8, 12, 16, 24
+};
+
+static const char* LINK_TUNE_DECISION_NAME[LINK_TUNE_DECISION_CNT] = {
+	"probe", "hold", "loss", "recover", "refused", "gone"
+};
+
+void linkTuneInit(link_tune_t* pTune)
+{
+	memset(pTune, 0, sizeof(link_tune_t));
+}
+
+/* Call before nLinkTuneStart(). Returns -1 when the controller the link
+ * is on cannot be opened, the link then keeps the interval it has. */
+int32_t nLinkTuneAdd(link_tune_t* pTune, const ble_central_conn_t* pConn, const char* pName)
+{
+	link_tune_entry_t* pEntry;
+
+	if (BLE_CENTRAL_MAX_DEVICES == pTune->nEntries){
+		return (-1);
+	}
+	pEntry = pTune->tEntries + pTune->nEntries;
+	memset(pEntry, 0, sizeof(link_tune_entry_t));
+	pEntry->nDd = hci_open_dev(pConn->nDevId);
+	if (pEntry->nDd < 0){
+		LOG_W("Open HCI device %d for %s failed: %m", pConn->nDevId, pName);
+		return (-1);
+	}
+	snprintf(pEntry->cName, sizeof(pEntry->cName), "%s", pName);
+	pEntry->unConnHandle = pConn->unConnHandle;
+	pEntry->nActive = 1;
+	pEntry->tDecision = LINK_TUNE_PROBE;
+	pTune->nEntries++;
+	return 0;
+}
+
+static void decide(link_tune_entry_t* pEntry, link_tune_decision_t tDecision)
+{
+	__atomic_store_n(&(pEntry->tDecision), tDecision, __ATOMIC_RELAXED);
+}
+
+/* hci_le_conn_update() without dropping what the controller granted.
+ * Returns 0 once the update is complete. */
+static int32_t nConnUpdate(link_tune_entry_t* pEntry, int32_t nStep)
+{
+	evt_le_connection_update_complete tComplete;
+	le_connection_update_cp tCommand;
+	struct hci_request tRequest;
+	uint64_t ullStartNs;
+
+	memset(&tCommand, 0, sizeof(tCommand));
+	tCommand.handle = htobs(pEntry->unConnHandle);
+	tCommand.min_interval = htobs(LINK_TUNE_INTERVAL[nStep]);
+	tCommand.max_interval = htobs(LINK_TUNE_INTERVAL[nStep]);
+	tCommand.latency = htobs(BLE_CENTRAL_LATENCY);
+	tCommand.supervision_timeout = htobs(BLE_CENTRAL_SUPERVISION);
+	tCommand.min_ce_length = htobs(0x0001);
+	tCommand.max_ce_length = htobs(0x0001);
+
+	memset(&tRequest, 0, sizeof(tRequest));
+	tRequest.ogf = OGF_LE_CTL;
+	tRequest.ocf = OCF_LE_CONN_UPDATE;
+	tRequest.cparam = &tCommand;
+	tRequest.clen = LE_CONN_UPDATE_CP_SIZE;
+	tRequest.event = EVT_LE_CONN_UPDATE_COMPLETE;
+	tRequest.rparam = &tComplete;
+	tRequest.rlen = sizeof(tComplete);
+
+	ullStartNs = ullStatsNowNs();
+	if ((hci_send_req(pEntry->nDd, &tRequest, LINK_TUNE_HCI_TIMEOUT_MS) < 0) || (tComplete.status != 0)){
+		statsCount(&(pEntry->unRefused), 1);
+		decide(pEntry, LINK_TUNE_REFUSED);
+		return (-1);
+	}
+	statsHistogramRecord(&(pEntry->tUpdateRtt), ullStatsNowNs() - ullStartNs);
+	__atomic_store_n(&(pEntry->unInterval), btohs(tComplete.interval), __ATOMIC_RELAXED);
+	return 0;
+}
+
+/* Step the interval to the one the controller actually granted */
+static int32_t nStepOf(uint16_t unInterval)
+{
+	int32_t nStep;
+
+	for (nStep = 0; nStep < (LINK_TUNE_STEPS - 1); nStep++){
+		if (unInterval <= LINK_TUNE_INTERVAL[nStep]){
+			break;
+		}
+	}
+	return nStep;
+}
+
+/* Shortest step first, the first one granted is the floor */
+static void probe(link_tune_entry_t* pEntry)
+{
+	int32_t nStep;
+
+	for (nStep = 0; nStep < LINK_TUNE_STEPS; nStep++){
+		if (0 == nConnUpdate(pEntry, nStep)){
+			pEntry->nFloor = pEntry->nStep = nStepOf(pEntry->unInterval);
+			decide(pEntry, LINK_TUNE_HOLD);
+			LOG_I("%s runs at a %.2f ms connection interval.", pEntry->cName,
+					pEntry->unInterval * 1.25);
+			return;
+		}
+	}
+	pEntry->nFloor = pEntry->nStep = -1;	// nothing granted, only watch the link
+	LOG_W("%s refused every connection interval, keeping its own.", pEntry->cName);
+}
+
+static int32_t nReadLink(link_tune_entry_t* pEntry)
+{
+	uint64_t ullStartNs = ullStatsNowNs();
+	int8_t nRssi;
+	uint8_t unQuality;
+
+	if (hci_read_rssi(pEntry->nDd, pEntry->unConnHandle, &nRssi, LINK_TUNE_HCI_TIMEOUT_MS) < 0){
+		return (-1);
+	}
+	statsHistogramRecord(&(pEntry->tReadRtt), ullStatsNowNs() - ullStartNs);
+	__atomic_store_n(&(pEntry->nRssi), nRssi, __ATOMIC_RELAXED);
+	if (1 == pEntry->nNoQuality){
+		return 0;
+	}
+	ullStartNs = ullStatsNowNs();
+	if (hci_read_link_quality(pEntry->nDd, pEntry->unConnHandle, &unQuality, LINK_TUNE_HCI_TIMEOUT_MS) < 0){
+		pEntry->nNoQuality = 1;		// many controllers only answer this for BR/EDR
+		return 0;
+	}
+	statsHistogramRecord(&(pEntry->tReadRtt), ullStatsNowNs() - ullStartNs);
+	__atomic_store_n(&(pEntry->unQuality), unQuality, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/* A lossy link goes one step longer, so a connection event has room for
+ * retransmissions; after LINK_TUNE_RECOVER_CHECKS clean checks it steps
+ * back towards the floor. */
+static void check(link_tune_entry_t* pEntry)
+{
+	int32_t nLossy;
+
+	statsCount(&(pEntry->unChecks), 1);
+	if (nReadLink(pEntry) < 0){
+		if (++(pEntry->nFailures) >= LINK_TUNE_MAX_FAILURES){
+			LOG_I("%s stopped answering, no longer tuned.", pEntry->cName);
+			decide(pEntry, LINK_TUNE_GONE);
+			__atomic_store_n(&(pEntry->nActive), 0, __ATOMIC_RELAXED);
+			hci_close_dev(pEntry->nDd);
+			return;
+		}
+		nLossy = (ETIMEDOUT == errno) ? 1 : 0;
+	}else{
+		pEntry->nFailures = 0;
+		nLossy = ((pEntry->nRssi < LINK_TUNE_WEAK_RSSI) ||
+				((0 == pEntry->nNoQuality) && (pEntry->unQuality < LINK_TUNE_MIN_QUALITY))) ? 1 : 0;
+	}
+
+	if (1 == nLossy){
+		statsCount(&(pEntry->unLossy), 1);
+		pEntry->nCleanChecks = 0;
+		decide(pEntry, LINK_TUNE_LOSS);
+		if ((pEntry->nStep >= 0) && (pEntry->nStep < (LINK_TUNE_STEPS - 1)) &&
+				(0 == nConnUpdate(pEntry, pEntry->nStep + 1))){
+			pEntry->nStep = nStepOf(pEntry->unInterval);
+			statsCount(&(pEntry->unLonger), 1);
+			LOG_I("%s is losing packets, interval now %.2f ms.", pEntry->cName, pEntry->unInterval * 1.25);
+		}
+		return;
+	}
+	if ((++(pEntry->nCleanChecks) >= LINK_TUNE_RECOVER_CHECKS) && (pEntry->nStep > pEntry->nFloor)){
+		pEntry->nCleanChecks = 0;
+		if (0 == nConnUpdate(pEntry, pEntry->nStep - 1)){
+			pEntry->nStep = nStepOf(pEntry->unInterval);
+			statsCount(&(pEntry->unShorter), 1);
+			decide(pEntry, LINK_TUNE_RECOVER);
+			LOG_I("%s is clean again, interval now %.2f ms.", pEntry->cName, pEntry->unInterval * 1.25);
+		}
+		return;
+	}
+	decide(pEntry, LINK_TUNE_HOLD);
+}
+
+/* Reactor thread, right after the link is opened. Returns -1 when the
+ * queue is full, the link then keeps the controller's defaults. */
+int32_t nLinkTuneProfile(link_tune_t* pTune, const link_policy_target_t* pTarget,
+		link_stats_t* pStats, const char* pName)
+{
+	link_tune_profile_t* pProfile;
+	uint32_t unHead = pTune->unProfileHead;
+
+	if ((unHead - __atomic_load_n(&(pTune->unProfileTail), __ATOMIC_ACQUIRE)) >= LINK_TUNE_MAX_PROFILES){
+		LOG_W("%s keeps its link settings, %d links wait for theirs.", pName, LINK_TUNE_MAX_PROFILES);
+		return (-1);
+	}
+	pProfile = pTune->tProfiles + (unHead % LINK_TUNE_MAX_PROFILES);
+	pProfile->tTarget = *pTarget;
+	pProfile->pStats = pStats;
+	pProfile->ullOpenedNs = (NULL == pStats) ? 0 : pStats->ullOpenedNs;
+	snprintf(pProfile->cName, sizeof(pProfile->cName), "%s", pName);
+	__atomic_store_n(&(pTune->unProfileHead), unHead + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* The stats slot is only written while it still holds the same link */
+static void applyProfiles(link_tune_t* pTune)
+{
+	link_tune_profile_t* pProfile;
+	link_policy_t tPolicy;
+	uint32_t unTail = pTune->unProfileTail;
+
+	while ((0 == pTune->nStop) && (unTail != __atomic_load_n(&(pTune->unProfileHead), __ATOMIC_ACQUIRE))){
+		pProfile = pTune->tProfiles + (unTail % LINK_TUNE_MAX_PROFILES);
+		if (0 == nLinkPolicyApply(&(pProfile->tTarget), &tPolicy)){
+			LOG_I("Link %s: local %s, policy %04X, supervision %u ms.", pProfile->cName,
+					(1 == tPolicy.nMaster) ? "master" : "slave", tPolicy.unPolicy, tPolicy.unSupervision * 5 / 8);
+			if ((pProfile->pStats != NULL) && __atomic_load_n(&(pProfile->pStats->nActive), __ATOMIC_ACQUIRE) &&
+					(pProfile->ullOpenedNs == __atomic_load_n(&(pProfile->pStats->ullOpenedNs), __ATOMIC_RELAXED))){
+				statsLinkMode(pProfile->pStats, tPolicy.nApplied, tPolicy.nMaster,
+						tPolicy.unPolicy, tPolicy.unSupervision);
+			}
+		}else{
+			LOG_I("Link %s closed before its profile was applied.", pProfile->cName);
+		}
+		__atomic_store_n(&(pTune->unProfileTail), ++unTail, __ATOMIC_RELEASE);
+	}
+}
+
+static void* linkTuneService(void* pContext)
+{
+	link_tune_t* pTune = (link_tune_t*)pContext;
+	int32_t nIndex, nWaitedMs;
+
+	for (nIndex = 0; nIndex < pTune->nEntries; nIndex++){
+		probe(pTune->tEntries + nIndex);
+	}
+	while (0 == pTune->nStop){
+		for (nWaitedMs = 0; (nWaitedMs < LINK_TUNE_PERIOD_MS) && (0 == pTune->nStop);
+				nWaitedMs += LINK_TUNE_MAX_SLEEP_MS){
+			applyProfiles(pTune);
+			usleep(LINK_TUNE_MAX_SLEEP_MS * 1000);
+		}
+		for (nIndex = 0; (nIndex < pTune->nEntries) && (0 == pTune->nStop); nIndex++){
+			if (1 == pTune->tEntries[nIndex].nActive){
+				check(pTune->tEntries + nIndex);
+			}
+		}
+	}
+	return NULL;
+}
+
+/* Runs even without BLE links, accepted RFCOMM links get their profile here */
+int32_t nLinkTuneStart(link_tune_t* pTune)
+{
+	if (pthread_create(&(pTune->tThread), NULL, linkTuneService, pTune) != 0){
+		LOG_E("Start link tuning thread failed.");
+		return (-1);
+	}
+	pTune->nRunning = 1;
+	return 0;
+}
+
+void linkTuneStop(link_tune_t* pTune)
+{
+	int32_t nIndex;
+
+	if (1 == pTune->nRunning){
+		pTune->nStop = 1;
+		pthread_join(pTune->tThread, NULL);
+		pTune->nRunning = 0;
+	}
+	for (nIndex = 0; nIndex < pTune->nEntries; nIndex++){
+		if (1 == pTune->tEntries[nIndex].nActive){
+			hci_close_dev(pTune->tEntries[nIndex].nDd);
+			pTune->tEntries[nIndex].nActive = 0;
+		}
+	}
+}
+
+#define LINK_TUNE_APPEND(expr)	do { nLen += (expr); if (nLen >= nBuffLen) return nBuffLen - 1; } while (0)
+
+/* Appended to the "stats" report, one block per tuned link */
+int32_t nLinkTuneReport(link_tune_t* pTune, char* pBuff, int32_t nBuffLen)
+{
+	link_tune_entry_t* pEntry;
+	int32_t nLen = 0, nIndex;
+
+	for (nIndex = 0; nIndex < pTune->nEntries; nIndex++){
+		pEntry = pTune->tEntries + nIndex;
+		LINK_TUNE_APPEND(snprintf(pBuff + nLen, nBuffLen - nLen,
+				"ble:%s interval_ms:%.2f rssi_dbm:%d quality:%u checks:%u lossy:%u longer:%u shorter:%u "
+				"refused:%u decision:%s\n", pEntry->cName,
+				__atomic_load_n(&(pEntry->unInterval), __ATOMIC_RELAXED) * 1.25,
+				__atomic_load_n(&(pEntry->nRssi), __ATOMIC_RELAXED),
+				__atomic_load_n(&(pEntry->unQuality), __ATOMIC_RELAXED),
+				__atomic_load_n(&(pEntry->unChecks), __ATOMIC_RELAXED),
+				__atomic_load_n(&(pEntry->unLossy), __ATOMIC_RELAXED),
+				__atomic_load_n(&(pEntry->unLonger), __ATOMIC_RELAXED),
+				__atomic_load_n(&(pEntry->unShorter), __ATOMIC_RELAXED),
+				__atomic_load_n(&(pEntry->unRefused), __ATOMIC_RELAXED),
+				LINK_TUNE_DECISION_NAME[__atomic_load_n(&(pEntry->tDecision), __ATOMIC_RELAXED)]));
+		LINK_TUNE_APPEND(nStatsReportHistogram(pBuff + nLen, nBuffLen - nLen, "read", &(pEntry->tReadRtt)));
+		LINK_TUNE_APPEND(nStatsReportHistogram(pBuff + nLen, nBuffLen - nLen, "update", &(pEntry->tUpdateRtt)));
+	}
+	return nLen;
+}
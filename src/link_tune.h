@@ -0,0 +1,103 @@
+/*
+ * link_tune.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#ifndef LINK_TUNE_H_
+#define LINK_TUNE_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "ble_central.h"
+#include "link_policy.h"
+#include "stats.h"
+
+#define LINK_TUNE_PERIOD_MS				1000	// between two checks of a link
+#define LINK_TUNE_MAX_SLEEP_MS			100		// stop requests are seen this quickly
+#define LINK_TUNE_HCI_TIMEOUT_MS		1000
+#define LINK_TUNE_MIN_QUALITY			200		// of 255, below counts as losing packets
+#define LINK_TUNE_WEAK_RSSI				(-85)	// dBm
+#define LINK_TUNE_RECOVER_CHECKS		30		// clean checks before stepping back down
+#define LINK_TUNE_MAX_FAILURES			3		// unanswered checks in a row, the link is gone
+#define LINK_TUNE_STEPS					5
+#define LINK_TUNE_MAX_PROFILES			8		// accepted RFCOMM links waiting for their profile
+
+/* What the tuner did last to a link */
+typedef enum {
+	LINK_TUNE_PROBE = 0,		// looking for the shortest interval the controller takes
+	LINK_TUNE_HOLD,				// link clean, interval kept
+	LINK_TUNE_LOSS,				// losing packets, interval made longer
+	LINK_TUNE_RECOVER,			// clean long enough, interval made shorter again
+	LINK_TUNE_REFUSED,			// controller kept its interval
+	LINK_TUNE_GONE,				// link no longer answers
+	LINK_TUNE_DECISION_CNT
+}link_tune_decision_t;
+
+/* One BLE-MIDI link. The tuner thread writes, the stats report reads
+ * with relaxed atomics. */
+typedef struct {
+	char cName[STATS_NAME_LENGTH];
+	uint16_t unConnHandle;
+	int32_t nDd;				// HCI socket of the controller the link is on
+	int32_t nActive;
+	int32_t nFloor;				// shortest step the controller granted
+	int32_t nStep;				// index into the interval steps
+	uint16_t unInterval;		// granted, 1.25 ms units
+	int8_t nRssi;
+	uint8_t unQuality;
+	int32_t nNoQuality;			// controller cannot tell link quality on LE
+	int32_t nCleanChecks;
+	int32_t nFailures;
+	link_tune_decision_t tDecision;
+	uint32_t unChecks;
+	uint32_t unLossy;
+	uint32_t unLonger;
+	uint32_t unShorter;
+	uint32_t unRefused;
+	stats_histogram_t tReadRtt;		// RSSI and link quality command -> complete
+	stats_histogram_t tUpdateRtt;	// connection update command -> update complete
+}link_tune_entry_t;
+
+/* An accepted RFCOMM link handed over by the reactor thread. ullOpenedNs
+ * tells whether pStats still belongs to it once the profile is applied. */
+typedef struct {
+	link_policy_target_t tTarget;
+	link_stats_t* pStats;
+	uint64_t ullOpenedNs;
+	char cName[STATS_NAME_LENGTH];
+}link_tune_profile_t;
+
+/* Keeps BLE-MIDI links on the shortest connection interval they can
+ * hold. Each link is probed from 7.5 ms upwards once, then read every
+ * LINK_TUNE_PERIOD_MS for RSSI and link quality on a thread of its own,
+ * since HCI commands block until the controller answers. The same thread
+ * applies the latency profile to accepted RFCOMM links, which the
+ * reactor queues in tProfiles, a single producer ring. */
+typedef struct {
+	link_tune_entry_t tEntries[BLE_CENTRAL_MAX_DEVICES];
+	int32_t nEntries;
+	link_tune_profile_t tProfiles[LINK_TUNE_MAX_PROFILES];
+	uint32_t unProfileHead;		// written by the reactor thread
+	uint32_t unProfileTail;		// written by the tuner thread
+	pthread_t tThread;
+	int32_t nRunning;
+	volatile int32_t nStop;
+}link_tune_t;
+
+void linkTuneInit(link_tune_t* pTune);
+
+int32_t nLinkTuneAdd(link_tune_t* pTune, const ble_central_conn_t* pConn, const char* pName);
+
+int32_t nLinkTuneProfile(link_tune_t* pTune, const link_policy_target_t* pTarget,
+		link_stats_t* pStats, const char* pName);
+
+int32_t nLinkTuneStart(link_tune_t* pTune);
+
+void linkTuneStop(link_tune_t* pTune);
+
+int32_t nLinkTuneReport(link_tune_t* pTune, char* pBuff, int32_t nBuffLen);
+
+#endif /* LINK_TUNE_H_ */
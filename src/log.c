@@ -0,0 +1,230 @@
+/*
+ * log.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "log.h"
+
+#define LOG_OUT_BUFFER_SIZE				8192
+#define LOG_LEVEL_LETTERS				"EWID"
+
+int32_t nLogLevel = LOG_LEVEL_INFO;
+
+static log_ring_t* pRings = NULL;
+static __thread log_ring_t* pThreadRing = NULL;
+static pthread_t tWriterThread;
+static int32_t nWriterRunning = 0;
+static volatile int32_t nWriterStop = 0;
+
+static uint64_t ullLogNowNs(void)
+{
+	struct timespec tNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	return (uint64_t)tNow.tv_sec * 1000000000ULL + tNow.tv_nsec;
+}
+
+/* Rings are only ever added, so the writer can walk the list without a lock.
+ * They live until the process exits, like the threads that own them. */
+static log_ring_t* pGetThreadRing(void)
+{
+	log_ring_t* pRing = pThreadRing;
+
+	if (pRing != NULL){
+		return pRing;
+	}
+	pRing = calloc(1, sizeof(log_ring_t));
+	if (NULL == pRing){
+		return NULL;
+	}
+	pRing->pNext = __atomic_load_n(&pRings, __ATOMIC_RELAXED);
+	while (0 == __atomic_compare_exchange_n(&pRings, &(pRing->pNext), pRing, 1,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED)){
+		/* pNext was refreshed by the failed exchange */
+	}
+	pThreadRing = pRing;
+	return pRing;
+}
+
+/* Returns 0 when the line may go out, and how many were held back before it.
+ * Threads sharing a site race on it, the limit is approximate by design. */
+static int32_t nRateLimit(log_site_t* pSite, uint64_t ullNow, uint32_t* pSuppressed)
+{
+	uint64_t ullStart = __atomic_load_n(&(pSite->ullWindowStartNs), __ATOMIC_RELAXED);
+
+	if ((ullNow - ullStart) >= LOG_RATE_WINDOW_NS){
+		__atomic_store_n(&(pSite->ullWindowStartNs), ullNow, __ATOMIC_RELAXED);
+		__atomic_store_n(&(pSite->unInWindow), 0, __ATOMIC_RELAXED);
+	}
+	if (__atomic_add_fetch(&(pSite->unInWindow), 1, __ATOMIC_RELAXED) > LOG_RATE_BURST){
+		__atomic_add_fetch(&(pSite->unSuppressed), 1, __ATOMIC_RELAXED);
+		return (-1);
+	}
+	*pSuppressed = __atomic_exchange_n(&(pSite->unSuppressed), 0, __ATOMIC_RELAXED);
+	return 0;
+}
+
+static void formatRecord(log_record_t* pRecord, int32_t nLevel, uint64_t ullNow,
+		uint32_t unSuppressed, const char* pFormat, va_list tArgs)
+{
+	int32_t nLen;
+
+	pRecord->ullStampNs = ullNow;
+	pRecord->nLevel = nLevel;
+	nLen = vsnprintf(pRecord->cText, LOG_LINE_SIZE, pFormat, tArgs);
+	if (nLen >= LOG_LINE_SIZE){
+		nLen = LOG_LINE_SIZE - 1;
+	}
+	if ((unSuppressed > 0) && (nLen < (LOG_LINE_SIZE - 1))){
+		nLen += snprintf(pRecord->cText + nLen, LOG_LINE_SIZE - nLen, " (%u similar suppressed)", unSuppressed);
+		if (nLen >= LOG_LINE_SIZE){
+			nLen = LOG_LINE_SIZE - 1;
+		}
+	}
+	pRecord->nLen = (nLen < 0) ? 0 : nLen;
+}
+
+static int32_t nRenderRecord(const log_record_t* pRecord, char* pOut, int32_t nSize)
+{
+	int32_t nLen;
+
+	nLen = snprintf(pOut, nSize, "[%5llu.%06llu] %c %.*s\n",
+			(unsigned long long)(pRecord->ullStampNs / 1000000000ULL),
+			(unsigned long long)((pRecord->ullStampNs % 1000000000ULL) / 1000),
+			LOG_LEVEL_LETTERS[pRecord->nLevel], pRecord->nLen, pRecord->cText);
+	return (nLen >= nSize) ? (nSize - 1) : nLen;
+}
+
+static void writeAll(const char* pData, int32_t nLen)
+{
+	ssize_t nWritten;
+
+	while (nLen > 0){
+		nWritten = write(STDOUT_FILENO, pData, nLen);
+		if (nWritten <= 0){
+			return;		// nowhere to complain to
+		}
+		pData += nWritten;
+		nLen -= nWritten;
+	}
+}
+
+void logWrite(int32_t nLevel, log_site_t* pSite, const char* pFormat, ...)
+{
+	log_record_t tRecord;
+	log_ring_t* pRing;
+	uint64_t ullNow = ullLogNowNs();
+	uint32_t unSuppressed = 0, unHead;
+	char cOut[LOG_LINE_SIZE + 32];
+	va_list tArgs;
+
+	if (nRateLimit(pSite, ullNow, &unSuppressed) < 0){
+		return;
+	}
+	pRing = (0 != __atomic_load_n(&nWriterRunning, __ATOMIC_ACQUIRE)) ? pGetThreadRing() : NULL;
+	va_start(tArgs, pFormat);
+	if (NULL == pRing){
+		// no writer thread (start up, shut down, tools), keep in order with printf
+		formatRecord(&tRecord, nLevel, ullNow, unSuppressed, pFormat, tArgs);
+		va_end(tArgs);
+		fwrite(cOut, 1, nRenderRecord(&tRecord, cOut, sizeof(cOut)), stdout);
+		return;
+	}
+
+	unHead = pRing->unHead;		// only this thread moves it
+	if ((unHead - __atomic_load_n(&(pRing->unTail), __ATOMIC_ACQUIRE)) >= LOG_RING_SLOTS){
+		va_end(tArgs);
+		__atomic_add_fetch(&(pRing->unDropped), 1, __ATOMIC_RELAXED);
+		return;
+	}
+	formatRecord(pRing->tRecord + (unHead & (LOG_RING_SLOTS - 1)), nLevel, ullNow,
+			unSuppressed, pFormat, tArgs);
+	va_end(tArgs);
+	__atomic_store_n(&(pRing->unHead), unHead + 1, __ATOMIC_RELEASE);
+}
+
+/* Empties every ring once, returns how many lines went out */
+static int32_t nDrainRings(char* pOut)
+{
+	log_ring_t* pRing;
+	log_record_t tDropped;
+	uint32_t unTail, unHead, unDropped;
+	int32_t nLen = 0, nLines = 0;
+
+	for (pRing = __atomic_load_n(&pRings, __ATOMIC_ACQUIRE); pRing != NULL; pRing = pRing->pNext){
+		unTail = pRing->unTail;		// only the writer moves it
+		unHead = __atomic_load_n(&(pRing->unHead), __ATOMIC_ACQUIRE);
+		for (; unTail != unHead; unTail++){
+			if ((LOG_OUT_BUFFER_SIZE - nLen) < (LOG_LINE_SIZE + 32)){
+				writeAll(pOut, nLen);
+				nLen = 0;
+			}
+			nLen += nRenderRecord(pRing->tRecord + (unTail & (LOG_RING_SLOTS - 1)),
+					pOut + nLen, LOG_OUT_BUFFER_SIZE - nLen);
+			nLines++;
+		}
+		__atomic_store_n(&(pRing->unTail), unTail, __ATOMIC_RELEASE);
+
+		unDropped = __atomic_exchange_n(&(pRing->unDropped), 0, __ATOMIC_RELAXED);
+		if (unDropped > 0){
+			tDropped.ullStampNs = ullLogNowNs();
+			tDropped.nLevel = LOG_LEVEL_WARN;
+			tDropped.nLen = snprintf(tDropped.cText, LOG_LINE_SIZE, "Log ring full, %u lines dropped.", unDropped);
+			if ((LOG_OUT_BUFFER_SIZE - nLen) < (LOG_LINE_SIZE + 32)){
+				writeAll(pOut, nLen);
+				nLen = 0;
+			}
+			nLen += nRenderRecord(&tDropped, pOut + nLen, LOG_OUT_BUFFER_SIZE - nLen);
+		}
+	}
+	writeAll(pOut, nLen);
+	return nLines;
+}
+
+static void* logWriterService(void* pUnused)
+{
+	char cOut[LOG_OUT_BUFFER_SIZE];
+
+	while (0 == nWriterStop){
+		if (0 == nDrainRings(cOut)){
+			usleep(LOG_FLUSH_INTERVAL_US);
+		}
+	}
+	nDrainRings(cOut);
+	return NULL;
+}
+
+int32_t nLogInit(int32_t nLevel)
+{
+	nLogLevel = nLevel;
+	nWriterStop = 0;
+	fflush(stdout);		// whatever was printed so far goes before the writer's lines
+	if (pthread_create(&tWriterThread, NULL, logWriterService, NULL) != 0){
+		perror("Create log writer thread failed");
+		return (-1);
+	}
+	__atomic_store_n(&nWriterRunning, 1, __ATOMIC_RELEASE);
+	atexit(logRelease);		// error exits still get their last lines out
+	return 0;
+}
+
+/* Drains what is queued, lines logged from now on are written synchronously */
+void logRelease(void)
+{
+	if (0 == nWriterRunning){
+		return;
+	}
+	__atomic_store_n(&nWriterRunning, 0, __ATOMIC_RELEASE);
+	nWriterStop = 1;
+	pthread_join(tWriterThread, NULL);
+}
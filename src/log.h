@@ -0,0 +1,87 @@
+/*
+ * log.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ *
+ *  Asynchronous logging. A log call formats into a ring owned by the
+ *  calling thread and returns, a background writer thread empties all
+ *  rings to stdout. The caller never blocks on the console; when its ring
+ *  is full the line is dropped and counted instead.
+ *
+ *  Each call site keeps its own rate limit, at most LOG_RATE_BURST lines
+ *  per LOG_RATE_WINDOW_NS, the next line that passes says how many were
+ *  suppressed. LOG_D() compiles to nothing unless LOG_COMPILE_LEVEL is
+ *  raised to LOG_LEVEL_DEBUG, e.g. -DLOG_COMPILE_LEVEL=3.
+ */
+
+#ifndef LOG_H_
+#define LOG_H_
+
+#include <stdint.h>
+
+#define LOG_LEVEL_ERROR					0
+#define LOG_LEVEL_WARN					1
+#define LOG_LEVEL_INFO					2
+#define LOG_LEVEL_DEBUG					3
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL				LOG_LEVEL_INFO
+#endif
+
+#define LOG_LINE_SIZE					160
+#define LOG_RING_SLOTS					256		// power of two
+#define LOG_RATE_BURST					10
+#define LOG_RATE_WINDOW_NS				1000000000ULL
+#define LOG_FLUSH_INTERVAL_US			10000
+
+/* Rate limit state of one call site */
+typedef struct {
+	uint64_t ullWindowStartNs;
+	uint32_t unInWindow;
+	uint32_t unSuppressed;
+}log_site_t;
+
+typedef struct {
+	uint64_t ullStampNs;
+	int32_t nLevel;
+	int32_t nLen;
+	char cText[LOG_LINE_SIZE];
+}log_record_t;
+
+/* Single producer (its thread), single consumer (the writer) */
+typedef struct log_ring log_ring_t;
+struct log_ring{
+	uint32_t unHead;			// next slot the owner writes
+	uint32_t unTail;			// next slot the writer reads
+	uint32_t unDropped;
+	log_ring_t* pNext;			// every ring ever created, never unlinked
+	log_record_t tRecord[LOG_RING_SLOTS];
+};
+
+#define LOG_AT(nLevel, ...)		do{ \
+		static log_site_t tLogSite; \
+		if ((nLevel) <= nLogLevel){ \
+			logWrite((nLevel), &tLogSite, __VA_ARGS__); \
+		} \
+	}while (0)
+
+#define LOG_E(...)				LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_W(...)				LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_I(...)				LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#if LOG_COMPILE_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_D(...)				LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_D(...)				do{ }while (0)
+#endif
+
+extern int32_t nLogLevel;
+
+int32_t nLogInit(int32_t nLevel);
+
+void logRelease(void);
+
+void logWrite(int32_t nLevel, log_site_t* pSite, const char* pFormat, ...)
+		__attribute__((format(printf, 3, 4)));
+
+#endif /* LOG_H_ */
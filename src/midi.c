@@ -8,6 +8,8 @@
 #include <unistd.h>
 #include <alsa/asoundlib.h>
 
+#include "midi.h"
+
 #define MIDI_DAEMON_VERSION_STR		"01.01"
 
 /* error handling for ALSA functions */
@@ -136,8 +138,27 @@ void listUsage(const char *argv0)
 		"-h, --help                  this help\n"
 		"-V, --version               print current version\n"
 		"-l, --list                  list all possible output ports\n"
-		"-p, --port=client:port,...  set port(s) to play to\n"
-		"-d, --delay=seconds         delay after song ends\n",
+		"-p, --port=client:port,...  set port(s) to play to, the device with -o rawmidi,\n"
+		"                            the file to record into with -o null\n"
+		"-o, --output=seq|rawmidi|null  where events go (seq)\n"
+		"-b, --batch-window=usec     wait this long for more events before draining (0)\n"
+		"-B, --batch-cap=usec        never hold an event longer than this (2000)\n"
+		"-s, --schedule=usec         play events through a queue this long after arrival\n"
+		"-f, --filter                drop repeated note offs, controller values and programs\n"
+		"-r, --record=file           record everything played into a standard MIDI file\n"
+		"-j, --journal               record into a crash safe journal instead, made into\n"
+		"                            file.1.mid, file.2.mid, ... every 16 MB and at exit\n"
+		"-c, --max-clients=n         accept at most n Bluetooth clients at once (10)\n"
+		"-D, --drop-policy=tail|notes  when a client floods its queue refuse anything new,\n"
+		"                            or first only its notes and pressure (tail)\n"
+		"-L, --log-level=0..3        error, warning, info or debug (2), debug lines\n"
+		"                            need a build with -DLOG_COMPILE_LEVEL=3\n"
+		"-u, --uart-midi=baud        the serial port carries raw MIDI at this rate,\n"
+		"                            31250 for a DIN port, instead of text frames\n"
+		"-E, --ble=address[/random]  take notes from this BLE-MIDI controller, up to 4\n"
+		"-d, --delay=seconds         delay after song ends\n"
+		"midifile ...                standard MIDI files played in order under the live\n"
+		"                            input, timed by the queue when -s is given\n",
 		argv0);
 }
 
@@ -176,92 +197,51 @@ int32_t nConnectPorts(snd_seq_t *pSeq, int32_t nPortCount, snd_seq_addr_t *pPort
 	return 0;
 }
 
-void erroExitHandler(snd_seq_t *pSeq, snd_seq_addr_t *pPorts, int32_t nPortid)
+void erroExitHandler(midi_out_t *pOut)
 {
-	if (pPorts != NULL){
-		free(pPorts);
-	}
-	if (nPortid >= 0){
-		snd_seq_delete_port(pSeq, nPortid);
-	}
-	if (pSeq != NULL){
-		snd_seq_close(pSeq);
-	}
+	midiOutClose(pOut);
 	exit(EXIT_FAILURE);
 }
 
-int32_t nPlayReadyMidi(snd_seq_t *pSeq, int32_t nMyPortID)
+/* Runs before the engine thread exists, so it may block */
+static void playJingle(midi_out_t *pOut, int32_t nProgram, int32_t nNote)
 {
 	snd_seq_event_t tEvent;
 	int32_t i;
 
 	snd_seq_ev_clear(&tEvent);
-    snd_seq_ev_set_source(&tEvent, nMyPortID);
-    snd_seq_ev_set_subs(&tEvent);
-    snd_seq_ev_set_direct(&tEvent);
-	snd_seq_ev_set_fixed(&tEvent);
-
+	snd_seq_ev_set_direct(&tEvent);
 	tEvent.type = SND_SEQ_EVENT_PGMCHANGE;
 	tEvent.data.control.channel = 0;
-	tEvent.data.control.value = 1;
-	snd_seq_event_output(pSeq, &tEvent);
-	snd_seq_drain_output(pSeq);
+	tEvent.data.control.value = nProgram;
+	nMidiOutSendBatch(pOut, &tEvent, 1);
 
-    for (i = 0; i < 2; i++){
-		 // set event type, data, so on..
+	for (i = 0; i < 2; i++){
+		snd_seq_ev_clear(&tEvent);
+		snd_seq_ev_set_direct(&tEvent);
 		tEvent.type = SND_SEQ_EVENT_NOTEON;
 		tEvent.data.note.channel = 0;
-		tEvent.data.note.note = 100;
+		tEvent.data.note.note = nNote;
 		tEvent.data.note.velocity = 80;
-		snd_seq_event_output(pSeq, &tEvent);
-		snd_seq_drain_output(pSeq);
+		nMidiOutSendBatch(pOut, &tEvent, 1);
+		nMidiOutFlush(pOut);
 		usleep(300000);
 
 		tEvent.type = SND_SEQ_EVENT_NOTEOFF;
-		tEvent.data.note.channel = 0;
-		tEvent.data.note.note = 100;
 		tEvent.data.note.velocity = 0;
-		snd_seq_event_output(pSeq, &tEvent);
-		snd_seq_drain_output(pSeq);
-    }
+		nMidiOutSendBatch(pOut, &tEvent, 1);
+		nMidiOutFlush(pOut);
+	}
+}
 
+int32_t nPlayReadyMidi(midi_out_t *pOut)
+{
+	playJingle(pOut, 1, 100);
 	return 0;
 }
 
-int32_t nPlayConnectedMidi(snd_seq_t *pSeq, int32_t nMyPortID)
+int32_t nPlayConnectedMidi(midi_out_t *pOut)
 {
-	snd_seq_event_t tEvent;
-	int32_t i;
-
-	snd_seq_ev_clear(&tEvent);
-    snd_seq_ev_set_source(&tEvent, nMyPortID);
-    snd_seq_ev_set_subs(&tEvent);
-    snd_seq_ev_set_direct(&tEvent);
-	snd_seq_ev_set_fixed(&tEvent);
-
-	tEvent.type = SND_SEQ_EVENT_PGMCHANGE;
-	tEvent.data.control.channel = 0;
-	tEvent.data.control.value = 25;
-	snd_seq_event_output(pSeq, &tEvent);
-	snd_seq_drain_output(pSeq);
-
-    for (i = 0; i < 2; i++){
-		 // set event type, data, so on..
-		tEvent.type = SND_SEQ_EVENT_NOTEON;
-		tEvent.data.note.channel = 0;
-		tEvent.data.note.note = 50;
-		tEvent.data.note.velocity = 80;
-		snd_seq_event_output(pSeq, &tEvent);
-		snd_seq_drain_output(pSeq);
-		usleep(300000);
-
-		tEvent.type = SND_SEQ_EVENT_NOTEOFF;
-		tEvent.data.note.channel = 0;
-		tEvent.data.note.note = 50;
-		tEvent.data.note.velocity = 0;
-		snd_seq_event_output(pSeq, &tEvent);
-		snd_seq_drain_output(pSeq);
-    }
-
+	playJingle(pOut, 25, 50);
 	return 0;
 }
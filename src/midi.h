@@ -8,6 +8,8 @@
 #ifndef MIDI_H_
 #define MIDI_H_
 
+#include "midi_out.h"
+
 int nCheckSnd(const char *operation, int err);
 
 int nInitSeq(snd_seq_t** pSeq);
@@ -24,10 +26,10 @@ int pCreateSourcePort(snd_seq_t *pSeq);
 
 int nConnectPorts(snd_seq_t *pSeq, int nPortCount, snd_seq_addr_t *pPorts);
 
-void erroExitHandler(snd_seq_t *pSeq, snd_seq_addr_t *pPorts, int nPortid);
+void erroExitHandler(midi_out_t *pOut);
 
-int nPlayReadyMidi(snd_seq_t *pSeq, int nMyPortID);
+int nPlayReadyMidi(midi_out_t *pOut);
 
-int nPlayConnectedMidi(snd_seq_t *pSeq, int nMyPortID);
+int nPlayConnectedMidi(midi_out_t *pOut);
 
 #endif /* MIDI_H_ */
@@ -0,0 +1,419 @@
+/*
+ * midi_ctrl.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#define _GNU_SOURCE		// accept4()
+
+#include <stdio.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+
+#include "log.h"
+#include "midi_ctrl.h"
+
+void midiCtrlConnInit(midi_ctrl_conn_t* pConn, int32_t nFd, const midi_ctrl_command_t* pCommands,
+		int32_t nCommands, void* pContext)
+{
+	memset(pConn, 0, offsetof(midi_ctrl_conn_t, unIn));
+	pConn->nFd = nFd;
+	pConn->tMode = MIDI_CTRL_MODE_NEW;
+	pConn->pCommands = pCommands;
+	pConn->nCommands = nCommands;
+	pConn->pContext = pContext;
+}
+
+/* Whatever the socket does not take now stays queued for the next flush */
+int32_t nMidiCtrlFlush(midi_ctrl_conn_t* pConn)
+{
+	ssize_t nSent;
+
+	if (0 == pConn->nOutLen){
+		return 0;
+	}
+	nSent = send(pConn->nFd, pConn->unOut, pConn->nOutLen, MSG_NOSIGNAL | MSG_DONTWAIT);
+	if (nSent < 0){
+		if ((EAGAIN == errno) || (EWOULDBLOCK == errno) || (EINTR == errno)){
+			return 0;
+		}
+		LOG_E("Send control reply failed: %m");
+		return (-1);
+	}
+	pConn->nOutLen -= nSent;
+	memmove(pConn->unOut, pConn->unOut + nSent, pConn->nOutLen);
+	return 0;
+}
+
+/* Replies are only ever queued whole, so the binary stream stays framed
+ * even when a slow reader makes us drop some. */
+static uint8_t* pReserve(midi_ctrl_conn_t* pConn, int32_t nLen)
+{
+	uint8_t* pSpace;
+
+	if ((pConn->nOutLen + nLen) > MIDI_CTRL_OUT_SIZE){
+		nMidiCtrlFlush(pConn);
+		if ((pConn->nOutLen + nLen) > MIDI_CTRL_OUT_SIZE){
+			pConn->unReplyDropped++;
+			return NULL;
+		}
+	}
+	pSpace = pConn->unOut + pConn->nOutLen;
+	pConn->nOutLen += nLen;
+	return pSpace;
+}
+
+static void replyStatus(midi_ctrl_conn_t* pConn, uint8_t unOpcode, uint8_t unTag, uint8_t unStatus)
+{
+	uint8_t* pFrame = pReserve(pConn, MIDI_CTRL_FRAME_HEADER + 1);
+
+	if (NULL == pFrame){
+		return;
+	}
+	pFrame[0] = 0;
+	pFrame[1] = 3;
+	pFrame[2] = unOpcode | MIDI_CTRL_REPLY;
+	pFrame[3] = unTag;
+	pFrame[4] = unStatus;
+}
+
+static void replyReport(midi_ctrl_conn_t* pConn, uint8_t unOpcode, uint8_t unTag,
+		const midi_ctrl_command_t* pCommand)
+{
+	uint8_t* pFrame = pReserve(pConn, MIDI_CTRL_FRAME_HEADER + MIDI_CTRL_REPORT_SIZE);
+	int32_t nLen;
+
+	if (NULL == pFrame){
+		return;
+	}
+	nLen = pCommand->nReport(pConn->pContext, (char*)pFrame + MIDI_CTRL_FRAME_HEADER,
+			MIDI_CTRL_REPORT_SIZE);
+	pConn->nOutLen -= MIDI_CTRL_REPORT_SIZE - nLen;	// give back what the report left unused
+	pFrame[0] = (nLen + 2) >> 8;
+	pFrame[1] = (nLen + 2) & 0xFF;
+	pFrame[2] = unOpcode | MIDI_CTRL_REPLY;
+	pFrame[3] = unTag;
+}
+
+static int32_t nRunCommand(midi_ctrl_conn_t* pConn, const midi_ctrl_command_t* pCommand,
+		const int32_t* pArgs)
+{
+	pConn->unCommands++;
+	return pCommand->pRun(pConn->pContext, pArgs[0], pArgs[1], pArgs[2], pArgs[3]);
+}
+
+/* pLine is terminated, newline included */
+static void runTextLine(midi_ctrl_conn_t* pConn, const char* pLine)
+{
+	const midi_ctrl_command_t* pCommand;
+	int32_t nArgs[MIDI_CTRL_MAX_ARGS] = {0};
+	int32_t nOpcode;
+	uint8_t* pReport;
+
+	for (nOpcode = 0; nOpcode < pConn->nCommands; nOpcode++){
+		pCommand = pConn->pCommands + nOpcode;
+		if (NULL == pCommand->pTextFormat){
+			continue;
+		}
+		if (0 == pCommand->nArgs){
+			if ((pCommand->nReport != NULL) &&
+					(0 == strncmp(pLine, pCommand->pTextFormat, strlen(pCommand->pTextFormat)))){
+				pConn->unCommands++;
+				pReport = pReserve(pConn, MIDI_CTRL_REPORT_SIZE);
+				if (pReport != NULL){
+					pConn->nOutLen -= MIDI_CTRL_REPORT_SIZE -
+							pCommand->nReport(pConn->pContext, (char*)pReport, MIDI_CTRL_REPORT_SIZE);
+				}
+				return;
+			}
+		}else if (pCommand->nArgs == sscanf(pLine, pCommand->pTextFormat,
+				nArgs, nArgs + 1, nArgs + 2, nArgs + 3)){
+			nRunCommand(pConn, pCommand, nArgs);
+			return;
+		}
+	}
+	pConn->unMalformed++;
+	LOG_W("Unknown control command: %.*s", (int)strcspn(pLine, "\n"), pLine);
+}
+
+static int32_t nProcessText(midi_ctrl_conn_t* pConn)
+{
+	uint8_t* pEnd;
+	uint8_t unSaved;
+	int32_t nUsed = 0;
+
+	while (NULL != (pEnd = memchr(pConn->unIn + nUsed, '\n', pConn->nInLen - nUsed))){
+		unSaved = pEnd[1];		// unIn has one spare byte past the end
+		pEnd[1] = '\0';
+		runTextLine(pConn, (const char*)pConn->unIn + nUsed);
+		pEnd[1] = unSaved;
+		nUsed = pEnd + 1 - pConn->unIn;
+	}
+	if ((0 == nUsed) && (MIDI_CTRL_IN_SIZE == pConn->nInLen)){
+		// no command is that long, throw it away
+		pConn->unMalformed++;
+		nUsed = pConn->nInLen;
+	}
+	return nUsed;
+}
+
+static void runFrame(midi_ctrl_conn_t* pConn, const uint8_t* pFrame, int32_t nPayload)
+{
+	const midi_ctrl_command_t* pCommand;
+	int32_t nArgs[MIDI_CTRL_MAX_ARGS] = {0};
+	uint8_t unOpcode = pFrame[2], unTag = pFrame[3];
+	int32_t nIndex;
+
+	if ((unOpcode >= pConn->nCommands) ||
+			((NULL == pConn->pCommands[unOpcode].pRun) && (NULL == pConn->pCommands[unOpcode].nReport))){
+		pConn->unMalformed++;
+		replyStatus(pConn, unOpcode, unTag, MIDI_CTRL_STATUS_UNKNOWN);
+		return;
+	}
+	pCommand = pConn->pCommands + unOpcode;		// direct lookup, no parsing
+	if (nPayload != (2 * pCommand->nArgs)){
+		pConn->unMalformed++;
+		replyStatus(pConn, unOpcode, unTag, MIDI_CTRL_STATUS_FAILED);
+		return;
+	}
+	if (pCommand->nReport != NULL){
+		pConn->unCommands++;
+		replyReport(pConn, unOpcode, unTag, pCommand);
+		return;
+	}
+	for (nIndex = 0; nIndex < pCommand->nArgs; nIndex++){
+		nArgs[nIndex] = (int16_t)((pFrame[MIDI_CTRL_FRAME_HEADER + 2 * nIndex] << 8) |
+				pFrame[MIDI_CTRL_FRAME_HEADER + 2 * nIndex + 1]);
+	}
+	replyStatus(pConn, unOpcode, unTag, (nRunCommand(pConn, pCommand, nArgs) < 0) ?
+			MIDI_CTRL_STATUS_FAILED : MIDI_CTRL_STATUS_OK);
+}
+
+/* A bad length means the framing is lost, the caller drops the client */
+static int32_t nProcessBinary(midi_ctrl_conn_t* pConn)
+{
+	int32_t nUsed = 0, nLen;
+
+	while ((nUsed + 2) <= pConn->nInLen){
+		nLen = (pConn->unIn[nUsed] << 8) | pConn->unIn[nUsed + 1];
+		if ((nLen < 2) || ((nLen + 2) > MIDI_CTRL_MAX_FRAME)){
+			pConn->unMalformed++;
+			LOG_W("Control frame length %d invalid.", nLen);
+			return (-1);
+		}
+		if ((nUsed + 2 + nLen) > pConn->nInLen){
+			break;
+		}
+		runFrame(pConn, pConn->unIn + nUsed, nLen - 2);
+		nUsed += 2 + nLen;
+	}
+	return nUsed;
+}
+
+/* Run every complete command in the input, keep a partial one for later */
+int32_t nMidiCtrlProcess(midi_ctrl_conn_t* pConn)
+{
+	int32_t nUsed = 0;
+
+	if ((MIDI_CTRL_MODE_NEW == pConn->tMode) && (pConn->nInLen > 0)){
+		if (MIDI_CTRL_HELLO == pConn->unIn[0]){
+			pConn->tMode = MIDI_CTRL_MODE_BINARY;
+			pConn->nInLen -= 1;
+			memmove(pConn->unIn, pConn->unIn + 1, pConn->nInLen);
+			if (NULL != pReserve(pConn, 1)){
+				pConn->unOut[pConn->nOutLen - 1] = MIDI_CTRL_HELLO;
+			}
+		}else{
+			pConn->tMode = MIDI_CTRL_MODE_TEXT;
+		}
+	}
+	switch (pConn->tMode){
+	case MIDI_CTRL_MODE_TEXT:
+		nUsed = nProcessText(pConn);
+		break;
+	case MIDI_CTRL_MODE_BINARY:
+		nUsed = nProcessBinary(pConn);
+		break;
+	default:
+		return 0;
+	}
+	if (nUsed < 0){
+		return (-1);
+	}
+	pConn->nInLen -= nUsed;
+	memmove(pConn->unIn, pConn->unIn + nUsed, pConn->nInLen);
+	return 0;
+}
+
+/* Read until the socket is empty, running commands as they complete and
+ * sending all their replies together. Returns (-1) when the client is
+ * gone or broke the protocol. */
+int32_t nMidiCtrlRecv(midi_ctrl_conn_t* pConn)
+{
+	ssize_t nRc;
+
+	while (1){
+		nRc = recv(pConn->nFd, pConn->unIn + pConn->nInLen, MIDI_CTRL_IN_SIZE - pConn->nInLen, 0);
+		if (nRc < 0){
+			if (EINTR == errno){
+				continue;
+			}
+			if ((EAGAIN == errno) || (EWOULDBLOCK == errno)){
+				break;
+			}
+			LOG_E("Receive control command failed: %m");
+			return (-1);
+		}
+		if (0 == nRc){
+			LOG_I("Control connection %d closed.", pConn->nFd);
+			return (-1);
+		}
+		pConn->nInLen += nRc;
+		if (nMidiCtrlProcess(pConn) < 0){
+			return (-1);
+		}
+	}
+	return nMidiCtrlFlush(pConn);
+}
+
+static void closeClient(midi_ctrl_conn_t* pConn)
+{
+	midi_ctrl_server_t* pServer = pConn->pServer;
+
+	nReactorRemove(pServer->pReactor, &(pConn->tHandler));
+	close(pConn->nFd);
+	if (pConn->pPrev != NULL){
+		pConn->pPrev->pNext = pConn->pNext;
+	}else{
+		pServer->pClients = pConn->pNext;
+	}
+	if (pConn->pNext != NULL){
+		pConn->pNext->pPrev = pConn->pPrev;
+	}
+	pServer->nClients--;
+	free(pConn);
+}
+
+/* Only this client's own event can reach it, so it may free itself here */
+static void onClientEvent(reactor_handler_t* pHandler, uint32_t unEvents)
+{
+	midi_ctrl_conn_t* pConn = (midi_ctrl_conn_t*)pHandler->pContext;
+
+	if (unEvents & EPOLLOUT){
+		if (nMidiCtrlFlush(pConn) < 0){
+			closeClient(pConn);
+			return;
+		}
+	}
+	if (unEvents & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
+		if (nMidiCtrlRecv(pConn) < 0){
+			closeClient(pConn);
+		}
+	}
+}
+
+static void onClientAccept(reactor_handler_t* pHandler, uint32_t unEvents)
+{
+	midi_ctrl_server_t* pServer = (midi_ctrl_server_t*)pHandler->pContext;
+	midi_ctrl_conn_t* pConn;
+	int32_t nClientSocket;
+
+	while (1){
+		nClientSocket = accept4(pHandler->nFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (nClientSocket < 0){
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)){
+				LOG_E("Accept control connection failed: %m");
+			}
+			return;
+		}
+		if (pServer->nClients >= MIDI_CTRL_MAX_CLIENTS){
+			pServer->unRejected++;
+			close(nClientSocket);
+			continue;
+		}
+		pConn = malloc(sizeof(midi_ctrl_conn_t));
+		if (NULL == pConn){
+			LOG_E("Allocate control connection failed: %m");
+			close(nClientSocket);
+			continue;
+		}
+		midiCtrlConnInit(pConn, nClientSocket, pServer->pCommands, pServer->nCommands, pServer->pContext);
+		pConn->pServer = pServer;
+		pConn->tHandler.nFd = nClientSocket;
+		pConn->tHandler.pOnEvent = onClientEvent;
+		pConn->tHandler.pContext = pConn;
+		// EPOLLOUT only fires on the edge, when a stalled reply may continue
+		if (nReactorAdd(pServer->pReactor, &(pConn->tHandler),
+				EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET) < 0){
+			close(nClientSocket);
+			free(pConn);
+			continue;
+		}
+		pConn->pNext = pServer->pClients;
+		if (pServer->pClients != NULL){
+			pServer->pClients->pPrev = pConn;
+		}
+		pServer->pClients = pConn;
+		pServer->nClients++;
+	}
+}
+
+int32_t nMidiCtrlServerInit(midi_ctrl_server_t* pServer, reactor_t* pReactor, const char* pPath,
+		const midi_ctrl_command_t* pCommands, int32_t nCommands, void* pContext)
+{
+	struct sockaddr_un tServerSocketAddr;
+	int32_t nServerSocket;
+
+	memset(pServer, 0, sizeof(midi_ctrl_server_t));
+	pServer->pReactor = pReactor;
+	pServer->pCommands = pCommands;
+	pServer->nCommands = nCommands;
+	pServer->pContext = pContext;
+
+	nServerSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (nServerSocket < 0){
+		LOG_E("Create Unix server socket failed: %m");
+		return (-1);
+	}
+	memset(&tServerSocketAddr, 0, sizeof(tServerSocketAddr));
+	tServerSocketAddr.sun_family = AF_UNIX;
+	strncpy(tServerSocketAddr.sun_path, pPath, sizeof(tServerSocketAddr.sun_path) - 1);
+	unlink(tServerSocketAddr.sun_path);
+	if (bind(nServerSocket, (struct sockaddr *)&tServerSocketAddr, sizeof(tServerSocketAddr)) < 0){
+		LOG_E("Server socket bind failed: %m");
+		close(nServerSocket);
+		return (-1);
+	}
+	chmod(pPath, S_IRWXU|S_IRWXG);
+	if (listen(nServerSocket, SOMAXCONN) < 0){
+		LOG_E("Listen failed: %m");
+		close(nServerSocket);
+		return (-1);
+	}
+
+	pServer->tListener.nFd = nServerSocket;
+	pServer->tListener.pOnEvent = onClientAccept;
+	pServer->tListener.pContext = pServer;
+	if (nReactorAdd(pReactor, &(pServer->tListener), EPOLLIN | EPOLLET) < 0){
+		close(nServerSocket);
+		return (-1);
+	}
+	return 0;
+}
+
+void midiCtrlServerRelease(midi_ctrl_server_t* pServer)
+{
+	while (pServer->pClients != NULL){
+		closeClient(pServer->pClients);
+	}
+	nReactorRemove(pServer->pReactor, &(pServer->tListener));
+	close(pServer->tListener.nFd);
+}
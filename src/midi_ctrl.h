@@ -0,0 +1,123 @@
+/*
+ * midi_ctrl.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ *
+ *  Control protocol of the Unix attribute socket. A connection starts in
+ *  the text mode, one command per line following the command's format,
+ *  e.g. "channel:%d,volume:%d,EMPTY_PARA_1:%d,EMPTY_PARA_2:%d\n".
+ *  Text commands are not acknowledged, only reports are answered.
+ *
+ *  A client switches to binary by sending MIDI_CTRL_HELLO as its very
+ *  first byte, the daemon answers with the same byte. From then on both
+ *  directions carry frames of
+ *
+ *      [length, 2 bytes big endian][opcode][tag][payload]
+ *
+ *  where length counts opcode, tag and payload. A command's payload is
+ *  its arguments, each a 16 bit big endian signed value. Every command
+ *  is answered, in order, with opcode | MIDI_CTRL_REPLY and the same tag:
+ *  a one byte status for commands, the report text for reports.
+ *  Any number of commands may be sent without waiting for the replies.
+ */
+
+#ifndef MIDI_CTRL_H_
+#define MIDI_CTRL_H_
+
+#include <stdint.h>
+
+#include "reactor.h"
+
+#define MIDI_CTRL_HELLO					((uint8_t)0xFD)	// never starts a text command
+#define MIDI_CTRL_REPLY					((uint8_t)0x80)
+#define MIDI_CTRL_STATUS_OK				0
+#define MIDI_CTRL_STATUS_FAILED			1
+#define MIDI_CTRL_STATUS_UNKNOWN		2
+#define MIDI_CTRL_MAX_ARGS				4
+#define MIDI_CTRL_FRAME_HEADER			4
+#define MIDI_CTRL_MAX_FRAME				(MIDI_CTRL_FRAME_HEADER + 2 * MIDI_CTRL_MAX_ARGS)
+#define MIDI_CTRL_IN_SIZE				1024
+#define MIDI_CTRL_REPORT_SIZE			4096
+#define MIDI_CTRL_OUT_SIZE				(2 * MIDI_CTRL_REPORT_SIZE)
+#define MIDI_CTRL_MAX_CLIENTS			512
+
+typedef enum {
+	MIDI_CTRL_OP_PROGRAM = 0,
+	MIDI_CTRL_OP_VOLUME,
+	MIDI_CTRL_OP_CHANNEL_VOLUME,
+	MIDI_CTRL_OP_TRANSPOSE,
+	MIDI_CTRL_OP_VELOCITY_CURVE,
+	MIDI_CTRL_OP_VELOCITY_KNEE,
+	MIDI_CTRL_OP_STATS,
+	MIDI_CTRL_OP_CNT
+}midi_ctrl_opcode_t;
+
+typedef enum {
+	MIDI_CTRL_MODE_NEW = 0,
+	MIDI_CTRL_MODE_TEXT,
+	MIDI_CTRL_MODE_BINARY
+}midi_ctrl_mode_t;
+
+/* One entry per opcode, the opcode is the index. A command runs pRun with
+ * the context and its arguments, a report fills the reply through
+ * nReport(pContext, pBuff, nSize) and returns the length written. */
+typedef struct {
+	const char* pTextFormat;	// sscanf format, or the literal word when nArgs is 0
+	int32_t nArgs;
+	int32_t (*pRun)();
+	int32_t (*nReport)(void* pContext, char* pBuff, int32_t nSize);
+}midi_ctrl_command_t;
+
+typedef struct midi_ctrl_server midi_ctrl_server_t;
+typedef struct midi_ctrl_conn midi_ctrl_conn_t;
+
+/* Per client state, owned by the control thread. Allocated on accept and
+ * freed when the client goes, nothing else keeps a pointer to it. */
+struct midi_ctrl_conn{
+	reactor_handler_t tHandler;
+	midi_ctrl_server_t* pServer;
+	midi_ctrl_conn_t* pPrev;
+	midi_ctrl_conn_t* pNext;
+	int32_t nFd;
+	midi_ctrl_mode_t tMode;
+	const midi_ctrl_command_t* pCommands;
+	int32_t nCommands;
+	void* pContext;
+	int32_t nInLen;
+	int32_t nOutLen;
+	uint32_t unCommands;
+	uint32_t unMalformed;
+	uint32_t unReplyDropped;
+	uint8_t unIn[MIDI_CTRL_IN_SIZE + 1];	// room for a terminator behind a text line
+	uint8_t unOut[MIDI_CTRL_OUT_SIZE];
+};
+
+/* Unix socket listener plus its clients, all served by one reactor.
+ * Readiness is edge triggered, every wakeup reads a client dry. */
+struct midi_ctrl_server{
+	reactor_t* pReactor;
+	reactor_handler_t tListener;
+	const midi_ctrl_command_t* pCommands;
+	int32_t nCommands;
+	void* pContext;
+	midi_ctrl_conn_t* pClients;
+	int32_t nClients;
+	uint32_t unRejected;
+};
+
+void midiCtrlConnInit(midi_ctrl_conn_t* pConn, int32_t nFd, const midi_ctrl_command_t* pCommands,
+		int32_t nCommands, void* pContext);
+
+int32_t nMidiCtrlRecv(midi_ctrl_conn_t* pConn);
+
+int32_t nMidiCtrlProcess(midi_ctrl_conn_t* pConn);
+
+int32_t nMidiCtrlFlush(midi_ctrl_conn_t* pConn);
+
+int32_t nMidiCtrlServerInit(midi_ctrl_server_t* pServer, reactor_t* pReactor, const char* pPath,
+		const midi_ctrl_command_t* pCommands, int32_t nCommands, void* pContext);
+
+void midiCtrlServerRelease(midi_ctrl_server_t* pServer);
+
+#endif /* MIDI_CTRL_H_ */
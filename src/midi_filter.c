@@ -0,0 +1,95 @@
+/*
+ * midi_filter.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#include <string.h>
+#include <alsa/asoundlib.h>
+
+#include "midi_filter.h"
+
+#define MIDI_FILTER_BIT(unMap, nIndex)	((unMap)[(nIndex) >> 5] & (1U << ((nIndex) & 31)))
+#define MIDI_FILTER_SET(unMap, nIndex)	((unMap)[(nIndex) >> 5] |= (1U << ((nIndex) & 31)))
+#define MIDI_FILTER_CLEAR(unMap, nIndex)	((unMap)[(nIndex) >> 5] &= ~(1U << ((nIndex) & 31)))
+
+void midiFilterInit(midi_filter_t* pFilter)
+{
+	memset(pFilter, 0, sizeof(midi_filter_t));
+	memset(pFilter->unProgram, MIDI_FILTER_NO_PROGRAM, sizeof(pFilter->unProgram));
+}
+
+/* Controllers that act when sent rather than hold a value:
+ * data entry, increment/decrement, (N)RPN select and channel mode. */
+static int32_t nIsTriggerControl(uint32_t unParam)
+{
+	return ((MIDI_CTL_MSB_DATA_ENTRY == unParam) || (MIDI_CTL_LSB_DATA_ENTRY == unParam) ||
+			((unParam >= MIDI_CTL_DATA_INCREMENT) && (unParam <= MIDI_CTL_REGIST_PARM_NUM_MSB)) ||
+			(unParam >= MIDI_CTL_ALL_SOUNDS_OFF)) ? 1 : 0;
+}
+
+static int32_t nPassControl(midi_filter_t* pFilter, int32_t nChannel, uint32_t unParam, int32_t nValue)
+{
+	if (unParam > 127){
+		return 1;
+	}
+	if ((MIDI_CTL_ALL_SOUNDS_OFF == unParam) || (MIDI_CTL_ALL_NOTES_OFF == unParam)){
+		memset(pFilter->unNoteOn[nChannel], 0, sizeof(pFilter->unNoteOn[nChannel]));
+	}
+	if (MIDI_CTL_RESET_CONTROLLERS == unParam){
+		memset(pFilter->unControlKnown[nChannel], 0, sizeof(pFilter->unControlKnown[nChannel]));
+	}
+	if (1 == nIsTriggerControl(unParam)){
+		return 1;
+	}
+	if (MIDI_FILTER_BIT(pFilter->unControlKnown[nChannel], unParam) &&
+			(pFilter->unControl[nChannel][unParam] == nValue)){
+		pFilter->unDropped[MIDI_FILTER_CONTROL]++;
+		return 0;
+	}
+	pFilter->unControl[nChannel][unParam] = nValue;
+	MIDI_FILTER_SET(pFilter->unControlKnown[nChannel], unParam);
+	if ((MIDI_CTL_MSB_BANK == unParam) || (MIDI_CTL_LSB_BANK == unParam)){
+		// the same program number now means a different sound
+		pFilter->unProgram[nChannel] = MIDI_FILTER_NO_PROGRAM;
+	}
+	return 1;
+}
+
+/* Returns 0 when the event changes nothing on the synth and can go.
+ * A repeated note on is kept, it retriggers the note. */
+int32_t nMidiFilterPass(midi_filter_t* pFilter, const snd_seq_event_t* pEvent)
+{
+	int32_t nChannel, nNote;
+
+	switch (pEvent->type){
+	case SND_SEQ_EVENT_NOTEON:
+	case SND_SEQ_EVENT_NOTEOFF:
+		nChannel = pEvent->data.note.channel & (MIDI_FILTER_CHANNELS - 1);
+		nNote = pEvent->data.note.note & 0x7F;
+		if ((SND_SEQ_EVENT_NOTEON == pEvent->type) && (pEvent->data.note.velocity > 0)){
+			MIDI_FILTER_SET(pFilter->unNoteOn[nChannel], nNote);
+			return 1;
+		}
+		if (0 == MIDI_FILTER_BIT(pFilter->unNoteOn[nChannel], nNote)){
+			pFilter->unDropped[MIDI_FILTER_NOTE_OFF]++;
+			return 0;
+		}
+		MIDI_FILTER_CLEAR(pFilter->unNoteOn[nChannel], nNote);
+		return 1;
+	case SND_SEQ_EVENT_CONTROLLER:
+		return nPassControl(pFilter, pEvent->data.control.channel & (MIDI_FILTER_CHANNELS - 1),
+				pEvent->data.control.param, pEvent->data.control.value);
+	case SND_SEQ_EVENT_PGMCHANGE:
+		nChannel = pEvent->data.control.channel & (MIDI_FILTER_CHANNELS - 1);
+		if (pFilter->unProgram[nChannel] == pEvent->data.control.value){
+			pFilter->unDropped[MIDI_FILTER_PROGRAM]++;
+			return 0;
+		}
+		pFilter->unProgram[nChannel] = pEvent->data.control.value & 0x7F;
+		return 1;
+	default:
+		return 1;
+	}
+}
@@ -0,0 +1,38 @@
+/*
+ * midi_filter.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#ifndef MIDI_FILTER_H_
+#define MIDI_FILTER_H_
+
+#include <stdint.h>
+
+#define MIDI_FILTER_CHANNELS			16
+#define MIDI_FILTER_NO_PROGRAM			0xFF
+
+typedef enum {
+	MIDI_FILTER_NOTE_OFF = 0,		// note off for a note that is not on
+	MIDI_FILTER_CONTROL,			// controller already at that value
+	MIDI_FILTER_PROGRAM,			// program already selected
+	MIDI_FILTER_REASON_CNT
+}midi_filter_reason_t;
+
+/* What the synth has been told so far, per channel, so repeats from
+ * controllers resending over lossy links can be dropped. Only the
+ * engine thread touches it, no locking. */
+typedef struct {
+	uint32_t unNoteOn[MIDI_FILTER_CHANNELS][4];			// bitmap of 128 notes
+	uint32_t unControlKnown[MIDI_FILTER_CHANNELS][4];	// bitmap of 128 controllers
+	uint8_t unControl[MIDI_FILTER_CHANNELS][128];
+	uint8_t unProgram[MIDI_FILTER_CHANNELS];
+	uint32_t unDropped[MIDI_FILTER_REASON_CNT];
+}midi_filter_t;
+
+void midiFilterInit(midi_filter_t* pFilter);
+
+int32_t nMidiFilterPass(midi_filter_t* pFilter, const snd_seq_event_t* pEvent);
+
+#endif /* MIDI_FILTER_H_ */
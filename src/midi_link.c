@@ -0,0 +1,575 @@
+/*
+ * midi_link.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ *
+ *  Everything a player connection needs once its fd exists: text frame
+ *  reassembly, switching to binary framing, parsing raw MIDI or BLE-MIDI
+ *  notifications, decoding and handing events to the sequencer engine.
+ *  Runs entirely on the reactor thread.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <alsa/asoundlib.h>
+
+#include "log.h"
+#include "ble_central.h"
+#include "midi_link.h"
+
+#define LINK_JINGLE_STEP_MS				300
+
+/* A text frame carries a note or a realtime event, any other type byte
+ * makes it malformed. SysEx and the variable length types would point
+ * the engine at memory the frame never had. */
+int32_t generateEventContent(snd_seq_event_t* pSndSeqEvent, char* pEventString)
+{
+	uint8_t unEventData[NOTE_FRAME_DATA_NUMBER];
+	if (nMidiWireDecodeHex(pEventString, unEventData, NOTE_FRAME_DATA_NUMBER) < 0){
+		return (-1);
+	}
+	switch (unEventData[0]){
+	case SND_SEQ_EVENT_NOTEON:
+	case SND_SEQ_EVENT_NOTEOFF:
+	case SND_SEQ_EVENT_KEYPRESS:
+	case SND_SEQ_EVENT_CLOCK:
+	case SND_SEQ_EVENT_START:
+	case SND_SEQ_EVENT_CONTINUE:
+	case SND_SEQ_EVENT_STOP:
+	case SND_SEQ_EVENT_SENSING:
+	case SND_SEQ_EVENT_RESET:
+		break;
+	default:
+		return (-1);
+	}
+
+//	printf("  Type is: %u, Channel is: %u, Note is: %u, velocity is: %u.\n",
+//			unEventData[0], unEventData[1], unEventData[2], unEventData[3]);
+	pSndSeqEvent->type = unEventData[0];
+	pSndSeqEvent->data.note.channel = unEventData[1];
+	pSndSeqEvent->data.note.note = unEventData[2];
+	pSndSeqEvent->data.note.velocity = unEventData[3];	// volume is applied by the engine
+	return 0;
+}
+
+static void submitNote(seq_engine_t* pEngine, snd_seq_event_type_t tType, uint8_t unVelocity)
+{
+	snd_seq_event_t tEvent;
+
+	snd_seq_ev_clear(&tEvent);
+	tEvent.type = tType;
+	tEvent.data.note.channel = 0;
+	tEvent.data.note.note = 50;
+	tEvent.data.note.velocity = unVelocity;
+	nSeqEngineQueue(pEngine, &tEvent);
+}
+
+/* Short jingle so the player hears the connection is up. The steps are
+ * driven by a timerfd, the reactor thread never sleeps. */
+static void onJingleTimer(reactor_handler_t* pHandler, uint32_t unEvents)
+{
+	midi_link_t* pLink = (midi_link_t*)pHandler->pContext;
+	seq_engine_t* pEngine = pLink->pTable->pEngine;
+	uint64_t ulExpired;
+
+	if (read(pHandler->nFd, &ulExpired, sizeof(ulExpired)) < 0){
+		return;
+	}
+	pLink->nJingleStep++;
+	submitNote(pEngine, SND_SEQ_EVENT_NOTEOFF, 0);
+	if (1 == pLink->nJingleStep){
+		submitNote(pEngine, SND_SEQ_EVENT_NOTEON, 80);
+	}else{
+		nReactorRemove(pLink->pTable->pReactor, pHandler);
+		close(pHandler->nFd);
+		pHandler->nFd = -1;
+	}
+	seqEngineKick(pEngine);
+}
+
+static void startJingle(midi_link_t* pLink)
+{
+	seq_engine_t* pEngine = pLink->pTable->pEngine;
+	struct itimerspec tInterval;
+	snd_seq_event_t tEvent;
+
+	pLink->tJingle.nFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (pLink->tJingle.nFd < 0){
+		LOG_E("Create jingle timer failed: %m");
+		return;
+	}
+	pLink->tJingle.pOnEvent = onJingleTimer;
+	pLink->tJingle.pContext = pLink;
+	pLink->nJingleStep = 0;
+
+	memset(&tInterval, 0, sizeof(tInterval));
+	tInterval.it_value.tv_nsec = LINK_JINGLE_STEP_MS * 1000000L;
+	tInterval.it_interval = tInterval.it_value;
+	if ((timerfd_settime(pLink->tJingle.nFd, 0, &tInterval, NULL) < 0) ||
+			(nReactorAdd(pLink->pTable->pReactor, &(pLink->tJingle), EPOLLIN) < 0)){
+		close(pLink->tJingle.nFd);
+		pLink->tJingle.nFd = -1;
+		return;
+	}
+
+	snd_seq_ev_clear(&tEvent);
+	tEvent.type = SND_SEQ_EVENT_PGMCHANGE;
+	tEvent.data.control.channel = 0;
+	tEvent.data.control.value = 25;
+	nSeqEngineQueue(pEngine, &tEvent);	// goes out with the first note
+	submitNote(pEngine, SND_SEQ_EVENT_NOTEON, 80);
+	seqEngineKick(pEngine);
+}
+
+static int32_t nSwitchToBinary(midi_link_t* pLink)
+{
+	uint8_t unHello = MIDI_WIRE_HELLO;
+	struct termios tSerial;
+
+	if (1 == pLink->nIsTty){
+		/* binary frames must not go through the canonical line discipline */
+		if (tcgetattr(pLink->tHandler.nFd, &tSerial) == 0){
+			tSerial.c_lflag &= ~ICANON;
+			tSerial.c_iflag &= ~ICRNL;
+			tcsetattr(pLink->tHandler.nFd, TCSANOW, &tSerial);
+		}
+	}
+	if (write(pLink->tHandler.nFd, &unHello, 1) != 1){
+		LOG_E("Acknowledge binary framing failed: %m");
+		return (-1);
+	}
+	midiWireParserInit(&(pLink->tWire));
+	pLink->nBinary = 1;
+	LOG_I("Link %s switched to binary framing.", pLink->cName);
+	return 0;
+}
+
+/* Event plus sender stamp, see midi_link_t. Returns -1 if malformed. */
+static int32_t nScheduleStampedFrame(midi_link_t* pLink, snd_seq_event_t* pEvent,
+		char* pFrame, int64_t llArrivalUs)
+{
+	uint8_t unStamp[(NOTE_FRAME_STAMP_LENGTH - 1) / 2];
+	uint32_t unSenderUs;
+
+	if ((generateEventContent(pEvent, pFrame) < 0) ||
+			(nMidiWireDecodeHex(pFrame + NOTE_FRAME_LENGTH - 1, unStamp, sizeof(unStamp)) < 0)){
+		return (-1);
+	}
+	unSenderUs = ((uint32_t)unStamp[0] << 24) | ((uint32_t)unStamp[1] << 16) |
+			((uint32_t)unStamp[2] << 8) | unStamp[3];
+	seqEngineSchedule(pLink->pTable->pEngine, pEvent,
+			llJitterClockMap(&(pLink->tSenderClock), unSenderUs, llArrivalUs));
+	return 0;
+}
+
+/* Returns the number of frames completed by this read */
+static int32_t nHandleTextFrames(midi_link_t* pLink, int64_t llArrivalUs)
+{
+	snd_seq_event_t tSndSeqEvent;
+	char* pFrame;
+	int32_t nFrameLen;
+	int32_t nRSTL;
+	int32_t nFrames = 0;
+
+	snd_seq_ev_clear(&tSndSeqEvent);
+	// every complete frame of this read is decoded in place
+	while (NULL != (pFrame = pStreamBufNextFrame(&(pLink->tStream), &nFrameLen))){
+		nFrames++;
+		if ((1 == nFrameLen) && (MIDI_WIRE_HELLO == (uint8_t)pFrame[0])){
+			if (0 == nSwitchToBinary(pLink)){
+				return nFrames;
+			}
+			continue;
+		}
+		LOG_D("%s received: %s", pLink->cName, pFrame);
+		snd_seq_ev_clear(&tSndSeqEvent);
+		if ((NOTE_FRAME_LENGTH - 1) == nFrameLen){
+			nRSTL = generateEventContent(&tSndSeqEvent, pFrame);
+			seqEngineSchedule(pLink->pTable->pEngine, &tSndSeqEvent, llArrivalUs);
+		}else if ((NOTE_FRAME_LENGTH + NOTE_FRAME_STAMP_LENGTH - 2) == nFrameLen){
+			nRSTL = nScheduleStampedFrame(pLink, &tSndSeqEvent, pFrame, llArrivalUs);
+		}else{
+			nRSTL = -1;
+		}
+		if (nRSTL < 0){
+			pLink->unMalformed++;
+			if (pLink->pStats != NULL){
+				statsCount(&(pLink->pStats->unMalformed), 1);
+			}
+			LOG_W("Malformed %s frame dropped.", pLink->cName);
+			continue;
+		}
+		if (pLink->pStats != NULL){
+			statsCount(&(pLink->pStats->unFrames), 1);
+		}
+		nSeqEngineQueueFrom(pLink->pTable->pEngine, &tSndSeqEvent, pLink->nSource, pLink->ullReadNs);
+	}
+	return nFrames;
+}
+
+static int32_t nQueueSysEx(midi_link_t* pLink, const uint8_t* pData, int32_t nLen, int64_t llArrivalUs)
+{
+	seq_engine_t* pEngine = pLink->pTable->pEngine;
+	snd_seq_event_t tEvent;
+
+	if (nSeqEngineSysExEvent(pEngine, &tEvent, pData, nLen) < 0){
+		return (-1);
+	}
+	seqEngineSchedule(pEngine, &tEvent, llArrivalUs);
+	return nSeqEngineQueueFrom(pEngine, &tEvent, pLink->nSource, pLink->ullReadNs);
+}
+
+/* Hand the SysEx chunk the parser stopped at, if any, to the engine.
+ * Once a chunk finds no buffer or queue room the rest of its message is
+ * dropped as well, a synth must not get a dump spliced together from
+ * its ends. If the start already went out an early F7 closes it, sent
+ * with the next chunk the link reads if there is no room right now. */
+static void forwardSysEx(midi_link_t* pLink, int64_t llArrivalUs)
+{
+	static const uint8_t SYSEX_END = 0xF7;
+	const uint8_t* pSysEx;
+	int32_t nLen, nLast;
+
+	pSysEx = pMidiStreamSysEx(&(pLink->tWire.tStream), &nLen, &nLast);
+	if ((NULL == pSysEx) || (0 == nLen)){
+		return;
+	}
+	if (0xF0 == pSysEx[0]){
+		pLink->nSysExBroken = 0;	// a new message
+	}
+	if ((1 == pLink->nSysExUnclosed) && (0 == nQueueSysEx(pLink, &SYSEX_END, 1, llArrivalUs))){
+		pLink->nSysExUnclosed = 0;
+	}
+	if (1 == pLink->nSysExBroken){
+		// rest of a lost message
+	}else if ((1 == pLink->nSysExUnclosed) || (nQueueSysEx(pLink, pSysEx, nLen, llArrivalUs) < 0)){
+		pLink->nSysExBroken = 1;
+		if (pSysEx[0] != 0xF0){
+			pLink->nSysExUnclosed = 1;	// the chunks before went out
+		}
+		if (pLink->pTable->pStats != NULL){
+			statsCount(&(pLink->pTable->pStats->unSysExLost), 1);
+		}
+		LOG_W("%s SysEx message lost, no free buffer or queue room.", pLink->cName);
+	}else if (pLink->pStats != NULL){
+		statsCount(&(pLink->pStats->unSysEx), 1);
+	}
+	if (1 == nLast){
+		pLink->nSysExBroken = 0;
+	}
+}
+
+/* Binary frames, or plain MIDI on a raw link. Every event goes out as
+ * soon as its last byte is read. Returns the number of events decoded
+ * from this read. */
+static int32_t nHandleMidiStream(midi_link_t* pLink, int64_t llArrivalUs)
+{
+	midi_stream_parser_t* pStream = &(pLink->tWire.tStream);
+	snd_seq_event_t tEvents[LINK_MAX_DECODED_EVENTS];
+	uint8_t* pData;
+	int32_t nLen, nUsed, nEvents, nIndex;
+	int32_t nFrames = 0;
+	uint32_t unMalformed = pStream->unMalformed;
+
+	pData = (uint8_t*)pStreamBufPending(&(pLink->tStream), &nLen);
+	while (nLen > 0){
+		if (1 == pLink->nRawMidi){
+			nEvents = nMidiStreamDecode(pStream, pData, nLen,
+					tEvents, LINK_MAX_DECODED_EVENTS, &nUsed);
+		}else{
+			nEvents = nMidiWireDecode(&(pLink->tWire), pData, nLen,
+					tEvents, LINK_MAX_DECODED_EVENTS, &nUsed);
+		}
+		for (nIndex = 0; nIndex < nEvents; nIndex++){
+			seqEngineSchedule(pLink->pTable->pEngine, tEvents + nIndex, llArrivalUs);
+			nSeqEngineQueueFrom(pLink->pTable->pEngine, tEvents + nIndex,
+					pLink->nSource, pLink->ullReadNs);
+		}
+		nFrames += nEvents;
+		forwardSysEx(pLink, llArrivalUs);
+		streamBufConsume(&(pLink->tStream), nUsed);
+		pData += nUsed;
+		nLen -= nUsed;
+	}
+	if (pLink->pStats != NULL){
+		statsCount(&(pLink->pStats->unFrames), nFrames);
+		statsCount(&(pLink->pStats->unMalformed), pStream->unMalformed - unMalformed);
+	}
+	return nFrames;
+}
+
+/* One ATT notification per read, the socket keeps PDU boundaries. The
+ * sender clock unfolded from the 13 bit timestamps goes through the
+ * jitter clock like the stamps of text frames. Returns the number of
+ * events decoded from this read. */
+static int32_t nHandleBleMidi(midi_link_t* pLink, int64_t llArrivalUs)
+{
+	midi_stream_parser_t* pStream = &(pLink->tWire.tStream);
+	snd_seq_event_t tEvents[LINK_MAX_DECODED_EVENTS];
+	uint32_t unSenderUs[LINK_MAX_DECODED_EVENTS];
+	struct timespec tNow;
+	int64_t llNowUs;
+	uint8_t* pData;
+	int32_t nLen, nPdu, nUsed, nEvents, nIndex;
+	int32_t nFrames = 0;
+	uint32_t unMalformed = pStream->unMalformed;
+
+	pData = (uint8_t*)pStreamBufPending(&(pLink->tStream), &nLen);
+	nPdu = nLen;
+	if ((nLen < ATT_NOTIFY_HEADER) || (pData[0] != ATT_OP_NOTIFY) ||
+			((pData[1] | (pData[2] << 8)) != pLink->unBleHandle)){
+		streamBufConsume(&(pLink->tStream), nPdu);
+		return 0;	// some other attribute, or a late response
+	}
+
+	/* after a pause longer than half the timestamp range the unfolded
+	 * sender clock cannot be trusted, start both clocks over */
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	llNowUs = (int64_t)tNow.tv_sec * 1000000 + tNow.tv_nsec / 1000;
+	if ((llNowUs - pLink->llBlePacketUs) > (BLE_MIDI_STAMP_WRAP_US / 2)){
+		pLink->tBle.nStarted = 0;
+		jitterClockInit(&(pLink->tSenderClock));
+	}
+	pLink->llBlePacketUs = llNowUs;
+
+	pData += ATT_NOTIFY_HEADER;
+	nLen -= ATT_NOTIFY_HEADER;
+	nUsed = nBleMidiPacketStart(&(pLink->tBle), pStream, pData, nLen);
+	while ((nUsed > 0) && (nLen > 0)){
+		pData += nUsed;
+		nLen -= nUsed;
+		nEvents = nBleMidiDecode(&(pLink->tBle), pStream, pData, nLen,
+				tEvents, unSenderUs, LINK_MAX_DECODED_EVENTS, &nUsed);
+		for (nIndex = 0; nIndex < nEvents; nIndex++){
+			seqEngineSchedule(pLink->pTable->pEngine, tEvents + nIndex,
+					llJitterClockMap(&(pLink->tSenderClock), unSenderUs[nIndex], llArrivalUs));
+			nSeqEngineQueueFrom(pLink->pTable->pEngine, tEvents + nIndex,
+					pLink->nSource, pLink->ullReadNs);
+		}
+		nFrames += nEvents;
+		forwardSysEx(pLink, llArrivalUs);
+	}
+	streamBufConsume(&(pLink->tStream), nPdu);
+	if (pLink->pStats != NULL){
+		statsCount(&(pLink->pStats->unFrames), nFrames);
+		statsCount(&(pLink->pStats->unMalformed), pStream->unMalformed - unMalformed);
+	}
+	return nFrames;
+}
+
+/* How long the first frame completed by this read waited for its tail,
+ * 0 unless it was split across reads. One sample per read that completes
+ * a frame, so split frames do not hide behind their neighbours. */
+static void recordFrameWait(midi_link_t* pLink, int32_t nFrames)
+{
+	int32_t nPending;
+	int32_t nMidFrame;
+
+	if ((1 == pLink->nRawMidi) || (1 == pLink->nBleMidi)){
+		nMidFrame = nMidiStreamMidMessage(&(pLink->tWire.tStream));
+	}else if (1 == pLink->nBinary){
+		nMidFrame = (pLink->tWire.unFrameLeft != 0) ? 1 : 0;
+	}else{
+		pStreamBufPending(&(pLink->tStream), &nPending);
+		nMidFrame = (nPending > 0) ? 1 : 0;
+	}
+	if (nFrames > 0){
+		statsRecord(pLink->pStats, STATS_STAGE_FRAME, (0 == pLink->ullPartialSinceNs) ?
+				0 : pLink->ullReadNs - pLink->ullPartialSinceNs);
+		pLink->ullPartialSinceNs = 0;
+	}
+	if ((1 == nMidFrame) && (0 == pLink->ullPartialSinceNs)){
+		pLink->ullPartialSinceNs = pLink->ullReadNs;
+	}
+}
+
+static void onLinkReadable(reactor_handler_t* pHandler, uint32_t unEvents)
+{
+	midi_link_t* pLink = (midi_link_t*)pHandler->pContext;
+	seq_engine_t* pEngine = pLink->pTable->pEngine;
+	int64_t llArrivalUs = 0;
+	int32_t nBytesRead;
+	int32_t nFrames = 0;
+
+	nBytesRead = nStreamBufRecv(&(pLink->tStream), pHandler->nFd);
+	if (nBytesRead < 0){
+		if ((EAGAIN == errno) || (EWOULDBLOCK == errno) || (EINTR == errno)){
+			return;	// stale or spurious readiness
+		}
+		LOG_W("%s received error with code %d.", pLink->cName, errno);
+		if (pLink->pTable->pStats != NULL){
+			statsCount(&(pLink->pTable->pStats->unDropped), 1);
+		}
+		linkClose(pLink);
+		return;
+	}
+	if (0 == nBytesRead){
+		/* a canonical tty reports VEOF as a zero length read, that is not a hang up */
+		if ((1 == pLink->nIsTty) && (0 == (unEvents & EPOLLHUP))){
+			return;
+		}
+		LOG_I("%s closed connection.", pLink->cName);
+		linkClose(pLink);
+		return;
+	}
+
+	if (pEngine->nQueue != SEQ_ENGINE_NO_QUEUE){
+		llArrivalUs = llSeqEngineQueueTimeUs(pEngine);
+	}
+	if (pLink->pStats != NULL){
+		pLink->ullReadNs = ullStatsNowNs();
+		__atomic_add_fetch(&(pLink->pStats->ullBytes), nBytesRead, __ATOMIC_RELAXED);
+	}
+	if (1 == pLink->nBleMidi){
+		nFrames = nHandleBleMidi(pLink, llArrivalUs);
+	}else if ((0 == pLink->nBinary) && (0 == pLink->nRawMidi)){
+		nFrames = nHandleTextFrames(pLink, llArrivalUs);
+	}
+	if ((1 == pLink->nBinary) || (1 == pLink->nRawMidi)){
+		nFrames += nHandleMidiStream(pLink, llArrivalUs);
+	}
+	if (pLink->pStats != NULL){
+		recordFrameWait(pLink, nFrames);
+		statsRecord(pLink->pStats, STATS_STAGE_DECODE, ullStatsNowNs() - pLink->ullReadNs);
+	}
+	// one doorbell per read burst
+	seqEngineKick(pEngine);
+}
+
+/* pStats may be NULL, otherwise it needs at least nCapacity link slots.
+ * Slot memory is allocated as links arrive, nCapacity is only the limit. */
+int32_t nLinkTableInit(midi_link_table_t* pTable, reactor_t* pReactor,
+		seq_engine_t* pEngine, daemon_stats_t* pStats, int32_t nCapacity)
+{
+	memset(pTable, 0, sizeof(midi_link_table_t));
+	if (nSlotTableInit(&(pTable->tLinks), sizeof(midi_link_t), nCapacity) < 0){
+		return (-1);
+	}
+	pTable->pReactor = pReactor;
+	pTable->pEngine = pEngine;
+	pTable->pStats = pStats;
+	return 0;
+}
+
+/* Take over nFd. Returns NULL, with nFd closed, when all slots are busy.
+ * The slot belongs to the link, and so to the reactor thread, until
+ * linkClose() hands it back. */
+midi_link_t* pLinkOpen(midi_link_table_t* pTable, int32_t nFd, const char* pName, int32_t nPlayJingle)
+{
+	midi_link_t* pLink;
+	int32_t nIndex;
+
+	nIndex = nSlotTableAcquire(&(pTable->tLinks));
+	if (SLOT_TABLE_NO_SLOT == nIndex){
+		LOG_W("All %d links busy, %s rejected.", pTable->tLinks.nMaxSlots, pName);
+		if (pTable->pStats != NULL){
+			statsCount(&(pTable->pStats->unRejected), 1);
+		}
+		close(nFd);
+		return NULL;
+	}
+
+	pLink = pSlotTableGet(&(pTable->tLinks), nIndex);
+	memset(pLink, 0, sizeof(midi_link_t));
+	pLink->pTable = pTable;
+	pLink->nSource = nIndex;
+	pLink->nIsTty = isatty(nFd) ? 1 : 0;
+	pLink->tJingle.nFd = -1;
+	snprintf(pLink->cName, sizeof(pLink->cName), "%s", pName);
+	streamBufInit(&(pLink->tStream), NOTE_FRAME_END_SYMBOL);
+	jitterClockInit(&(pLink->tSenderClock));
+
+	pLink->tHandler.nFd = nFd;
+	pLink->tHandler.pOnEvent = onLinkReadable;
+	pLink->tHandler.pContext = pLink;
+	if (pTable->pStats != NULL){
+		statsLinkOpen(pTable->pStats, nIndex, pName);
+		pLink->pStats = pStatsForSource(pTable->pStats, nIndex);
+	}
+	if ((nSeqEngineOpenSource(pTable->pEngine, nIndex, EVENT_MERGE_DEFAULT_WEIGHT) < 0) ||
+			(nSetNonBlocking(nFd) < 0) ||
+			(nReactorAdd(pTable->pReactor, &(pLink->tHandler), EPOLLIN | EPOLLRDHUP) < 0)){
+		close(nFd);
+		pLink->tHandler.nFd = -1;
+		if (pTable->pStats != NULL){
+			statsLinkClose(pTable->pStats, nIndex);
+		}
+		slotTableFree(&(pTable->tLinks), nIndex);
+		return NULL;
+	}
+	pLink->nInUse = 1;
+	pTable->nActive++;
+
+	if (1 == nPlayJingle){
+		startJingle(pLink);
+	}
+	return pLink;
+}
+
+/* The link carries plain MIDI from now on. Call on the reactor thread,
+ * or before it runs, with the fd already raw. */
+void linkSetRawMidi(midi_link_t* pLink)
+{
+	midiWireParserInit(&(pLink->tWire));
+	pLink->nRawMidi = 1;
+	LOG_I("Link %s carries raw MIDI.", pLink->cName);
+}
+
+/* The link carries BLE-MIDI notifications of unValueHandle from now on,
+ * on an ATT socket from nBleCentralConnect(). Call before the reactor
+ * runs. */
+void linkSetBleMidi(midi_link_t* pLink, uint16_t unValueHandle)
+{
+	midiWireParserInit(&(pLink->tWire));
+	bleMidiParserInit(&(pLink->tBle));
+	pLink->unBleHandle = unValueHandle;
+	pLink->llBlePacketUs = 0;
+	pLink->nBleMidi = 1;
+	LOG_I("Link %s carries BLE-MIDI.", pLink->cName);
+}
+
+/* The slot keeps its memory, only nFd = -1 marks it, see reactorRun() */
+void linkClose(midi_link_t* pLink)
+{
+	midi_link_table_t* pTable = pLink->pTable;
+
+	if (0 == pLink->nInUse){
+		return;
+	}
+	if (pLink->tJingle.nFd >= 0){
+		nReactorRemove(pTable->pReactor, &(pLink->tJingle));
+		close(pLink->tJingle.nFd);
+		pLink->tJingle.nFd = -1;
+	}
+	nReactorRemove(pTable->pReactor, &(pLink->tHandler));
+	close(pLink->tHandler.nFd);
+	pLink->tHandler.nFd = -1;
+	if ((pLink->unMalformed + pLink->tWire.tStream.unMalformed) > 0){
+		LOG_I("%s had %u malformed frames.", pLink->cName,
+				pLink->unMalformed + pLink->tWire.tStream.unMalformed);
+	}
+	if (pTable->pStats != NULL){
+		statsLinkClose(pTable->pStats, pLink->nSource);
+	}
+	pLink->nInUse = 0;
+	pTable->nActive--;
+	slotTableFree(&(pTable->tLinks), pLink->nSource);
+}
+
+void linkTableRelease(midi_link_table_t* pTable)
+{
+	int32_t nIndex;
+
+	for (nIndex = 0; nIndex < nSlotTableSlots(&(pTable->tLinks)); nIndex++){
+		linkClose(pSlotTableGet(&(pTable->tLinks), nIndex));
+	}
+	slotTableRelease(&(pTable->tLinks));
+}
@@ -0,0 +1,86 @@
+/*
+ * midi_link.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#ifndef MIDI_LINK_H_
+#define MIDI_LINK_H_
+
+#include <stdint.h>
+
+#include "reactor.h"
+#include "stream_buf.h"
+#include "midi_wire.h"
+#include "ble_midi.h"
+#include "seq_engine.h"
+#include "jitter.h"
+#include "slot_table.h"
+
+#define NOTE_FRAME_LENGTH				sizeof("0601AE2C")	// type+channel+note+velocity
+#define NOTE_FRAME_DATA_NUMBER			((NOTE_FRAME_LENGTH - 1)/2)
+#define NOTE_FRAME_END_SYMBOL			'\n'
+#define NOTE_FRAME_STAMP_LENGTH			sizeof("12345678")	// sender microseconds, big endian
+#define LINK_NAME_LENGTH				32
+#define LINK_MAX_DECODED_EVENTS			64
+
+typedef struct midi_link_table midi_link_table_t;
+
+/* One player connection: an RFCOMM socket, the UART, or anything else
+ * that delivers the same byte stream (socketpair, pty). A raw MIDI link,
+ * a DIN port on the UART, skips the framing and is parsed byte by byte.
+ * A BLE-MIDI link reads one ATT notification at a time and schedules
+ * each event by its BLE timestamp.
+ * A text frame may carry the sender's time stamp behind the event,
+ * "0601AE2C0012D687\n", used when the engine plays through a queue. */
+typedef struct {
+	reactor_handler_t tHandler;
+	reactor_handler_t tJingle;
+	int32_t nJingleStep;
+	int32_t nInUse;
+	int32_t nIsTty;
+	int32_t nBinary;
+	int32_t nRawMidi;
+	int32_t nBleMidi;
+	uint16_t unBleHandle;		// attribute handle the notifications must carry
+	stream_buf_t tStream;
+	midi_wire_parser_t tWire;	// raw and BLE-MIDI use only its stream parser
+	ble_midi_parser_t tBle;
+	int32_t nSysExBroken;		// a chunk was lost, drop the rest of the message
+	int32_t nSysExUnclosed;		// a cut short message still needs its F7
+	int64_t llBlePacketUs;		// arrival of the last BLE-MIDI packet, monotonic
+	jitter_clock_t tSenderClock;
+	uint32_t unMalformed;
+	int32_t nSource;			// slot index, also the statistics source id
+	link_stats_t* pStats;		// NULL when the daemon keeps no statistics
+	uint64_t ullReadNs;
+	uint64_t ullPartialSinceNs;	// read that brought the first byte of a split frame
+	midi_link_table_t* pTable;
+	char cName[LINK_NAME_LENGTH];
+}midi_link_t;
+
+struct midi_link_table{
+	reactor_t* pReactor;
+	seq_engine_t* pEngine;
+	slot_table_t tLinks;		// of midi_link_t, grows on demand up to the capacity
+	int32_t nActive;
+	daemon_stats_t* pStats;
+};
+
+int32_t generateEventContent(snd_seq_event_t* pSndSeqEvent, char* pEventString);
+
+int32_t nLinkTableInit(midi_link_table_t* pTable, reactor_t* pReactor,
+		seq_engine_t* pEngine, daemon_stats_t* pStats, int32_t nCapacity);
+
+midi_link_t* pLinkOpen(midi_link_table_t* pTable, int32_t nFd, const char* pName, int32_t nPlayJingle);
+
+void linkSetRawMidi(midi_link_t* pLink);
+
+void linkSetBleMidi(midi_link_t* pLink, uint16_t unValueHandle);
+
+void linkClose(midi_link_t* pLink);
+
+void linkTableRelease(midi_link_table_t* pTable);
+
+#endif /* MIDI_LINK_H_ */
@@ -0,0 +1,126 @@
+/*
+ * midi_out.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ *
+ *  Backend dispatch and the null backend. The sequencer and raw MIDI
+ *  backends live in midi_out_seq.c and midi_out_rawmidi.c.
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <alsa/asoundlib.h>
+
+#include "midi_out.h"
+#include "stats.h"
+
+int32_t nMidiOutOpen(midi_out_t* pOut, const midi_out_backend_t* pBackend, const char* pTarget)
+{
+	memset(pOut, 0, sizeof(midi_out_t));
+	pOut->pBackend = pBackend;
+	if (pBackend->nOpen(pOut, pTarget) < 0){
+		pOut->pBackend = NULL;
+		return (-1);
+	}
+	printf("  MIDI output %s opened on %s.\n", pBackend->pName,
+			((NULL == pTarget) || ('\0' == pTarget[0])) ? "nothing" : pTarget);
+	return 0;
+}
+
+int32_t nMidiOutSendBatch(midi_out_t* pOut, const snd_seq_event_t* pEvents, int32_t nCount)
+{
+	if (pOut->pBackend->nSendBatch(pOut, pEvents, nCount) < 0){
+		pOut->unErrors++;
+		return (-1);
+	}
+	pOut->unEvents += nCount;
+	return 0;
+}
+
+int32_t nMidiOutFlush(midi_out_t* pOut)
+{
+	pOut->unFlushes++;
+	if (pOut->pBackend->nFlush(pOut) < 0){
+		pOut->unErrors++;
+		return (-1);
+	}
+	return 0;
+}
+
+void midiOutClose(midi_out_t* pOut)
+{
+	if (NULL == pOut->pBackend){
+		return;
+	}
+	printf("  MIDI output %s closed, %u events in %u flushes, %u errors.\n",
+			pOut->pBackend->pName, pOut->unEvents, pOut->unFlushes, pOut->unErrors);
+	pOut->pBackend->close(pOut);
+	pOut->pBackend = NULL;
+}
+
+static int32_t nNullOpen(midi_out_t* pOut, const char* pTarget)
+{
+	FILE* pFile;
+
+	if ((NULL == pTarget) || ('\0' == pTarget[0])){
+		return 0;
+	}
+	pFile = fopen(pTarget, "w");
+	if (NULL == pFile){
+		perror("Open MIDI record file failed");
+		return (-1);
+	}
+	pOut->pState = pFile;
+	return 0;
+}
+
+static int32_t nNullSendBatch(midi_out_t* pOut, const snd_seq_event_t* pEvents, int32_t nCount)
+{
+	FILE* pFile = (FILE*)pOut->pState;
+	uint64_t ullNow;
+	int32_t nIndex;
+
+	if (pOut->pRecord != NULL){
+		pOut->pRecord(pEvents, nCount, pOut->pRecordContext);
+	}
+	if (NULL == pFile){
+		return 0;
+	}
+	ullNow = ullStatsNowNs();
+	for (nIndex = 0; nIndex < nCount; nIndex++){
+		if ((pEvents[nIndex].type >= SND_SEQ_EVENT_NOTE) && (pEvents[nIndex].type <= SND_SEQ_EVENT_KEYPRESS)){
+			fprintf(pFile, "%" PRIu64 " type:%u channel:%u note:%u velocity:%u\n", ullNow,
+					pEvents[nIndex].type, pEvents[nIndex].data.note.channel,
+					pEvents[nIndex].data.note.note, pEvents[nIndex].data.note.velocity);
+		}else if (SND_SEQ_EVENT_SYSEX == pEvents[nIndex].type){
+			fprintf(pFile, "%" PRIu64 " type:%u length:%u\n", ullNow,
+					pEvents[nIndex].type, pEvents[nIndex].data.ext.len);
+		}else{
+			fprintf(pFile, "%" PRIu64 " type:%u channel:%u param:%u value:%d\n", ullNow,
+					pEvents[nIndex].type, pEvents[nIndex].data.control.channel,
+					pEvents[nIndex].data.control.param, pEvents[nIndex].data.control.value);
+		}
+	}
+	return 0;
+}
+
+static int32_t nNullFlush(midi_out_t* pOut)
+{
+	if (pOut->pState != NULL){
+		fflush((FILE*)pOut->pState);
+	}
+	return 0;
+}
+
+static void nullClose(midi_out_t* pOut)
+{
+	if (pOut->pState != NULL){
+		fclose((FILE*)pOut->pState);
+		pOut->pState = NULL;
+	}
+}
+
+const midi_out_backend_t MIDI_OUT_NULL = {
+	"null", nNullOpen, nNullSendBatch, nNullFlush, nullClose
+};
@@ -0,0 +1,58 @@
+/*
+ * midi_out.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#ifndef MIDI_OUT_H_
+#define MIDI_OUT_H_
+
+#include <stdint.h>
+
+#define MIDI_OUT_RAWMIDI_BUFFER_SIZE	4096
+
+typedef struct midi_out midi_out_t;
+
+/* Where the engine's events end up. nSendBatch only buffers, nFlush hands
+ * everything buffered to the kernel (or the file) in as few calls as
+ * possible. All four run on the engine thread once it is started. */
+typedef struct {
+	const char* pName;
+	int32_t (*nOpen)(midi_out_t* pOut, const char* pTarget);
+	int32_t (*nSendBatch)(midi_out_t* pOut, const snd_seq_event_t* pEvents, int32_t nCount);
+	int32_t (*nFlush)(midi_out_t* pOut);
+	void (*close)(midi_out_t* pOut);
+}midi_out_backend_t;
+
+/* Sees every batch the null backend gets, e.g. a benchmark sink */
+typedef void (*midi_out_record_t)(const snd_seq_event_t* pEvents, int32_t nCount, void* pContext);
+
+struct midi_out{
+	const midi_out_backend_t* pBackend;
+	void* pState;		// owned by the backend
+	midi_out_record_t pRecord;
+	void* pRecordContext;
+	uint32_t unEvents;
+	uint32_t unFlushes;
+	uint32_t unErrors;
+};
+
+/* Sequencer: target is the client:port list to connect to */
+extern const midi_out_backend_t MIDI_OUT_SEQ;
+/* Raw MIDI: target is a device such as hw:1,0,0, no routing in between */
+extern const midi_out_backend_t MIDI_OUT_RAWMIDI;
+/* Null: target is an optional file every event is written to as text */
+extern const midi_out_backend_t MIDI_OUT_NULL;
+
+int32_t nMidiOutOpen(midi_out_t* pOut, const midi_out_backend_t* pBackend, const char* pTarget);
+
+int32_t nMidiOutSendBatch(midi_out_t* pOut, const snd_seq_event_t* pEvents, int32_t nCount);
+
+int32_t nMidiOutFlush(midi_out_t* pOut);
+
+void midiOutClose(midi_out_t* pOut);
+
+snd_seq_t* pMidiOutSeq(midi_out_t* pOut);
+
+#endif /* MIDI_OUT_H_ */
@@ -0,0 +1,130 @@
+/*
+ * midi_out_rawmidi.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ *
+ *  ALSA raw MIDI backend for a single synth: events are turned into MIDI
+ *  bytes (with running status) in user space and a whole batch goes out
+ *  in one snd_rawmidi_write(), no sequencer routing in between.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <alsa/asoundlib.h>
+
+#include "midi.h"
+#include "midi_out.h"
+
+typedef struct {
+	snd_rawmidi_t* pRawmidi;
+	snd_midi_event_t* pDecoder;
+	int32_t nLen;
+	uint8_t unBuff[MIDI_OUT_RAWMIDI_BUFFER_SIZE];
+}midi_out_rawmidi_t;
+
+static void rawmidiClose(midi_out_t* pOut)
+{
+	midi_out_rawmidi_t* pState = (midi_out_rawmidi_t*)pOut->pState;
+
+	if (NULL == pState){
+		return;
+	}
+	if (pState->pRawmidi != NULL){
+		snd_rawmidi_drain(pState->pRawmidi);
+		snd_rawmidi_close(pState->pRawmidi);
+	}
+	if (pState->pDecoder != NULL){
+		snd_midi_event_free(pState->pDecoder);
+	}
+	free(pState);
+	pOut->pState = NULL;
+}
+
+/* Room for a full batch in the kernel, and no active sensing from the driver */
+static void tuneRawmidi(snd_rawmidi_t* pRawmidi)
+{
+	snd_rawmidi_params_t* pParams;
+	int32_t err;
+
+	snd_rawmidi_params_alloca(&pParams);
+	err = snd_rawmidi_params_current(pRawmidi, pParams);
+	if (err >= 0){
+		err = snd_rawmidi_params_set_buffer_size(pRawmidi, pParams, MIDI_OUT_RAWMIDI_BUFFER_SIZE);
+	}
+	if (err >= 0){
+		err = snd_rawmidi_params_set_no_active_sensing(pRawmidi, pParams, 1);
+	}
+	if (err >= 0){
+		err = snd_rawmidi_params(pRawmidi, pParams);
+	}
+	if (nCheckSnd("set raw MIDI parameters", err) < 0){
+		printf(", keeping the driver defaults.\n");
+	}
+}
+
+static int32_t nRawmidiOpen(midi_out_t* pOut, const char* pTarget)
+{
+	midi_out_rawmidi_t* pState;
+
+	if ((NULL == pTarget) || ('\0' == pTarget[0])){
+		printf("  Please specify a raw MIDI device, e.g. hw:1,0,0.\n");
+		return (-1);
+	}
+	pState = calloc(1, sizeof(midi_out_rawmidi_t));
+	if (NULL == pState){
+		perror("Allocate raw MIDI backend failed");
+		return (-1);
+	}
+	pOut->pState = pState;
+
+	if ((nCheckSnd("open raw MIDI", snd_rawmidi_open(NULL, &(pState->pRawmidi), pTarget, 0)) < 0) ||
+			(nCheckSnd("create MIDI event decoder",
+					snd_midi_event_new(MIDI_OUT_RAWMIDI_BUFFER_SIZE, &(pState->pDecoder))) < 0)){
+		rawmidiClose(pOut);
+		return (-1);
+	}
+	tuneRawmidi(pState->pRawmidi);
+	return 0;
+}
+
+static int32_t nRawmidiFlush(midi_out_t* pOut)
+{
+	midi_out_rawmidi_t* pState = (midi_out_rawmidi_t*)pOut->pState;
+	int32_t nLen = pState->nLen;
+
+	pState->nLen = 0;
+	if (0 == nLen){
+		return 0;
+	}
+	return (snd_rawmidi_write(pState->pRawmidi, pState->unBuff, nLen) != nLen) ? (-1) : 0;
+}
+
+static int32_t nRawmidiSendBatch(midi_out_t* pOut, const snd_seq_event_t* pEvents, int32_t nCount)
+{
+	midi_out_rawmidi_t* pState = (midi_out_rawmidi_t*)pOut->pState;
+	long lBytes;
+	int32_t nIndex;
+
+	for (nIndex = 0; nIndex < nCount; nIndex++){
+		lBytes = snd_midi_event_decode(pState->pDecoder, pState->unBuff + pState->nLen,
+				MIDI_OUT_RAWMIDI_BUFFER_SIZE - pState->nLen, pEvents + nIndex);
+		if ((-ENOMEM == lBytes) && (pState->nLen > 0)){
+			// buffer full, push it out and start over with full status
+			if (nRawmidiFlush(pOut) < 0){
+				return (-1);
+			}
+			snd_midi_event_reset_decode(pState->pDecoder);
+			nIndex--;
+			continue;
+		}
+		if (lBytes > 0){
+			pState->nLen += lBytes;
+		}	// events with no MIDI wire form are skipped
+	}
+	return 0;
+}
+
+const midi_out_backend_t MIDI_OUT_RAWMIDI = {
+	"rawmidi", nRawmidiOpen, nRawmidiSendBatch, nRawmidiFlush, rawmidiClose
+};
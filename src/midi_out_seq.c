@@ -0,0 +1,127 @@
+/*
+ * midi_out_seq.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ *
+ *  ALSA sequencer backend: our own source port, connected to every port
+ *  given on the command line, events go to the subscribers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <alsa/asoundlib.h>
+
+#include "midi.h"
+#include "midi_out.h"
+
+typedef struct {
+	snd_seq_t* pSeq;
+	snd_seq_addr_t* pPorts;
+	int32_t nPortCount;
+	int32_t nMyPortID;
+}midi_out_seq_t;
+
+static void seqClose(midi_out_t* pOut)
+{
+	midi_out_seq_t* pState = (midi_out_seq_t*)pOut->pState;
+
+	if (NULL == pState){
+		return;
+	}
+	if (pState->pPorts != NULL){
+		free(pState->pPorts);
+	}
+	if (pState->nMyPortID >= 0){
+		snd_seq_delete_port(pState->pSeq, pState->nMyPortID);
+	}
+	if (pState->pSeq != NULL){
+		snd_seq_close(pState->pSeq);
+	}
+	free(pState);
+	pOut->pState = NULL;
+}
+
+static int32_t nSeqOpen(midi_out_t* pOut, const char* pTarget)
+{
+	midi_out_seq_t* pState;
+
+	if ((NULL == pTarget) || ('\0' == pTarget[0])){
+		printf("  Please specify at least one port.\n");
+		return (-1);
+	}
+	pState = calloc(1, sizeof(midi_out_seq_t));
+	if (NULL == pState){
+		perror("Allocate sequencer backend failed");
+		return (-1);
+	}
+	pState->nMyPortID = -1;
+	pOut->pState = pState;
+
+	if ((nInitSeq(&(pState->pSeq)) < 0) || (NULL == pState->pSeq)){
+		seqClose(pOut);
+		return (-1);
+	}
+	printf("  Sequencer initialized.\n");
+	pState->nPortCount = nParsePorts(pTarget, &(pState->pPorts), pState->pSeq);
+	if (pState->nPortCount < 1){
+		pState->pPorts = NULL;	// freed by nParsePorts() on error
+		seqClose(pOut);
+		return (-1);
+	}
+	pState->nMyPortID = pCreateSourcePort(pState->pSeq);
+	if (pState->nMyPortID < 0){
+		seqClose(pOut);
+		return (-1);
+	}
+	printf("Source sequencer port created.\n");
+	if (nConnectPorts(pState->pSeq, pState->nPortCount, pState->pPorts) < 0){
+		seqClose(pOut);
+		return (-1);
+	}
+	printf("Target sequencer port connected.\n");
+	return 0;
+}
+
+/* Events already marked direct or scheduled keep that, see seq_engine.c */
+static int32_t nSeqSendBatch(midi_out_t* pOut, const snd_seq_event_t* pEvents, int32_t nCount)
+{
+	midi_out_seq_t* pState = (midi_out_seq_t*)pOut->pState;
+	snd_seq_event_t tEvent;
+	int32_t nIndex;
+
+	for (nIndex = 0; nIndex < nCount; nIndex++){
+		tEvent = pEvents[nIndex];
+		snd_seq_ev_set_source(&tEvent, pState->nMyPortID);
+		snd_seq_ev_set_subs(&tEvent);
+		if (SND_SEQ_EVENT_SYSEX == tEvent.type){
+			// the data is copied into the output buffer, the chunk may be reused after this
+			snd_seq_ev_set_variable(&tEvent, tEvent.data.ext.len, tEvent.data.ext.ptr);
+		}else{
+			snd_seq_ev_set_fixed(&tEvent);
+		}
+		if (snd_seq_event_output(pState->pSeq, &tEvent) < 0){
+			return (-1);
+		}
+	}
+	return 0;
+}
+
+static int32_t nSeqFlush(midi_out_t* pOut)
+{
+	midi_out_seq_t* pState = (midi_out_seq_t*)pOut->pState;
+	return (snd_seq_drain_output(pState->pSeq) < 0) ? (-1) : 0;
+}
+
+const midi_out_backend_t MIDI_OUT_SEQ = {
+	"seq", nSeqOpen, nSeqSendBatch, nSeqFlush, seqClose
+};
+
+/* The sequencer handle for the playout queue, NULL on any other backend */
+snd_seq_t* pMidiOutSeq(midi_out_t* pOut)
+{
+	if (pOut->pBackend != &MIDI_OUT_SEQ){
+		return NULL;
+	}
+	return ((midi_out_seq_t*)pOut->pState)->pSeq;
+}
@@ -0,0 +1,311 @@
+/*
+ * midi_params.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <alsa/asoundlib.h>
+
+#include "log.h"
+#include "midi_params.h"
+
+typedef enum {
+	MIDI_PARAMS_FIELD_VOLUME = 0,
+	MIDI_PARAMS_FIELD_TRANSPOSE,
+	MIDI_PARAMS_FIELD_CURVE,
+	MIDI_PARAMS_FIELD_PROGRAM
+}midi_params_field_t;
+
+void midiParamsInit(midi_params_t* pParams)
+{
+	int32_t nChannel, nVelocity;
+
+	memset(pParams, 0, sizeof(midi_params_t));
+	for (nChannel = 0; nChannel < MIDI_PARAMS_CHANNELS; nChannel++){
+		pParams->tChannel[nChannel].unVolume = MIDI_PARAMS_MAX_VOLUME;
+		pParams->tChannel[nChannel].nTranspose = 0;
+		pParams->tChannel[nChannel].unCurve = MIDI_PARAMS_CURVE_LINEAR;
+		pParams->tChannel[nChannel].unProgram = MIDI_PARAMS_NO_PROGRAM;
+		for (nVelocity = 0; nVelocity < MIDI_PARAMS_VELOCITIES; nVelocity++){
+			pParams->unVelocity[nChannel][nVelocity] = nVelocity;
+			pParams->unCustom[nChannel][nVelocity] = nVelocity;
+		}
+	}
+	pthread_mutex_init(&(pParams->tWriteLock), NULL);
+}
+
+/* Lock free, safe from any thread */
+void midiParamsRead(midi_params_t* pParams, int32_t nChannel, midi_channel_params_t* pChannel)
+{
+	uint32_t unBefore, unAfter;
+
+	do{
+		unBefore = __atomic_load_n(&(pParams->unSequence), __ATOMIC_ACQUIRE);
+		__atomic_load(pParams->tChannel + nChannel, pChannel, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		unAfter = __atomic_load_n(&(pParams->unSequence), __ATOMIC_RELAXED);
+	}while ((unBefore & 1) || (unBefore != unAfter));
+}
+
+/* Curve first, then volume. Velocity 0 stays 0, anything else stays >= 1
+ * so a note on never turns into a note off. */
+static void buildVelocityTable(const midi_channel_params_t* pChannel, const uint8_t* pCustom,
+		uint8_t* pTable)
+{
+	int32_t nVelocity, nShaped;
+
+	pTable[0] = 0;
+	for (nVelocity = 1; nVelocity < MIDI_PARAMS_VELOCITIES; nVelocity++){
+		switch (pChannel->unCurve){
+		case MIDI_PARAMS_CURVE_EXPONENTIAL:
+			nShaped = (nVelocity * nVelocity + 63) / 127;
+			break;
+		case MIDI_PARAMS_CURVE_CUSTOM:
+			nShaped = pCustom[nVelocity];
+			break;
+		default:
+			nShaped = nVelocity;
+			break;
+		}
+		nShaped = (nShaped * pChannel->unVolume + 63) / MIDI_PARAMS_MAX_VOLUME;
+		pTable[nVelocity] = (nShaped < 1) ? 1 : nShaped;
+	}
+}
+
+/* pShape is only used, and then required, when switching to the custom curve */
+static int32_t nUpdateChannels(midi_params_t* pParams, int32_t nChannel,
+		midi_params_field_t tField, int32_t nValue, const uint8_t* pShape)
+{
+	midi_channel_params_t tChannel[MIDI_PARAMS_CHANNELS];
+	uint8_t unTable[MIDI_PARAMS_CHANNELS][MIDI_PARAMS_VELOCITIES];
+	int32_t nFirst = nChannel, nLast = nChannel;
+	int32_t nRebuild, nVelocity;
+	uint32_t unSequence;
+
+	if (MIDI_PARAMS_ALL_CHANNELS == nChannel){
+		nFirst = 0;
+		nLast = MIDI_PARAMS_CHANNELS - 1;
+	}else if ((nChannel < 0) || (nChannel >= MIDI_PARAMS_CHANNELS)){
+		LOG_W("Channel %d out of range.", nChannel);
+		return (-1);
+	}
+	nRebuild = ((MIDI_PARAMS_FIELD_VOLUME == tField) || (MIDI_PARAMS_FIELD_CURVE == tField)) ? 1 : 0;
+
+	pthread_mutex_lock(&(pParams->tWriteLock));
+	// everything is worked out before readers are told to retry
+	for (nChannel = nFirst; nChannel <= nLast; nChannel++){
+		tChannel[nChannel] = pParams->tChannel[nChannel];
+		switch (tField){
+		case MIDI_PARAMS_FIELD_VOLUME:
+			tChannel[nChannel].unVolume = nValue;
+			break;
+		case MIDI_PARAMS_FIELD_TRANSPOSE:
+			tChannel[nChannel].nTranspose = nValue;
+			break;
+		case MIDI_PARAMS_FIELD_CURVE:
+			tChannel[nChannel].unCurve = nValue;
+			if (pShape != NULL){
+				memcpy(pParams->unCustom[nChannel], pShape, MIDI_PARAMS_VELOCITIES);
+			}
+			break;
+		case MIDI_PARAMS_FIELD_PROGRAM:
+			tChannel[nChannel].unProgram = nValue;
+			break;
+		}
+		if (1 == nRebuild){
+			buildVelocityTable(tChannel + nChannel, pParams->unCustom[nChannel], unTable[nChannel]);
+		}
+	}
+
+	unSequence = pParams->unSequence;	// only writers change it
+	__atomic_store_n(&(pParams->unSequence), unSequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	for (nChannel = nFirst; nChannel <= nLast; nChannel++){
+		__atomic_store(pParams->tChannel + nChannel, tChannel + nChannel, __ATOMIC_RELAXED);
+		for (nVelocity = 0; (1 == nRebuild) && (nVelocity < MIDI_PARAMS_VELOCITIES); nVelocity++){
+			__atomic_store_n(&(pParams->unVelocity[nChannel][nVelocity]),
+					unTable[nChannel][nVelocity], __ATOMIC_RELAXED);
+		}
+	}
+	__atomic_store_n(&(pParams->unSequence), unSequence + 2, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&(pParams->tWriteLock));
+	return 0;
+}
+
+/* 0..127 scales the velocity, 127 leaves it as played */
+int32_t nMidiParamsSetVolume(midi_params_t* pParams, int32_t nChannel, int32_t nVolume)
+{
+	if ((nVolume < 0) || (nVolume > MIDI_PARAMS_MAX_VOLUME)){
+		LOG_W("Volume %d out of range.", nVolume);
+		return (-1);
+	}
+	return nUpdateChannels(pParams, nChannel, MIDI_PARAMS_FIELD_VOLUME, nVolume, NULL);
+}
+
+int32_t nMidiParamsSetTranspose(midi_params_t* pParams, int32_t nChannel, int32_t nSemitones)
+{
+	if ((nSemitones < -(MIDI_PARAMS_NOTES - 1)) || (nSemitones > (MIDI_PARAMS_NOTES - 1))){
+		LOG_W("Transpose %d out of range.", nSemitones);
+		return (-1);
+	}
+	return nUpdateChannels(pParams, nChannel, MIDI_PARAMS_FIELD_TRANSPOSE, nSemitones, NULL);
+}
+
+/* Switching to MIDI_PARAMS_CURVE_CUSTOM reuses the channel's last custom shape */
+int32_t nMidiParamsSetCurve(midi_params_t* pParams, int32_t nChannel, int32_t nCurve)
+{
+	if ((nCurve < 0) || (nCurve >= MIDI_PARAMS_CURVE_CNT)){
+		LOG_W("Velocity curve %d unknown.", nCurve);
+		return (-1);
+	}
+	return nUpdateChannels(pParams, nChannel, MIDI_PARAMS_FIELD_CURVE, nCurve, NULL);
+}
+
+/* pShape maps each of the 128 played velocities to 0..127 before volume */
+int32_t nMidiParamsSetCustomCurve(midi_params_t* pParams, int32_t nChannel, const uint8_t* pShape)
+{
+	int32_t nVelocity;
+
+	for (nVelocity = 0; nVelocity < MIDI_PARAMS_VELOCITIES; nVelocity++){
+		if (pShape[nVelocity] > 127){
+			LOG_W("Custom velocity %u out of range.", pShape[nVelocity]);
+			return (-1);
+		}
+	}
+	return nUpdateChannels(pParams, nChannel, MIDI_PARAMS_FIELD_CURVE, MIDI_PARAMS_CURVE_CUSTOM, pShape);
+}
+
+/* Custom curve of two straight lines, 0 -> 0, nKneeIn -> nKneeOut, 127 -> 127 */
+int32_t nMidiParamsSetKneeCurve(midi_params_t* pParams, int32_t nChannel, int32_t nKneeIn, int32_t nKneeOut)
+{
+	uint8_t unShape[MIDI_PARAMS_VELOCITIES];
+	int32_t nVelocity;
+
+	if ((nKneeIn < 1) || (nKneeIn > 126) || (nKneeOut < 0) || (nKneeOut > 127)){
+		LOG_W("Knee %d:%d out of range.", nKneeIn, nKneeOut);
+		return (-1);
+	}
+	for (nVelocity = 0; nVelocity < MIDI_PARAMS_VELOCITIES; nVelocity++){
+		if (nVelocity <= nKneeIn){
+			unShape[nVelocity] = (nVelocity * nKneeOut + nKneeIn / 2) / nKneeIn;
+		}else{
+			unShape[nVelocity] = nKneeOut + ((nVelocity - nKneeIn) * (127 - nKneeOut) +
+					(127 - nKneeIn) / 2) / (127 - nKneeIn);
+		}
+	}
+	return nMidiParamsSetCustomCurve(pParams, nChannel, unShape);
+}
+
+/* Only remembered here, the program change itself goes out as an event */
+int32_t nMidiParamsSetProgram(midi_params_t* pParams, int32_t nChannel, int32_t nProgram)
+{
+	if ((nProgram < 0) || (nProgram >= MIDI_PARAMS_NOTES)){
+		LOG_W("Program %d out of range.", nProgram);
+		return (-1);
+	}
+	return nUpdateChannels(pParams, nChannel, MIDI_PARAMS_FIELD_PROGRAM, nProgram, NULL);
+}
+
+static int32_t nClampNote(int32_t nNote)
+{
+	if (nNote < 0){
+		return 0;
+	}
+	return (nNote >= MIDI_PARAMS_NOTES) ? (MIDI_PARAMS_NOTES - 1) : nNote;
+}
+
+static int32_t nIsNoteEvent(const snd_seq_event_t* pEvent)
+{
+	return ((SND_SEQ_EVENT_NOTEON == pEvent->type) || (SND_SEQ_EVENT_NOTEOFF == pEvent->type) ||
+			(SND_SEQ_EVENT_KEYPRESS == pEvent->type)) ? 1 : 0;
+}
+
+/* unShaped is the velocity table entry for this event's velocity */
+static void transformNote(const midi_channel_params_t* pChannel, uint8_t unShaped,
+		midi_note_map_t* pMap, snd_seq_event_t* pEvent)
+{
+	uint8_t* pSounding;
+
+	pSounding = &(pMap->unSounding[pEvent->data.note.channel & (MIDI_PARAMS_CHANNELS - 1)]
+			[pEvent->data.note.note & (MIDI_PARAMS_NOTES - 1)]);
+	if ((SND_SEQ_EVENT_NOTEON == pEvent->type) && (pEvent->data.note.velocity > 0)){
+		*pSounding = nClampNote(pEvent->data.note.note + pChannel->nTranspose) + 1;
+		pEvent->data.note.note = *pSounding - 1;
+		pEvent->data.note.velocity = unShaped;
+		return;
+	}
+
+	// note off and key pressure follow wherever the note on went
+	if (*pSounding != 0){
+		pEvent->data.note.note = *pSounding - 1;
+		if (SND_SEQ_EVENT_KEYPRESS != pEvent->type){
+			*pSounding = 0;
+		}
+	}else{
+		pEvent->data.note.note = nClampNote(pEvent->data.note.note + pChannel->nTranspose);
+	}
+}
+
+/* Transpose and velocity shaping for one outgoing event, a single pass
+ * through the seqlock. Only one thread may apply with a given note map. */
+void midiParamsApply(midi_params_t* pParams, midi_note_map_t* pMap, snd_seq_event_t* pEvent)
+{
+	midi_channel_params_t tChannel;
+	uint8_t unShaped;
+	int32_t nChannel, nVelocity;
+	uint32_t unBefore, unAfter;
+
+	if (0 == nIsNoteEvent(pEvent)){
+		return;
+	}
+	nChannel = pEvent->data.note.channel & (MIDI_PARAMS_CHANNELS - 1);
+	nVelocity = pEvent->data.note.velocity & (MIDI_PARAMS_VELOCITIES - 1);
+	do{
+		unBefore = __atomic_load_n(&(pParams->unSequence), __ATOMIC_ACQUIRE);
+		__atomic_load(pParams->tChannel + nChannel, &tChannel, __ATOMIC_RELAXED);
+		unShaped = __atomic_load_n(&(pParams->unVelocity[nChannel][nVelocity]), __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		unAfter = __atomic_load_n(&(pParams->unSequence), __ATOMIC_RELAXED);
+	}while ((unBefore & 1) || (unBefore != unAfter));
+	transformNote(&tChannel, unShaped, pMap, pEvent);
+}
+
+/* Same as midiParamsApply() on every event, but each channel present is
+ * read from the store once per batch, table and all. The lookups that
+ * follow are plain loads from a local copy the compiler can keep hot. */
+void midiParamsApplyBatch(midi_params_t* pParams, midi_note_map_t* pMap,
+		snd_seq_event_t* pEvents, int32_t nCount)
+{
+	midi_channel_params_t tChannel[MIDI_PARAMS_CHANNELS];
+	uint8_t unTable[MIDI_PARAMS_CHANNELS][MIDI_PARAMS_VELOCITIES];
+	uint32_t unLoaded = 0;	// bit per channel already copied
+	uint32_t unBefore, unAfter;
+	int32_t nIndex, nChannel, nVelocity;
+
+	for (nIndex = 0; nIndex < nCount; nIndex++){
+		if (0 == nIsNoteEvent(pEvents + nIndex)){
+			continue;
+		}
+		nChannel = pEvents[nIndex].data.note.channel & (MIDI_PARAMS_CHANNELS - 1);
+		if (0 == (unLoaded & (1U << nChannel))){
+			do{
+				unBefore = __atomic_load_n(&(pParams->unSequence), __ATOMIC_ACQUIRE);
+				__atomic_load(pParams->tChannel + nChannel, tChannel + nChannel, __ATOMIC_RELAXED);
+				for (nVelocity = 0; nVelocity < MIDI_PARAMS_VELOCITIES; nVelocity++){
+					unTable[nChannel][nVelocity] = __atomic_load_n(
+							&(pParams->unVelocity[nChannel][nVelocity]), __ATOMIC_RELAXED);
+				}
+				__atomic_thread_fence(__ATOMIC_ACQUIRE);
+				unAfter = __atomic_load_n(&(pParams->unSequence), __ATOMIC_RELAXED);
+			}while ((unBefore & 1) || (unBefore != unAfter));
+			unLoaded |= 1U << nChannel;
+		}
+		transformNote(tChannel + nChannel,
+				unTable[nChannel][pEvents[nIndex].data.note.velocity & (MIDI_PARAMS_VELOCITIES - 1)],
+				pMap, pEvents + nIndex);
+	}
+}
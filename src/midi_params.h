@@ -0,0 +1,77 @@
+/*
+ * midi_params.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#ifndef MIDI_PARAMS_H_
+#define MIDI_PARAMS_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define MIDI_PARAMS_CHANNELS			16
+#define MIDI_PARAMS_NOTES				128
+#define MIDI_PARAMS_ALL_CHANNELS		(-1)
+#define MIDI_PARAMS_MAX_VOLUME			127		// unity, velocities pass unchanged
+#define MIDI_PARAMS_NO_PROGRAM			0xFF
+#define MIDI_PARAMS_VELOCITIES			128
+
+typedef enum {
+	MIDI_PARAMS_CURVE_LINEAR = 0,
+	MIDI_PARAMS_CURVE_EXPONENTIAL,		// soft touch, v * v / 127
+	MIDI_PARAMS_CURVE_CUSTOM,			// any shape, see nMidiParamsSetCustomCurve()
+	MIDI_PARAMS_CURVE_CNT
+}midi_params_curve_t;
+
+/* Four bytes, so one channel is always read in a single load */
+typedef struct {
+	uint8_t unVolume;
+	int8_t nTranspose;
+	uint8_t unCurve;
+	uint8_t unProgram;
+}midi_channel_params_t;
+
+/* Live playing parameters. The control thread writes, the engine thread
+ * reads on every event. Readers never block: a seqlock tells them to
+ * retry when they overlapped an update, which only costs a few loads.
+ * Writers serialise among themselves on tWriteLock.
+ * Curve and volume are folded into one velocity table per channel, built
+ * by the writer before it opens the seqlock, so a note costs one load. */
+typedef struct {
+	uint32_t unSequence;		// odd while an update is in progress
+	midi_channel_params_t tChannel[MIDI_PARAMS_CHANNELS];
+	uint8_t unVelocity[MIDI_PARAMS_CHANNELS][MIDI_PARAMS_VELOCITIES];
+	uint8_t unCustom[MIDI_PARAMS_CHANNELS][MIDI_PARAMS_VELOCITIES];	// writer side only
+	pthread_mutex_t tWriteLock;
+}midi_params_t;
+
+/* Reader side memory of the note each held key was sent as, so a note
+ * off still matches its note on when the transpose changed in between. */
+typedef struct {
+	uint8_t unSounding[MIDI_PARAMS_CHANNELS][MIDI_PARAMS_NOTES];	// output note + 1, 0 if silent
+}midi_note_map_t;
+
+void midiParamsInit(midi_params_t* pParams);
+
+void midiParamsRead(midi_params_t* pParams, int32_t nChannel, midi_channel_params_t* pChannel);
+
+int32_t nMidiParamsSetVolume(midi_params_t* pParams, int32_t nChannel, int32_t nVolume);
+
+int32_t nMidiParamsSetTranspose(midi_params_t* pParams, int32_t nChannel, int32_t nSemitones);
+
+int32_t nMidiParamsSetCurve(midi_params_t* pParams, int32_t nChannel, int32_t nCurve);
+
+int32_t nMidiParamsSetCustomCurve(midi_params_t* pParams, int32_t nChannel, const uint8_t* pShape);
+
+int32_t nMidiParamsSetKneeCurve(midi_params_t* pParams, int32_t nChannel, int32_t nKneeIn, int32_t nKneeOut);
+
+int32_t nMidiParamsSetProgram(midi_params_t* pParams, int32_t nChannel, int32_t nProgram);
+
+void midiParamsApply(midi_params_t* pParams, midi_note_map_t* pMap, snd_seq_event_t* pEvent);
+
+void midiParamsApplyBatch(midi_params_t* pParams, midi_note_map_t* pMap,
+		snd_seq_event_t* pEvents, int32_t nCount);
+
+#endif /* MIDI_PARAMS_H_ */
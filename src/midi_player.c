@@ -0,0 +1,428 @@
+/*
+ * midi_player.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ *
+ *  Standard MIDI File playback. The file is mapped rather than read, so
+ *  even a large one costs no copy before parsing starts. Formats 0, 1
+ *  and 2 are all merged into one timeline; SysEx and meta events other
+ *  than tempo are skipped.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <alsa/asoundlib.h>
+
+#include "log.h"
+#include "midi_wire.h"
+#include "midi_player.h"
+
+#define MIDI_PLAYER_HEADER_LENGTH		14		// "MThd", length, format, tracks, division
+#define MIDI_PLAYER_CHUNK_HEADER		8
+
+static uint32_t unBigEndian(const uint8_t* pData, int32_t nBytes)
+{
+	uint32_t unValue = 0;
+
+	while (nBytes-- > 0){
+		unValue = (unValue << 8) | *pData++;
+	}
+	return unValue;
+}
+
+/* Variable length quantity at *ppPos, -1 when it runs past pEnd */
+static int32_t nReadVlq(const uint8_t** ppPos, const uint8_t* pEnd, uint32_t* pValue)
+{
+	uint32_t unValue = 0;
+	int32_t nBytes;
+
+	for (nBytes = 0; (nBytes < 4) && (*ppPos < pEnd); nBytes++){
+		unValue = (unValue << 7) | (**ppPos & 0x7F);
+		if (0 == (*(*ppPos)++ & 0x80)){
+			*pValue = unValue;
+			return 0;
+		}
+	}
+	return (-1);
+}
+
+static int32_t nSongAppend(midi_song_t* pSong, uint64_t ullTick, uint32_t unTempoUs,
+		const uint8_t* pData, int32_t nLen)
+{
+	midi_player_event_t* pEvents;
+	midi_player_event_t* pEvent;
+
+	if (pSong->unEvents == pSong->unCapacity){
+		pEvents = realloc(pSong->pEvents, (pSong->unCapacity * 2) * sizeof(midi_player_event_t));
+		if (NULL == pEvents){
+			LOG_E("Grow MIDI song failed: %m");
+			return (-1);
+		}
+		pSong->pEvents = pEvents;
+		pSong->unCapacity *= 2;
+	}
+	pEvent = pSong->pEvents + pSong->unEvents;
+	pEvent->ullTimeUs = ullTick;
+	pEvent->unOrder = pSong->unEvents++;
+	pEvent->unTempoUs = unTempoUs;
+	pEvent->unLen = nLen;
+	if (nLen > 0){
+		memcpy(pEvent->unData, pData, nLen);
+	}
+	return 0;
+}
+
+/* Appends the track's events with their absolute tick. Returns -1 at the
+ * first malformed byte, what came before it is kept. */
+static int32_t nParseTrack(midi_song_t* pSong, const uint8_t* pPos, const uint8_t* pEnd)
+{
+	uint64_t ullTick = 0;
+	uint32_t unDelta, unLen;
+	uint8_t unMessage[3], unRunningStatus = 0, unType;
+	int32_t nNeeded, nIndex;
+
+	while (pPos < pEnd){
+		if ((nReadVlq(&pPos, pEnd, &unDelta) < 0) || (pPos >= pEnd)){
+			return (-1);
+		}
+		ullTick += unDelta;
+		if (*pPos & 0x80){
+			unMessage[0] = *pPos++;
+		}else if (unRunningStatus != 0){
+			unMessage[0] = unRunningStatus;
+		}else{
+			return (-1);
+		}
+
+		if ((0xFF == unMessage[0]) || (0xF0 == unMessage[0]) || (0xF7 == unMessage[0])){
+			// meta and SysEx carry a length, and cancel running status
+			unType = 0;
+			if ((0xFF == unMessage[0]) && (pPos < pEnd)){
+				unType = *pPos++;
+			}
+			if ((nReadVlq(&pPos, pEnd, &unLen) < 0) || (unLen > (uint32_t)(pEnd - pPos))){
+				return (-1);
+			}
+			if ((0x51 == unType) && (3 == unLen) &&
+					(nSongAppend(pSong, ullTick, unBigEndian(pPos, 3), NULL, 0) < 0)){
+				return (-1);
+			}
+			if (0x2F == unType){
+				return 0;	// end of track
+			}
+			pPos += unLen;
+			unRunningStatus = 0;
+			continue;
+		}
+		if (unMessage[0] >= 0xF0){
+			return (-1);	// system common and realtime have no place in a file
+		}
+
+		nNeeded = nMidiWireDataLength(unMessage[0]);
+		if ((pEnd - pPos) < nNeeded){
+			return (-1);
+		}
+		for (nIndex = 0; nIndex < nNeeded; nIndex++){
+			if (pPos[nIndex] & 0x80){
+				return (-1);
+			}
+			unMessage[1 + nIndex] = pPos[nIndex];
+		}
+		pPos += nNeeded;
+		unRunningStatus = unMessage[0];
+		if (nSongAppend(pSong, ullTick, 0, unMessage, nNeeded + 1) < 0){
+			return (-1);
+		}
+	}
+	return 0;	// no end of track meta, tolerated
+}
+
+static int nCompareEvents(const void* pA, const void* pB)
+{
+	const midi_player_event_t* pEventA = (const midi_player_event_t*)pA;
+	const midi_player_event_t* pEventB = (const midi_player_event_t*)pB;
+
+	if (pEventA->ullTimeUs != pEventB->ullTimeUs){
+		return (pEventA->ullTimeUs < pEventB->ullTimeUs) ? (-1) : 1;
+	}
+	return (pEventA->unOrder < pEventB->unOrder) ? (-1) : 1;
+}
+
+/* Ticks to microseconds in place, dropping the tempo entries. Each tempo
+ * change restarts the conversion from its own tick, so nothing drifts. */
+static void applyTempoMap(midi_song_t* pSong, uint16_t unDivision)
+{
+	midi_player_event_t* pEvent;
+	uint64_t ullBaseTick = 0, ullBaseUs = 0, ullTimeUs = 0;
+	uint64_t ullTicksPerSecond100 = 0;
+	uint32_t unTempoUs = MIDI_PLAYER_DEFAULT_TEMPO_US;
+	uint32_t unIn, unOut = 0;
+	int32_t nFps;
+
+	if (unDivision & 0x8000){
+		// SMPTE: frames per second (29 means 29.97) times ticks per frame
+		nFps = 256 - (unDivision >> 8);
+		ullTicksPerSecond100 = ((29 == nFps) ? 2997ULL : (uint64_t)nFps * 100) * (unDivision & 0xFF);
+	}
+	for (unIn = 0; unIn < pSong->unEvents; unIn++){
+		pEvent = pSong->pEvents + unIn;
+		if (ullTicksPerSecond100 != 0){
+			ullTimeUs = pEvent->ullTimeUs * 100000000ULL / ullTicksPerSecond100;
+		}else{
+			ullTimeUs = ullBaseUs + (pEvent->ullTimeUs - ullBaseTick) * unTempoUs / unDivision;
+		}
+		if (0 == pEvent->unLen){
+			ullBaseUs = ullTimeUs;
+			ullBaseTick = pEvent->ullTimeUs;
+			unTempoUs = pEvent->unTempoUs;
+			continue;
+		}
+		pSong->pEvents[unOut] = *pEvent;
+		pSong->pEvents[unOut++].ullTimeUs = ullTimeUs;
+	}
+	pSong->unEvents = unOut;
+	pSong->ullLengthUs = ullTimeUs;
+}
+
+static int32_t nParseSong(midi_song_t* pSong, const uint8_t* pMap, size_t ulLen, const char* pPath)
+{
+	const uint8_t* pPos;
+	const uint8_t* pEnd = pMap + ulLen;
+	uint32_t unHeaderLen, unChunkLen;
+	uint16_t unDivision;
+	int32_t nTracks = 0;
+
+	if ((ulLen < MIDI_PLAYER_HEADER_LENGTH) || (memcmp(pMap, "MThd", 4) != 0) ||
+			((unHeaderLen = unBigEndian(pMap + 4, 4)) < 6) || (unHeaderLen > (ulLen - MIDI_PLAYER_CHUNK_HEADER))){
+		LOG_E("%s is not a standard MIDI file.", pPath);
+		return (-1);
+	}
+	unDivision = unBigEndian(pMap + 12, 2);
+	if (0 == unDivision){
+		LOG_E("%s has no time division.", pPath);
+		return (-1);
+	}
+
+	for (pPos = pMap + MIDI_PLAYER_CHUNK_HEADER + unHeaderLen;
+			(pEnd - pPos) >= MIDI_PLAYER_CHUNK_HEADER; pPos += unChunkLen){
+		unChunkLen = unBigEndian(pPos + 4, 4);
+		pPos += MIDI_PLAYER_CHUNK_HEADER;
+		if (unChunkLen > (uint32_t)(pEnd - pPos)){
+			LOG_W("%s is truncated.", pPath);
+			unChunkLen = pEnd - pPos;
+		}
+		if (memcmp(pPos - MIDI_PLAYER_CHUNK_HEADER, "MTrk", 4) != 0){
+			continue;	// unknown chunks are to be skipped
+		}
+		if (nParseTrack(pSong, pPos, pPos + unChunkLen) < 0){
+			LOG_W("%s track %d is malformed, played up to the error.", pPath, nTracks);
+		}
+		nTracks++;
+	}
+
+	qsort(pSong->pEvents, pSong->unEvents, sizeof(midi_player_event_t), nCompareEvents);
+	applyTempoMap(pSong, unDivision);
+	return 0;
+}
+
+/* Map, parse and merge every track of pPath into one sorted array */
+int32_t nMidiSongLoad(midi_song_t* pSong, const char* pPath)
+{
+	struct stat tStat;
+	void* pMap;
+	int32_t nFd, nRSTL;
+
+	memset(pSong, 0, sizeof(midi_song_t));
+	nFd = open(pPath, O_RDONLY | O_CLOEXEC);
+	if (nFd < 0){
+		LOG_E("Open %s failed: %m", pPath);
+		return (-1);
+	}
+	if ((fstat(nFd, &tStat) < 0) || (0 == tStat.st_size)){
+		LOG_E("%s is empty or unreadable.", pPath);
+		close(nFd);
+		return (-1);
+	}
+	pMap = mmap(NULL, tStat.st_size, PROT_READ, MAP_PRIVATE, nFd, 0);
+	close(nFd);
+	if (MAP_FAILED == pMap){
+		LOG_E("Map %s failed: %m", pPath);
+		return (-1);
+	}
+	madvise(pMap, tStat.st_size, MADV_SEQUENTIAL);
+
+	pSong->unCapacity = MIDI_PLAYER_INITIAL_EVENTS;
+	pSong->pEvents = malloc(pSong->unCapacity * sizeof(midi_player_event_t));
+	if (NULL == pSong->pEvents){
+		LOG_E("Allocate MIDI song failed: %m");
+		munmap(pMap, tStat.st_size);
+		return (-1);
+	}
+	nRSTL = nParseSong(pSong, pMap, tStat.st_size, pPath);
+	munmap(pMap, tStat.st_size);
+	if (nRSTL < 0){
+		midiSongRelease(pSong);
+	}
+	return nRSTL;
+}
+
+void midiSongRelease(midi_song_t* pSong)
+{
+	free(pSong->pEvents);
+	memset(pSong, 0, sizeof(midi_song_t));
+}
+
+/* Sleep until llUntilUs on the queue clock, at most MIDI_PLAYER_MAX_SLEEP_US */
+static void sleepUntil(midi_player_t* pPlayer, int64_t llUntilUs)
+{
+	seq_engine_t* pEngine = pPlayer->pEngine;
+	struct timespec tWake;
+	int64_t llNowUs = llSeqEngineQueueTimeUs(pEngine);
+
+	if (llUntilUs > (llNowUs + MIDI_PLAYER_MAX_SLEEP_US)){
+		llUntilUs = llNowUs + MIDI_PLAYER_MAX_SLEEP_US;
+	}
+	if (llUntilUs <= llNowUs){
+		return;
+	}
+	// the queue clock is CLOCK_MONOTONIC from tQueueStart, zero without a queue
+	tWake.tv_sec = pEngine->tQueueStart.tv_sec + llUntilUs / 1000000;
+	tWake.tv_nsec = pEngine->tQueueStart.tv_nsec + (llUntilUs % 1000000) * 1000;
+	if (tWake.tv_nsec >= 1000000000){
+		tWake.tv_sec += 1;
+		tWake.tv_nsec -= 1000000000;
+	}
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tWake, NULL);
+}
+
+static void waitUntil(midi_player_t* pPlayer, int64_t llUntilUs)
+{
+	while ((0 == pPlayer->nStop) && (llSeqEngineQueueTimeUs(pPlayer->pEngine) < llUntilUs)){
+		sleepUntil(pPlayer, llUntilUs);
+	}
+}
+
+static void allNotesOff(midi_player_t* pPlayer, int64_t llPlayUs)
+{
+	snd_seq_event_t tEvent;
+	int32_t nChannel;
+
+	for (nChannel = 0; nChannel < 16; nChannel++){
+		snd_seq_ev_clear(&tEvent);
+		tEvent.type = SND_SEQ_EVENT_CONTROLLER;
+		tEvent.data.control.channel = nChannel;
+		tEvent.data.control.param = MIDI_CTL_ALL_NOTES_OFF;
+		seqEngineScheduleAt(pPlayer->pEngine, &tEvent, llPlayUs);
+		nSeqEngineQueueFrom(pPlayer->pEngine, &tEvent, pPlayer->nSource, 0);
+	}
+	seqEngineKick(pPlayer->pEngine);
+}
+
+/* Feed pSong to the engine as it comes due. A full merge queue is not a
+ * loss, the event is offered again shortly; it does show in the stats
+ * as shed and in the engine's dropped count. */
+static void playSong(midi_player_t* pPlayer, const midi_song_t* pSong)
+{
+	seq_engine_t* pEngine = pPlayer->pEngine;
+	const midi_player_event_t* pEvent;
+	snd_seq_event_t tEvent;
+	int64_t llStartUs, llHorizonUs, llDueUs = 0;
+	uint32_t unLookaheadUs = (SEQ_ENGINE_NO_QUEUE == pEngine->nQueue) ? 0 : MIDI_PLAYER_LOOKAHEAD_US;
+	uint32_t unNext = 0;
+	int32_t nQueued, nFull;
+
+	llStartUs = llSeqEngineQueueTimeUs(pEngine) + MIDI_PLAYER_LEAD_IN_US;
+	while ((unNext < pSong->unEvents) && (0 == pPlayer->nStop)){
+		llHorizonUs = llSeqEngineQueueTimeUs(pEngine) + unLookaheadUs;
+		nQueued = nFull = 0;
+		for (; unNext < pSong->unEvents; unNext++){
+			pEvent = pSong->pEvents + unNext;
+			llDueUs = llStartUs + pEvent->ullTimeUs;
+			if (llDueUs > llHorizonUs){
+				break;
+			}
+			midiWireChannelEvent(&tEvent, pEvent->unData[0], pEvent->unData + 1);
+			seqEngineScheduleAt(pEngine, &tEvent, llDueUs);
+			if (nSeqEngineQueueFrom(pEngine, &tEvent, pPlayer->nSource, 0) < 0){
+				pPlayer->unRetries++;
+				nFull = 1;
+				break;
+			}
+			nQueued++;
+		}
+		if (nQueued > 0){
+			seqEngineKick(pEngine);
+		}
+		pPlayer->unPlayed += nQueued;
+		sleepUntil(pPlayer, (1 == nFull) ? (llSeqEngineQueueTimeUs(pEngine) + MIDI_PLAYER_RETRY_US) :
+				(llDueUs - unLookaheadUs));
+	}
+	if (0 == pPlayer->nStop){
+		waitUntil(pPlayer, llStartUs + pSong->ullLengthUs);
+	}else{
+		allNotesOff(pPlayer, llSeqEngineQueueTimeUs(pEngine) + unLookaheadUs);
+	}
+}
+
+static void* midiPlayerService(void* pContext)
+{
+	midi_player_t* pPlayer = (midi_player_t*)pContext;
+	midi_song_t tSong;
+	int32_t nFile;
+
+	for (nFile = 0; (nFile < pPlayer->nFiles) && (0 == pPlayer->nStop); nFile++){
+		if (nMidiSongLoad(&tSong, pPlayer->pFiles[nFile]) < 0){
+			continue;
+		}
+		LOG_I("Playing %s, %u events in %.1f s.", pPlayer->pFiles[nFile],
+				tSong.unEvents, tSong.ullLengthUs / 1e6);
+		playSong(pPlayer, &tSong);
+		midiSongRelease(&tSong);
+		waitUntil(pPlayer, llSeqEngineQueueTimeUs(pPlayer->pEngine) + pPlayer->unDelaySec * 1000000LL);
+	}
+	LOG_I("Player done, %u events played, %u retries on a full queue.",
+			pPlayer->unPlayed, pPlayer->unRetries);
+	return NULL;
+}
+
+/* Plays pFiles in order on a thread of its own, the list must outlive it.
+ * nSource is a merge source id no link uses, the engine must have room
+ * for it. */
+int32_t nMidiPlayerStart(midi_player_t* pPlayer, seq_engine_t* pEngine, int32_t nSource,
+		char** pFiles, int32_t nFiles, uint32_t unDelaySec)
+{
+	memset(pPlayer, 0, sizeof(midi_player_t));
+	pPlayer->pEngine = pEngine;
+	pPlayer->nSource = nSource;
+	pPlayer->pFiles = pFiles;
+	pPlayer->nFiles = nFiles;
+	pPlayer->unDelaySec = unDelaySec;
+	if (nSeqEngineOpenSource(pEngine, nSource, MIDI_PLAYER_WEIGHT) < 0){
+		return (-1);
+	}
+	if (pthread_create(&(pPlayer->tThread), NULL, midiPlayerService, pPlayer) != 0){
+		LOG_E("Start MIDI player thread failed.");
+		return (-1);
+	}
+	pPlayer->nRunning = 1;
+	return 0;
+}
+
+/* Stops mid-song if need be, sounding notes are turned off */
+void midiPlayerStop(midi_player_t* pPlayer)
+{
+	if (0 == pPlayer->nRunning){
+		return;
+	}
+	pPlayer->nStop = 1;
+	pthread_join(pPlayer->tThread, NULL);
+	pPlayer->nRunning = 0;
+}
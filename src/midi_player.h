@@ -0,0 +1,68 @@
+/*
+ * midi_player.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#ifndef MIDI_PLAYER_H_
+#define MIDI_PLAYER_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "seq_engine.h"
+
+#define MIDI_PLAYER_LOOKAHEAD_US		100000	// how far ahead events go onto the queue
+#define MIDI_PLAYER_LEAD_IN_US			20000	// first event after start, time to queue it
+#define MIDI_PLAYER_MAX_SLEEP_US		100000	// stop requests are seen this quickly
+#define MIDI_PLAYER_RETRY_US			1000	// merge queue full, try again this soon
+#define MIDI_PLAYER_WEIGHT				4
+#define MIDI_PLAYER_DEFAULT_TEMPO_US	500000
+#define MIDI_PLAYER_INITIAL_EVENTS		4096
+
+/* One channel message of the song, at its time from the song start */
+typedef struct {
+	uint64_t ullTimeUs;		// tick until the tempo map is applied
+	uint32_t unOrder;		// file order, keeps sorting stable
+	uint32_t unTempoUs;		// tempo change when unLen is 0
+	uint8_t unLen;
+	uint8_t unData[3];
+}midi_player_event_t;
+
+typedef struct {
+	midi_player_event_t* pEvents;
+	uint32_t unEvents;
+	uint32_t unCapacity;
+	uint64_t ullLengthUs;
+}midi_song_t;
+
+/* Plays SMF files one after the other, on its own thread and as its
+ * own merge source, so live input is mixed on top. Each file is mapped,
+ * all its tracks parsed into one time-sorted array, and the array is
+ * fed to the engine as it comes due. With the engine's queue enabled
+ * events go out MIDI_PLAYER_LOOKAHEAD_US early, scheduled on the queue
+ * and timed by its timer; without one they are sent direct when due. */
+typedef struct {
+	seq_engine_t* pEngine;
+	int32_t nSource;
+	char** pFiles;
+	int32_t nFiles;
+	uint32_t unDelaySec;		// pause after each song
+	pthread_t tThread;
+	int32_t nRunning;
+	volatile int32_t nStop;
+	uint32_t unPlayed;
+	uint32_t unRetries;
+}midi_player_t;
+
+int32_t nMidiSongLoad(midi_song_t* pSong, const char* pPath);
+
+void midiSongRelease(midi_song_t* pSong);
+
+int32_t nMidiPlayerStart(midi_player_t* pPlayer, seq_engine_t* pEngine, int32_t nSource,
+		char** pFiles, int32_t nFiles, uint32_t unDelaySec);
+
+void midiPlayerStop(midi_player_t* pPlayer);
+
+#endif /* MIDI_PLAYER_H_ */
@@ -0,0 +1,547 @@
+/*
+ * midi_recorder.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ *
+ *  Standard MIDI File recording, format 0: "MThd" with one "MTrk" whose
+ *  length is only known at the end. A crash leaves that length unpatched,
+ *  the journal format exists for recordings that must survive one.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <alsa/asoundlib.h>
+
+#include "log.h"
+#include "stats.h"
+#include "midi_wire.h"
+#include "sysex_pool.h"
+#include "midi_recorder.h"
+
+#define MIDI_RECORDER_TICK_NS			((uint64_t)MIDI_RECORDER_TEMPO_US * 1000 / MIDI_RECORDER_DIVISION)
+#define MIDI_RECORDER_TRACK_LENGTH_AT	18		// offset of the MTrk length
+#define MIDI_RECORDER_JOURNAL_MAGIC		"MDJ2"
+#define MIDI_RECORDER_JOURNAL_PAYLOAD	((SYSEX_POOL_BUFFER_SIZE + sizeof(midi_recorder_journal_t) - 1) / \
+		sizeof(midi_recorder_journal_t))	// records after a SysEx head at most
+#define MIDI_RECORDER_JOURNAL_HEADER	4
+#define MIDI_RECORDER_CONVERT_RECORDS	256
+
+static int32_t nWriteAll(int32_t nFd, const uint8_t* pData, int32_t nLen)
+{
+	ssize_t nWritten;
+
+	while (nLen > 0){
+		nWritten = write(nFd, pData, nLen);
+		if (nWritten < 0){
+			if (EINTR == errno){
+				continue;
+			}
+			return (-1);
+		}
+		pData += nWritten;
+		nLen -= nWritten;
+	}
+	return 0;
+}
+
+/* Returns the bytes written, -1 on error with the buffer dropped */
+static int32_t nTrackFlush(midi_recorder_track_t* pTrack)
+{
+	int32_t nLen = pTrack->nLen;
+
+	pTrack->nLen = 0;
+	return (nWriteAll(pTrack->nFd, pTrack->unBuff, nLen) < 0) ? (-1) : nLen;
+}
+
+static void trackPut(midi_recorder_track_t* pTrack, const uint8_t* pData, int32_t nLen)
+{
+	if ((pTrack->nLen + nLen) > MIDI_RECORDER_BUFFER_SIZE){
+		nTrackFlush(pTrack);
+	}
+	memcpy(pTrack->unBuff + pTrack->nLen, pData, nLen);
+	pTrack->nLen += nLen;
+	pTrack->unTrackBytes += nLen;
+}
+
+static int32_t nTrackOpen(midi_recorder_track_t* pTrack, const char* pPath, uint64_t ullStartNs)
+{
+	static const uint8_t SMF_HEADER[] = {
+		'M', 'T', 'h', 'd', 0, 0, 0, 6,
+		0, 0,		// format 0
+		0, 1,		// one track
+		MIDI_RECORDER_DIVISION >> 8, MIDI_RECORDER_DIVISION & 0xFF,
+		'M', 'T', 'r', 'k', 0, 0, 0, 0
+	};
+	static const uint8_t SMF_TEMPO[] = {
+		0, 0xFF, 0x51, 3,
+		(MIDI_RECORDER_TEMPO_US >> 16) & 0xFF, (MIDI_RECORDER_TEMPO_US >> 8) & 0xFF, MIDI_RECORDER_TEMPO_US & 0xFF
+	};
+
+	pTrack->nFd = open(pPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (pTrack->nFd < 0){
+		LOG_E("Open MIDI file %s failed: %m", pPath);
+		return (-1);
+	}
+	pTrack->nLen = 0;
+	pTrack->ullStartNs = ullStartNs;
+	pTrack->ullLastTick = 0;
+	pTrack->unRunningStatus = 0;
+	trackPut(pTrack, SMF_HEADER, sizeof(SMF_HEADER));
+	pTrack->unTrackBytes = 0;
+	trackPut(pTrack, SMF_TEMPO, sizeof(SMF_TEMPO));
+	return 0;
+}
+
+/* Variable length quantity of at most 4 bytes into pOut, returns its length */
+static int32_t nPutVlq(uint8_t* pOut, uint32_t unValue)
+{
+	uint8_t unVlq[4];
+	int32_t nAt = sizeof(unVlq) - 1, nLen;
+
+	unVlq[nAt] = unValue & 0x7F;
+	while ((unValue >>= 7) > 0){
+		unVlq[--nAt] = 0x80 | (unValue & 0x7F);
+	}
+	nLen = sizeof(unVlq) - nAt;
+	memcpy(pOut, unVlq + nAt, nLen);
+	return nLen;
+}
+
+static void trackDelta(midi_recorder_track_t* pTrack, uint64_t ullStampNs)
+{
+	uint8_t unDelta[4];
+	uint64_t ullTick, ullDelta;
+
+	ullTick = (ullStampNs > pTrack->ullStartNs) ? (ullStampNs - pTrack->ullStartNs) / MIDI_RECORDER_TICK_NS : 0;
+	// scheduled and direct events may interleave slightly out of order
+	ullDelta = (ullTick > pTrack->ullLastTick) ? (ullTick - pTrack->ullLastTick) : 0;
+	pTrack->ullLastTick += ullDelta;
+	if (ullDelta > 0x0FFFFFFF){
+		ullDelta = 0x0FFFFFFF;		// longest variable length quantity, about 3.7 hours
+	}
+	trackPut(pTrack, unDelta, nPutVlq(unDelta, ullDelta));
+}
+
+/* Channel messages only, SMF has no plain form for realtime bytes */
+static void trackEvent(midi_recorder_track_t* pTrack, uint64_t ullStampNs, const uint8_t* pData, int32_t nLen)
+{
+	if ((nLen < 1) || (pData[0] >= 0xF0)){
+		return;
+	}
+	trackDelta(pTrack, ullStampNs);
+	if (pData[0] == pTrack->unRunningStatus){
+		pData++;
+		nLen--;
+	}else{
+		pTrack->unRunningStatus = pData[0];
+	}
+	trackPut(pTrack, pData, nLen);
+}
+
+/* The chunk that starts a message becomes "F0 <length> <bytes>", the
+ * ones after it "F7 <length> <bytes>" continuation events; the F7 that
+ * ends the message is part of the last one's bytes. */
+static void trackSysEx(midi_recorder_track_t* pTrack, uint64_t ullStampNs, const uint8_t* pData, int32_t nLen)
+{
+	uint8_t unHead[1 + 4];
+
+	if (nLen < 1){
+		return;
+	}
+	unHead[0] = (0xF0 == pData[0]) ? 0xF0 : 0xF7;
+	if (0xF0 == pData[0]){
+		pData++;
+		nLen--;
+	}
+	trackDelta(pTrack, ullStampNs);
+	trackPut(pTrack, unHead, 1 + nPutVlq(unHead + 1, nLen));
+	trackPut(pTrack, pData, nLen);
+	pTrack->unRunningStatus = 0;	// SysEx cancels running status
+}
+
+/* End of track, patch its length in and make it durable */
+static int32_t nTrackClose(midi_recorder_track_t* pTrack)
+{
+	static const uint8_t SMF_END_OF_TRACK[] = {0, 0xFF, 0x2F, 0};
+	uint8_t unLength[4];
+	int32_t nRSTL;
+
+	trackPut(pTrack, SMF_END_OF_TRACK, sizeof(SMF_END_OF_TRACK));
+	nRSTL = nTrackFlush(pTrack);
+	unLength[0] = pTrack->unTrackBytes >> 24;
+	unLength[1] = pTrack->unTrackBytes >> 16;
+	unLength[2] = pTrack->unTrackBytes >> 8;
+	unLength[3] = pTrack->unTrackBytes;
+	if ((nRSTL < 0) || (pwrite(pTrack->nFd, unLength, sizeof(unLength), MIDI_RECORDER_TRACK_LENGTH_AT) != sizeof(unLength)) ||
+			(fdatasync(pTrack->nFd) < 0)){
+		LOG_E("Finish MIDI file failed: %m");
+		nRSTL = -1;
+	}
+	close(pTrack->nFd);
+	pTrack->nFd = -1;
+	return (nRSTL < 0) ? (-1) : 0;
+}
+
+/* Journal so far into <path>.<n>.mid, time starts at its first record */
+static void convertJournal(midi_recorder_t* pRecorder)
+{
+	midi_recorder_journal_t tRecord[MIDI_RECORDER_CONVERT_RECORDS];
+	char cSmfPath[MIDI_RECORDER_PATH_LENGTH + 16];
+	uint8_t unSysEx[SYSEX_POOL_BUFFER_SIZE];
+	off_t tOffset = MIDI_RECORDER_JOURNAL_HEADER;
+	uint64_t ullSysExNs = 0;
+	ssize_t nRead;
+	int32_t nIndex, nEvents = 0, nSysExLen = 0, nSysExAt = 0, nCopy;
+
+	snprintf(cSmfPath, sizeof(cSmfPath), "%s.%d.mid", pRecorder->cPath, ++pRecorder->nRotations);
+	if (nTrackOpen(pRecorder->pTrack, cSmfPath, pRecorder->ullJournalStartNs) < 0){
+		return;
+	}
+	while ((nRead = pread(pRecorder->nJournalFd, tRecord, sizeof(tRecord), tOffset)) > 0){
+		for (nIndex = 0; nIndex < (nRead / (ssize_t)sizeof(midi_recorder_journal_t)); nIndex++){
+			if (nSysExAt < nSysExLen){
+				// bytes of the SysEx chunk headed by an earlier record, maybe in an earlier read
+				nCopy = nSysExLen - nSysExAt;
+				if (nCopy > (int32_t)sizeof(midi_recorder_journal_t)){
+					nCopy = sizeof(midi_recorder_journal_t);
+				}
+				memcpy(unSysEx + nSysExAt, tRecord + nIndex, nCopy);
+				nSysExAt += nCopy;
+				if (nSysExAt == nSysExLen){
+					trackSysEx(pRecorder->pTrack, ullSysExNs, unSysEx, nSysExLen);
+					nEvents++;
+				}
+			}else if (MIDI_RECORDER_JOURNAL_SYSEX == tRecord[nIndex].unLen){
+				nSysExLen = tRecord[nIndex].unData[0] | (tRecord[nIndex].unData[1] << 8);
+				if (nSysExLen > SYSEX_POOL_BUFFER_SIZE){
+					nSysExLen = 0;		// not written by us, nothing to trust after it either
+					break;
+				}
+				nSysExAt = 0;
+				ullSysExNs = tRecord[nIndex].ullStampNs;
+			}else{
+				trackEvent(pRecorder->pTrack, tRecord[nIndex].ullStampNs, tRecord[nIndex].unData, tRecord[nIndex].unLen);
+				nEvents++;
+			}
+		}
+		if (nIndex < (nRead / (ssize_t)sizeof(midi_recorder_journal_t))){
+			LOG_W("Journal damaged, converted up to offset %ld.", (long)(tOffset + nIndex * sizeof(midi_recorder_journal_t)));
+			break;
+		}
+		tOffset += nRead;
+	}
+	if ((nTrackClose(pRecorder->pTrack) == 0) && (0 == nRead)){
+		LOG_I("Journal of %d events converted to %s.", nEvents, cSmfPath);
+	}
+}
+
+static int32_t nJournalReset(midi_recorder_t* pRecorder)
+{
+	pRecorder->ullJournalBytes = MIDI_RECORDER_JOURNAL_HEADER;
+	pRecorder->ullJournalStartNs = 0;
+	if ((ftruncate(pRecorder->nJournalFd, MIDI_RECORDER_JOURNAL_HEADER) < 0) ||
+			(lseek(pRecorder->nJournalFd, MIDI_RECORDER_JOURNAL_HEADER, SEEK_SET) < 0)){
+		LOG_E("Reset MIDI journal failed: %m");
+		return (-1);
+	}
+	return 0;
+}
+
+static void writePending(midi_recorder_t* pRecorder, uint64_t ullNow)
+{
+	int32_t nWritten, nPending = pRecorder->nJournalLen;
+
+	if (MIDI_RECORDER_SMF == pRecorder->tFormat){
+		nWritten = nTrackFlush(pRecorder->pTrack);
+	}else{
+		pRecorder->nJournalLen = 0;
+		nWritten = (nWriteAll(pRecorder->nJournalFd, pRecorder->unJournal, nPending) < 0) ? (-1) : nPending;
+	}
+	if (nWritten < 0){
+		pRecorder->unWriteErrors++;
+		LOG_E("Write recording failed: %m");
+	}else{
+		pRecorder->ullUnsyncedBytes += nWritten;
+	}
+	pRecorder->ullLastWriteNs = ullNow;
+}
+
+/* Hand buffered bytes to the kernel when enough piled up or they waited
+ * long enough, and sync on the same terms with larger limits. nForce
+ * does both now, for rotation and close. */
+static void writeDue(midi_recorder_t* pRecorder, uint64_t ullNow, int32_t nForce)
+{
+	int32_t nPending = (MIDI_RECORDER_SMF == pRecorder->tFormat) ?
+			pRecorder->pTrack->nLen : pRecorder->nJournalLen;
+
+	if ((nPending > 0) && (nForce || (nPending >= MIDI_RECORDER_WRITE_BYTES) ||
+			((ullNow - pRecorder->ullLastWriteNs) >= MIDI_RECORDER_WRITE_INTERVAL_NS))){
+		writePending(pRecorder, ullNow);
+	}
+	if ((pRecorder->ullUnsyncedBytes > 0) && (nForce || (pRecorder->ullUnsyncedBytes >= MIDI_RECORDER_SYNC_BYTES) ||
+			((ullNow - pRecorder->ullLastSyncNs) >= MIDI_RECORDER_SYNC_INTERVAL_NS))){
+		if (fdatasync((MIDI_RECORDER_SMF == pRecorder->tFormat) ?
+				pRecorder->pTrack->nFd : pRecorder->nJournalFd) < 0){
+			pRecorder->unWriteErrors++;
+			LOG_E("Sync recording failed: %m");
+		}
+		pRecorder->ullUnsyncedBytes = 0;
+		pRecorder->ullLastSyncNs = ullNow;
+	}
+}
+
+/* One record for a short event, a head and the padded bytes for a
+ * SysEx chunk */
+static void journalEvent(midi_recorder_t* pRecorder, uint64_t ullStampNs, const uint8_t* pData, int32_t nLen,
+		int32_t nSysEx)
+{
+	midi_recorder_journal_t tRecord[1 + MIDI_RECORDER_JOURNAL_PAYLOAD];
+	int32_t nBytes = sizeof(midi_recorder_journal_t);
+
+	memset(tRecord, 0, sizeof(midi_recorder_journal_t));
+	tRecord[0].ullStampNs = ullStampNs;
+	if (1 == nSysEx){
+		tRecord[0].unLen = MIDI_RECORDER_JOURNAL_SYSEX;
+		tRecord[0].unData[0] = nLen & 0xFF;
+		tRecord[0].unData[1] = nLen >> 8;
+		memset(tRecord + 1, 0, MIDI_RECORDER_JOURNAL_PAYLOAD * sizeof(midi_recorder_journal_t));
+		memcpy(tRecord + 1, pData, nLen);
+		nBytes += (nLen + sizeof(midi_recorder_journal_t) - 1) / sizeof(midi_recorder_journal_t) *
+				sizeof(midi_recorder_journal_t);
+	}else{
+		tRecord[0].unLen = nLen;
+		memcpy(tRecord[0].unData, pData, nLen);
+	}
+	if ((pRecorder->nJournalLen + nBytes) > MIDI_RECORDER_BUFFER_SIZE){
+		writePending(pRecorder, ullStatsNowNs());
+	}
+	memcpy(pRecorder->unJournal + pRecorder->nJournalLen, tRecord, nBytes);
+	pRecorder->nJournalLen += nBytes;
+	pRecorder->ullJournalBytes += nBytes;
+	if (0 == pRecorder->ullJournalStartNs){
+		pRecorder->ullJournalStartNs = ullStampNs;
+	}
+	if (pRecorder->ullJournalBytes >= MIDI_RECORDER_ROTATE_BYTES){
+		writeDue(pRecorder, ullStatsNowNs(), 1);
+		convertJournal(pRecorder);
+		nJournalReset(pRecorder);
+	}
+}
+
+/* Writer thread, the bytes of a SysEx entry out of unSysEx, which then
+ * has room for new ones */
+static int32_t nSysExTake(midi_recorder_t* pRecorder, const midi_recorder_entry_t* pEntry, uint8_t* pData)
+{
+	uint32_t unAt = pEntry->unSysExAt & (MIDI_RECORDER_SYSEX_BYTES - 1);
+	uint32_t unLen = pEntry->tEvent.data.ext.len, unFirst = MIDI_RECORDER_SYSEX_BYTES - unAt;
+
+	if (unFirst > unLen){
+		unFirst = unLen;
+	}
+	memcpy(pData, pRecorder->unSysEx + unAt, unFirst);
+	memcpy(pData + unFirst, pRecorder->unSysEx, unLen - unFirst);
+	__atomic_store_n(&(pRecorder->unSysExTail), pEntry->unSysExAt + unLen, __ATOMIC_RELEASE);
+	return unLen;
+}
+
+/* Returns how many events were taken from the ring */
+static int32_t nDrainRing(midi_recorder_t* pRecorder)
+{
+	midi_recorder_entry_t* pEntry;
+	uint8_t unData[SYSEX_POOL_BUFFER_SIZE];
+	uint32_t unTail = pRecorder->unTail, unHead;
+	int32_t nLen, nSysEx, nEvents = 0;
+
+	unHead = __atomic_load_n(&(pRecorder->unHead), __ATOMIC_ACQUIRE);
+	for (; unTail != unHead; unTail++, nEvents++){
+		pEntry = pRecorder->tEntry + (unTail & (MIDI_RECORDER_RING_SLOTS - 1));
+		nSysEx = (SND_SEQ_EVENT_SYSEX == pEntry->tEvent.type) ? 1 : 0;
+		nLen = (1 == nSysEx) ? nSysExTake(pRecorder, pEntry, unData) : nMidiWireEncode(&(pEntry->tEvent), unData);
+		if (0 == nLen){
+			continue;
+		}
+		if (MIDI_RECORDER_SMF == pRecorder->tFormat){
+			if (1 == nSysEx){
+				trackSysEx(pRecorder->pTrack, pEntry->ullStampNs, unData, nLen);
+			}else{
+				trackEvent(pRecorder->pTrack, pEntry->ullStampNs, unData, nLen);
+			}
+		}else{
+			journalEvent(pRecorder, pEntry->ullStampNs, unData, nLen, nSysEx);
+		}
+		pRecorder->unRecorded++;
+		pRecorder->unSysExChunks += nSysEx;
+	}
+	__atomic_store_n(&(pRecorder->unTail), unTail, __ATOMIC_RELEASE);
+	return nEvents;
+}
+
+static void* midiRecorderService(void* pContext)
+{
+	midi_recorder_t* pRecorder = (midi_recorder_t*)pContext;
+
+	while (0 == pRecorder->nStop){
+		if (0 == nDrainRing(pRecorder)){
+			usleep(MIDI_RECORDER_POLL_US);
+		}
+		writeDue(pRecorder, ullStatsNowNs(), 0);
+	}
+	nDrainRing(pRecorder);
+	return NULL;
+}
+
+static int32_t nJournalOpen(midi_recorder_t* pRecorder)
+{
+	pRecorder->nJournalFd = open(pRecorder->cPath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (pRecorder->nJournalFd < 0){
+		LOG_E("Open MIDI journal %s failed: %m", pRecorder->cPath);
+		return (-1);
+	}
+	if (nWriteAll(pRecorder->nJournalFd, (const uint8_t*)MIDI_RECORDER_JOURNAL_MAGIC,
+			MIDI_RECORDER_JOURNAL_HEADER) < 0){
+		LOG_E("Write MIDI journal header failed: %m");
+		close(pRecorder->nJournalFd);
+		return (-1);
+	}
+	pRecorder->ullJournalBytes = MIDI_RECORDER_JOURNAL_HEADER;
+	return 0;
+}
+
+/* Call before the engine thread starts, recording begins right away */
+int32_t nMidiRecorderOpen(midi_recorder_t* pRecorder, const char* pPath, midi_recorder_format_t tFormat)
+{
+	uint64_t ullNow = ullStatsNowNs();
+
+	memset(pRecorder, 0, sizeof(midi_recorder_t));
+	pRecorder->tFormat = tFormat;
+	pRecorder->nJournalFd = -1;
+	snprintf(pRecorder->cPath, sizeof(pRecorder->cPath), "%s", pPath);
+	pRecorder->pTrack = calloc(1, sizeof(midi_recorder_track_t));
+	if (NULL == pRecorder->pTrack){
+		LOG_E("Allocate MIDI recorder failed: %m");
+		return (-1);
+	}
+	pRecorder->pTrack->nFd = -1;
+	if (((MIDI_RECORDER_SMF == tFormat) && (nTrackOpen(pRecorder->pTrack, pPath, ullNow) < 0)) ||
+			((MIDI_RECORDER_JOURNAL == tFormat) && (nJournalOpen(pRecorder) < 0))){
+		free(pRecorder->pTrack);
+		pRecorder->pTrack = NULL;
+		return (-1);
+	}
+	pRecorder->ullLastWriteNs = pRecorder->ullLastSyncNs = ullNow;
+	if (pthread_create(&(pRecorder->tWriterThread), NULL, midiRecorderService, pRecorder) != 0){
+		LOG_E("Start MIDI recorder thread failed.");
+		close((MIDI_RECORDER_SMF == tFormat) ? pRecorder->pTrack->nFd : pRecorder->nJournalFd);
+		free(pRecorder->pTrack);
+		pRecorder->pTrack = NULL;
+		return (-1);
+	}
+	LOG_I("Recording to %s as %s.", pPath, (MIDI_RECORDER_SMF == tFormat) ? "SMF" : "journal");
+	return 0;
+}
+
+/* Engine thread, one event into the ring. The bytes of a SysEx chunk
+ * are copied too, its pool buffer goes back after the batch. Returns -1
+ * when there is no room. */
+static int32_t nRingPut(midi_recorder_t* pRecorder, const snd_seq_event_t* pEvent, uint64_t ullStampNs)
+{
+	midi_recorder_entry_t* pEntry;
+	uint32_t unHead = pRecorder->unHead, unAt, unLen, unFirst;
+
+	if ((unHead - __atomic_load_n(&(pRecorder->unTail), __ATOMIC_ACQUIRE)) >= MIDI_RECORDER_RING_SLOTS){
+		return (-1);
+	}
+	pEntry = pRecorder->tEntry + (unHead & (MIDI_RECORDER_RING_SLOTS - 1));
+	if (SND_SEQ_EVENT_SYSEX == pEvent->type){
+		unLen = pEvent->data.ext.len;
+		if ((unLen < 1) || (unLen > SYSEX_POOL_BUFFER_SIZE) || ((pRecorder->unSysExHead + unLen -
+				__atomic_load_n(&(pRecorder->unSysExTail), __ATOMIC_ACQUIRE)) > MIDI_RECORDER_SYSEX_BYTES)){
+			return (-1);
+		}
+		unAt = pRecorder->unSysExHead & (MIDI_RECORDER_SYSEX_BYTES - 1);
+		unFirst = (unLen < (MIDI_RECORDER_SYSEX_BYTES - unAt)) ? unLen : (MIDI_RECORDER_SYSEX_BYTES - unAt);
+		memcpy(pRecorder->unSysEx + unAt, pEvent->data.ext.ptr, unFirst);
+		memcpy(pRecorder->unSysEx, (const uint8_t*)pEvent->data.ext.ptr + unFirst, unLen - unFirst);
+		pEntry->unSysExAt = pRecorder->unSysExHead;
+		pRecorder->unSysExHead += unLen;
+	}
+	pEntry->tEvent = *pEvent;
+	pEntry->ullStampNs = ullStampNs;
+	__atomic_store_n(&(pRecorder->unHead), unHead + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* Engine thread, before the batch's SysEx buffers go back. Events keep
+ * their scheduled time when they carry one, the others are stamped
+ * ullNowNs. Never blocks, a full ring drops. */
+void midiRecorderBatch(midi_recorder_t* pRecorder, const snd_seq_event_t* pEvents, int32_t nCount,
+		uint64_t ullNowNs, uint64_t ullQueueStartNs)
+{
+	static const uint8_t SYSEX_END = 0xF7;
+	const snd_seq_event_t* pEvent;
+	snd_seq_event_t tEnd;
+	uint64_t ullStampNs;
+	int32_t nIndex, nSysEx, nStart;
+
+	for (nIndex = 0; nIndex < nCount; nIndex++){
+		pEvent = pEvents + nIndex;
+		ullStampNs = ullNowNs;
+		if ((pEvent->flags & SND_SEQ_TIME_STAMP_REAL) && (pEvent->queue != SND_SEQ_QUEUE_DIRECT)){
+			ullStampNs = ullQueueStartNs + pEvent->time.time.tv_sec * 1000000000ULL + pEvent->time.time.tv_nsec;
+		}
+		nSysEx = (SND_SEQ_EVENT_SYSEX == pEvent->type) ? 1 : 0;
+		nStart = (1 == nSysEx) && (0xF0 == *(const uint8_t*)pEvent->data.ext.ptr);
+		if (1 == nStart){
+			pRecorder->nSysExBroken = 0;
+		}
+		if (1 == pRecorder->nSysExUnclosed){
+			snd_seq_ev_clear(&tEnd);
+			snd_seq_ev_set_sysex(&tEnd, 1, (void*)&SYSEX_END);
+			if (0 == nRingPut(pRecorder, &tEnd, ullStampNs)){
+				pRecorder->nSysExUnclosed = 0;
+			}
+		}
+		if ((1 == nSysEx) && ((1 == pRecorder->nSysExBroken) || (1 == pRecorder->nSysExUnclosed))){
+			__atomic_add_fetch(&(pRecorder->unDropped), 1, __ATOMIC_RELAXED);
+			pRecorder->nSysExBroken = 1;
+			continue;
+		}
+		if (nRingPut(pRecorder, pEvent, ullStampNs) < 0){
+			__atomic_add_fetch(&(pRecorder->unDropped), 1, __ATOMIC_RELAXED);
+			if (1 == nSysEx){
+				pRecorder->nSysExBroken = 1;
+				pRecorder->nSysExUnclosed = !nStart;	// the chunks before are recorded
+			}
+		}
+	}
+}
+
+/* After the engine thread stopped: everything recorded goes to disk */
+void midiRecorderClose(midi_recorder_t* pRecorder)
+{
+	if (NULL == pRecorder->pTrack){
+		return;
+	}
+	pRecorder->nStop = 1;
+	pthread_join(pRecorder->tWriterThread, NULL);
+	if (MIDI_RECORDER_SMF == pRecorder->tFormat){
+		nTrackClose(pRecorder->pTrack);
+	}else{
+		writeDue(pRecorder, ullStatsNowNs(), 1);
+		if (pRecorder->ullJournalBytes > MIDI_RECORDER_JOURNAL_HEADER){
+			convertJournal(pRecorder);
+			nJournalReset(pRecorder);
+		}
+		close(pRecorder->nJournalFd);
+	}
+	LOG_I("Recorded %u events, %u of them SysEx chunks, to %s, %u dropped, %u write errors.",
+			pRecorder->unRecorded, pRecorder->unSysExChunks, pRecorder->cPath, pRecorder->unDropped,
+			pRecorder->unWriteErrors);
+	free(pRecorder->pTrack);
+	pRecorder->pTrack = NULL;
+}
@@ -0,0 +1,106 @@
+/*
+ * midi_recorder.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#ifndef MIDI_RECORDER_H_
+#define MIDI_RECORDER_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define MIDI_RECORDER_RING_SLOTS		4096	// power of two, about 2 s of a full flood
+#define MIDI_RECORDER_SYSEX_BYTES		65536	// power of two, SysEx bytes waiting for the writer
+#define MIDI_RECORDER_CACHE_LINE		64
+#define MIDI_RECORDER_BUFFER_SIZE		65536
+#define MIDI_RECORDER_WRITE_BYTES		32768	// write() once this much is buffered...
+#define MIDI_RECORDER_WRITE_INTERVAL_NS	1000000000ULL	// ...or this long after the last one
+#define MIDI_RECORDER_SYNC_BYTES		(1 << 20)	// fdatasync() once this much is written...
+#define MIDI_RECORDER_SYNC_INTERVAL_NS	5000000000ULL	// ...or this long after the last one
+#define MIDI_RECORDER_POLL_US			10000
+#define MIDI_RECORDER_ROTATE_BYTES		(16 << 20)	// journal size that starts a new SMF
+#define MIDI_RECORDER_TEMPO_US			500000	// 120 bpm, the SMF default
+#define MIDI_RECORDER_DIVISION			10000	// ticks per quarter, 50 us per tick
+#define MIDI_RECORDER_PATH_LENGTH		256
+#define MIDI_RECORDER_JOURNAL_SYSEX		0xFF	// unLen of a record that heads SysEx bytes
+
+typedef enum {
+	MIDI_RECORDER_SMF = 0,		// one type 0 SMF, track length patched at close
+	MIDI_RECORDER_JOURNAL		// fixed records, made into <path>.<n>.mid on rotation
+}midi_recorder_format_t;
+
+typedef struct {
+	uint64_t ullStampNs;
+	snd_seq_event_t tEvent;
+	uint32_t unSysExAt;			// where a SysEx chunk's bytes start in unSysEx
+}midi_recorder_entry_t;
+
+/* On disk after the "MDJ2" magic, host byte order. A SysEx chunk is a
+ * MIDI_RECORDER_JOURNAL_SYSEX record with its length in unData[0..1],
+ * low byte first, followed by its bytes padded to whole records. */
+typedef struct {
+	uint64_t ullStampNs;
+	uint8_t unLen;
+	uint8_t unData[3];
+	uint8_t unPad[4];
+}midi_recorder_journal_t;
+
+/* A type 0 track being written to nFd, delta times from ullStartNs */
+typedef struct {
+	int32_t nFd;
+	uint32_t unTrackBytes;
+	uint64_t ullStartNs;
+	uint64_t ullLastTick;
+	uint8_t unRunningStatus;
+	int32_t nLen;
+	uint8_t unBuff[MIDI_RECORDER_BUFFER_SIZE];
+}midi_recorder_track_t;
+
+/* Captures what the engine sends. The engine thread only copies each
+ * event into a single-producer ring, and the bytes of a SysEx chunk into
+ * unSysEx before its pool buffer goes back; the writer thread turns them
+ * into file bytes, writes in large blocks and syncs in larger ones, so a
+ * slow disk never holds up output. When the ring is full events are
+ * counted and not recorded, a SysEx message cut that way is closed with
+ * an F7 instead of spliced to its later chunks. */
+typedef struct {
+	midi_recorder_format_t tFormat;
+	char cPath[MIDI_RECORDER_PATH_LENGTH];
+	midi_recorder_track_t* pTrack;		// SMF, or the conversion of a journal
+	int32_t nJournalFd;
+	int32_t nJournalLen;
+	uint8_t unJournal[MIDI_RECORDER_BUFFER_SIZE];
+	uint64_t ullJournalBytes;
+	uint64_t ullJournalStartNs;
+	int32_t nRotations;
+	uint64_t ullUnsyncedBytes;
+	uint64_t ullLastWriteNs;
+	uint64_t ullLastSyncNs;
+	uint32_t unRecorded;
+	uint32_t unSysExChunks;
+	uint32_t unWriteErrors;
+	pthread_t tWriterThread;
+	volatile int32_t nStop;
+	midi_recorder_entry_t tEntry[MIDI_RECORDER_RING_SLOTS];
+	char cPad0[MIDI_RECORDER_CACHE_LINE];
+	uint32_t unHead;			// engine thread
+	uint32_t unSysExHead;
+	int32_t nSysExBroken;		// a chunk was dropped, so is the rest of its message
+	int32_t nSysExUnclosed;		// the recorded start of a cut message still needs its F7
+	char cPad1[MIDI_RECORDER_CACHE_LINE];
+	uint32_t unTail;			// writer thread
+	uint32_t unSysExTail;
+	uint32_t unDropped;
+	uint8_t unSysEx[MIDI_RECORDER_SYSEX_BYTES];
+}midi_recorder_t;
+
+int32_t nMidiRecorderOpen(midi_recorder_t* pRecorder, const char* pPath, midi_recorder_format_t tFormat);
+
+void midiRecorderBatch(midi_recorder_t* pRecorder, const snd_seq_event_t* pEvents, int32_t nCount,
+		uint64_t ullNowNs, uint64_t ullQueueStartNs);
+
+void midiRecorderClose(midi_recorder_t* pRecorder);
+
+#endif /* MIDI_RECORDER_H_ */
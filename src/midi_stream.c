@@ -0,0 +1,181 @@
+/*
+ * midi_stream.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <alsa/asoundlib.h>
+
+#include "midi_wire.h"
+#include "midi_stream.h"
+
+/* Data bytes after a 0xF1..0xF7 system common status byte, indexed by
+ * the low nibble; 0xF4 and 0xF5 are undefined and carry nothing */
+static const uint8_t MIDI_STREAM_COMMON_LENGTH[8] = {
+	0, 1, 2, 1, 0, 0, 0, 0
+};
+
+void midiStreamParserInit(midi_stream_parser_t* pParser)
+{
+	memset(pParser, 0, sizeof(midi_stream_parser_t));
+}
+
+/* pData holds the data bytes of a complete system common message.
+ * Returns -1 for the undefined ones. */
+static int32_t nCommonEvent(snd_seq_event_t* pEvent, uint8_t unStatus, const uint8_t* pData)
+{
+	snd_seq_ev_clear(pEvent);
+	switch (unStatus){
+	case 0xF1:
+		pEvent->type = SND_SEQ_EVENT_QFRAME;
+		pEvent->data.control.value = pData[0];
+		return 0;
+	case 0xF2:
+		pEvent->type = SND_SEQ_EVENT_SONGPOS;
+		pEvent->data.control.value = (pData[1] << 7) | pData[0];
+		return 0;
+	case 0xF3:
+		pEvent->type = SND_SEQ_EVENT_SONGSEL;
+		pEvent->data.control.value = pData[0];
+		return 0;
+	case 0xF6:
+		pEvent->type = SND_SEQ_EVENT_TUNE_REQUEST;
+		return 0;
+	default:
+		return (-1);
+	}
+}
+
+/* The SysEx collected so far becomes the chunk to hand out */
+static void readySysEx(midi_stream_parser_t* pParser, int32_t nLast)
+{
+	pParser->nSysExReady = 1;
+	pParser->nSysExLast = nLast;
+	if (1 == nLast){
+		pParser->nInSysEx = 0;
+		pParser->unSysExMessages++;
+	}
+}
+
+/* Decode as many bytes as fit into pEvents. Returns the number of events
+ * produced, *pUsed tells how many input bytes were consumed. Decoding
+ * also stops right after a SysEx chunk is complete; the caller takes it
+ * with pMidiStreamSysEx() and feeds the rest again. */
+int32_t nMidiStreamDecode(midi_stream_parser_t* pParser, const uint8_t* pData, int32_t nLen,
+		snd_seq_event_t* pEvents, int32_t nMaxEvents, int32_t* pUsed)
+{
+	int32_t nIndex, nEvents = 0;
+	uint8_t unByte;
+
+	if (1 == pParser->nSysExReady){
+		pParser->nSysExReady = 0;	// not taken, the buffer is needed again
+		pParser->nSysExLen = 0;
+	}
+	for (nIndex = 0; (nIndex < nLen) && (nEvents < nMaxEvents); nIndex++){
+		unByte = pData[nIndex];
+
+		if (unByte >= 0xF8){
+			/* realtime may appear anywhere, even inside SysEx, and leaves everything alone */
+			if (0 == nMidiWireRealtimeEvent(pEvents + nEvents, unByte)){
+				nEvents++;
+			}
+			continue;
+		}
+
+		if (1 == pParser->nInSysEx){
+			if (0 == (unByte & 0x80)){
+				pParser->unSysEx[pParser->nSysExLen++] = unByte;
+				if (MIDI_STREAM_SYSEX_CHUNK == pParser->nSysExLen){
+					readySysEx(pParser, 0);
+					nIndex++;
+					break;
+				}
+				continue;
+			}
+			if (0xF7 == unByte){
+				pParser->unSysEx[pParser->nSysExLen++] = unByte;
+				readySysEx(pParser, 1);
+				nIndex++;
+				break;
+			}
+			/* any other status byte ends SysEx as well, it is parsed on the next call */
+			readySysEx(pParser, 1);
+			break;
+		}
+
+		if (unByte & 0x80){
+			if (pParser->unStatus != 0){
+				pParser->unMalformed++;	// previous message cut short
+			}
+			pParser->unStatus = 0;
+			pParser->unHave = 0;
+			if (unByte < 0xF0){
+				pParser->unStatus = pParser->unRunningStatus = unByte;
+				pParser->unNeeded = nMidiWireDataLength(unByte);
+				continue;
+			}
+			/* system common and exclusive cancel running status */
+			pParser->unRunningStatus = 0;
+			if (0xF0 == unByte){
+				pParser->nInSysEx = 1;
+				pParser->nSysExLen = 0;
+				pParser->unSysEx[pParser->nSysExLen++] = unByte;
+			}else if (0xF7 == unByte){
+				pParser->unMalformed++;	// end of exclusive without a start
+			}else if (MIDI_STREAM_COMMON_LENGTH[unByte & 0x07] > 0){
+				pParser->unStatus = unByte;
+				pParser->unNeeded = MIDI_STREAM_COMMON_LENGTH[unByte & 0x07];
+			}else if (0 == nCommonEvent(pEvents + nEvents, unByte, pParser->unData)){
+				nEvents++;
+			}
+			continue;
+		}
+
+		if (0 == pParser->unStatus){
+			if (0 == pParser->unRunningStatus){
+				pParser->unMalformed++;	// data byte without any status
+				continue;
+			}
+			/* running status, a new message starts with this data byte */
+			pParser->unStatus = pParser->unRunningStatus;
+			pParser->unNeeded = nMidiWireDataLength(pParser->unStatus);
+			pParser->unHave = 0;
+		}
+		pParser->unData[pParser->unHave++] = unByte;
+		if (pParser->unHave == pParser->unNeeded){
+			if (pParser->unStatus < 0xF0){
+				midiWireChannelEvent(pEvents + nEvents++, pParser->unStatus, pParser->unData);
+			}else if (0 == nCommonEvent(pEvents + nEvents, pParser->unStatus, pParser->unData)){
+				nEvents++;
+			}
+			pParser->unStatus = 0;
+			pParser->unHave = 0;
+		}
+	}
+	*pUsed = nIndex;
+	return nEvents;
+}
+
+/* Take the chunk the last decode stopped at, NULL when there is none.
+ * The bytes stay valid until the next nMidiStreamDecode(). *pLast is 1
+ * for the chunk that ends the message. */
+const uint8_t* pMidiStreamSysEx(midi_stream_parser_t* pParser, int32_t* pLen, int32_t* pLast)
+{
+	if (0 == pParser->nSysExReady){
+		return NULL;
+	}
+	*pLen = pParser->nSysExLen;
+	*pLast = pParser->nSysExLast;
+	pParser->nSysExReady = 0;
+	pParser->nSysExLen = 0;
+	return pParser->unSysEx;
+}
+
+/* 1 while a message, SysEx included, waits for more bytes */
+int32_t nMidiStreamMidMessage(const midi_stream_parser_t* pParser)
+{
+	return ((pParser->unStatus != 0) || (1 == pParser->nInSysEx)) ? 1 : 0;
+}
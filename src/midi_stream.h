@@ -0,0 +1,49 @@
+/*
+ * midi_stream.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ *
+ *  Byte level MIDI 1.0 parser for links that carry plain MIDI with no
+ *  framing at all, a DIN port behind the UART. A message may be split
+ *  across reads anywhere, all state lives in the parser. Running status
+ *  applies to channel messages, realtime bytes may sit inside any message
+ *  and leave it intact, system common messages are decoded and cancel
+ *  running status. SysEx is collected in the parser's own buffer and
+ *  handed out in chunks of at most MIDI_STREAM_SYSEX_CHUNK bytes, the
+ *  first starting with 0xF0 and the last ending with 0xF7, the way the
+ *  ALSA sequencer carries long SysEx.
+ */
+
+#ifndef MIDI_STREAM_H_
+#define MIDI_STREAM_H_
+
+#include <stdint.h>
+
+#define MIDI_STREAM_SYSEX_CHUNK			256
+
+typedef struct {
+	uint8_t unStatus;			// message being collected, 0 when none
+	uint8_t unRunningStatus;	// channel status a data byte may start again, 0 when none
+	uint8_t unNeeded;
+	uint8_t unHave;
+	uint8_t unData[2];
+	int32_t nInSysEx;
+	int32_t nSysExLen;
+	int32_t nSysExReady;		// unSysEx holds a chunk for pMidiStreamSysEx()
+	int32_t nSysExLast;
+	uint8_t unSysEx[MIDI_STREAM_SYSEX_CHUNK];
+	uint32_t unSysExMessages;
+	uint32_t unMalformed;
+}midi_stream_parser_t;
+
+void midiStreamParserInit(midi_stream_parser_t* pParser);
+
+int32_t nMidiStreamDecode(midi_stream_parser_t* pParser, const uint8_t* pData, int32_t nLen,
+		snd_seq_event_t* pEvents, int32_t nMaxEvents, int32_t* pUsed);
+
+const uint8_t* pMidiStreamSysEx(midi_stream_parser_t* pParser, int32_t* pLen, int32_t* pLast);
+
+int32_t nMidiStreamMidMessage(const midi_stream_parser_t* pParser);
+
+#endif /* MIDI_STREAM_H_ */
@@ -0,0 +1,212 @@
+/*
+ * midi_wire.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <alsa/asoundlib.h>
+
+#include "midi_wire.h"
+
+/* Indexed by the high nibble of a channel status byte */
+static const uint8_t MIDI_WIRE_DATA_LENGTH[16] = {
+	0, 0, 0, 0, 0, 0, 0, 0,
+	2, 2, 2, 2, 1, 1, 2, 0
+};
+
+static const uint8_t MIDI_WIRE_EVENT_TYPE[16] = {
+	SND_SEQ_EVENT_NONE, SND_SEQ_EVENT_NONE, SND_SEQ_EVENT_NONE, SND_SEQ_EVENT_NONE,
+	SND_SEQ_EVENT_NONE, SND_SEQ_EVENT_NONE, SND_SEQ_EVENT_NONE, SND_SEQ_EVENT_NONE,
+	SND_SEQ_EVENT_NOTEOFF, SND_SEQ_EVENT_NOTEON, SND_SEQ_EVENT_KEYPRESS, SND_SEQ_EVENT_CONTROLLER,
+	SND_SEQ_EVENT_PGMCHANGE, SND_SEQ_EVENT_CHANPRESS, SND_SEQ_EVENT_PITCHBEND, SND_SEQ_EVENT_NONE
+};
+
+/* Indexed by the low nibble of a 0xF8..0xFF realtime byte */
+static const uint8_t MIDI_WIRE_REALTIME_TYPE[16] = {
+	SND_SEQ_EVENT_NONE, SND_SEQ_EVENT_NONE, SND_SEQ_EVENT_NONE, SND_SEQ_EVENT_NONE,
+	SND_SEQ_EVENT_NONE, SND_SEQ_EVENT_NONE, SND_SEQ_EVENT_NONE, SND_SEQ_EVENT_NONE,
+	SND_SEQ_EVENT_CLOCK, SND_SEQ_EVENT_NONE, SND_SEQ_EVENT_START, SND_SEQ_EVENT_CONTINUE,
+	SND_SEQ_EVENT_STOP, SND_SEQ_EVENT_NONE, SND_SEQ_EVENT_SENSING, SND_SEQ_EVENT_RESET
+};
+
+/* Value of a hex digit, 0xF0 for anything else. OR-ing all lookups of a
+ * frame leaves the high nibble set if any character was not a hex digit. */
+static const uint8_t MIDI_WIRE_HEX_NIBBLE[256] = {
+	0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+	0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+	0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+	0xF0, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+	0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+	0xF0, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+	0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+	0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+	0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+	0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+	0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+	0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+	0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+	0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0,
+	0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0
+};
+
+void midiWireParserInit(midi_wire_parser_t* pParser)
+{
+	pParser->unFrameLeft = 0;
+	midiStreamParserInit(&(pParser->tStream));
+}
+
+/* Data bytes that follow a channel status byte */
+int32_t nMidiWireDataLength(uint8_t unStatus)
+{
+	return MIDI_WIRE_DATA_LENGTH[unStatus >> 4];
+}
+
+/* pData holds the data bytes of a complete channel message */
+void midiWireChannelEvent(snd_seq_event_t* pEvent, uint8_t unStatus, const uint8_t* pData)
+{
+	snd_seq_ev_clear(pEvent);
+	pEvent->type = MIDI_WIRE_EVENT_TYPE[unStatus >> 4];
+	switch (pEvent->type){
+	case SND_SEQ_EVENT_NOTEOFF:
+	case SND_SEQ_EVENT_NOTEON:
+	case SND_SEQ_EVENT_KEYPRESS:
+		pEvent->data.note.channel = unStatus & 0x0F;
+		pEvent->data.note.note = pData[0];
+		pEvent->data.note.velocity = pData[1];
+		break;
+	case SND_SEQ_EVENT_CONTROLLER:
+		pEvent->data.control.channel = unStatus & 0x0F;
+		pEvent->data.control.param = pData[0];
+		pEvent->data.control.value = pData[1];
+		break;
+	case SND_SEQ_EVENT_PITCHBEND:
+		pEvent->data.control.channel = unStatus & 0x0F;
+		pEvent->data.control.value = ((pData[1] << 7) | pData[0]) - 8192;
+		break;
+	default:	// program change, channel pressure
+		pEvent->data.control.channel = unStatus & 0x0F;
+		pEvent->data.control.value = pData[0];
+		break;
+	}
+}
+
+/* Event for a 0xF8..0xFF byte, -1 for the undefined ones */
+int32_t nMidiWireRealtimeEvent(snd_seq_event_t* pEvent, uint8_t unByte)
+{
+	if (SND_SEQ_EVENT_NONE == MIDI_WIRE_REALTIME_TYPE[unByte & 0x0F]){
+		return (-1);
+	}
+	snd_seq_ev_clear(pEvent);
+	pEvent->type = MIDI_WIRE_REALTIME_TYPE[unByte & 0x0F];
+	return 0;
+}
+
+/* Decode as many bytes as fit into pEvents. Returns the number of events
+ * produced, *pUsed tells how many input bytes were consumed; the caller
+ * feeds the rest again once it has flushed the events. Like
+ * nMidiStreamDecode() it also stops at a complete SysEx chunk. */
+int32_t nMidiWireDecode(midi_wire_parser_t* pParser, const uint8_t* pData, int32_t nLen,
+		snd_seq_event_t* pEvents, int32_t nMaxEvents, int32_t* pUsed)
+{
+	midi_stream_parser_t* pStream = &(pParser->tStream);
+	int32_t nIndex = 0, nEvents = 0;
+	int32_t nPayload, nUsed;
+
+	while ((nIndex < nLen) && (nEvents < nMaxEvents)){
+		if (0 == pParser->unFrameLeft){
+			if (pStream->unStatus != 0){
+				pStream->unMalformed++;	// previous frame ended mid message
+				pStream->unStatus = 0;
+				pStream->unHave = 0;
+			}
+			pParser->unFrameLeft = pData[nIndex++];
+			continue;
+		}
+		nPayload = (pParser->unFrameLeft < (nLen - nIndex)) ? pParser->unFrameLeft : (nLen - nIndex);
+		nEvents += nMidiStreamDecode(pStream, pData + nIndex, nPayload,
+				pEvents + nEvents, nMaxEvents - nEvents, &nUsed);
+		pParser->unFrameLeft -= nUsed;
+		nIndex += nUsed;
+		if (1 == pStream->nSysExReady){
+			break;	// the caller takes the chunk before the buffer is reused
+		}
+	}
+	*pUsed = nIndex;
+	return nEvents;
+}
+
+/* Wire form of pEvent with full status, pData needs 3 bytes. Returns the
+ * length, 0 for events that have no short MIDI message. */
+int32_t nMidiWireEncode(const snd_seq_event_t* pEvent, uint8_t* pData)
+{
+	int32_t nBend;
+
+	switch (pEvent->type){
+	case SND_SEQ_EVENT_NOTEOFF:
+	case SND_SEQ_EVENT_NOTEON:
+	case SND_SEQ_EVENT_KEYPRESS:
+		pData[0] = ((SND_SEQ_EVENT_NOTEOFF == pEvent->type) ? 0x80 :
+				(SND_SEQ_EVENT_NOTEON == pEvent->type) ? 0x90 : 0xA0) | (pEvent->data.note.channel & 0x0F);
+		pData[1] = pEvent->data.note.note & 0x7F;
+		pData[2] = pEvent->data.note.velocity & 0x7F;
+		return 3;
+	case SND_SEQ_EVENT_CONTROLLER:
+		pData[0] = 0xB0 | (pEvent->data.control.channel & 0x0F);
+		pData[1] = pEvent->data.control.param & 0x7F;
+		pData[2] = pEvent->data.control.value & 0x7F;
+		return 3;
+	case SND_SEQ_EVENT_PGMCHANGE:
+	case SND_SEQ_EVENT_CHANPRESS:
+		pData[0] = ((SND_SEQ_EVENT_PGMCHANGE == pEvent->type) ? 0xC0 : 0xD0) | (pEvent->data.control.channel & 0x0F);
+		pData[1] = pEvent->data.control.value & 0x7F;
+		return 2;
+	case SND_SEQ_EVENT_PITCHBEND:
+		nBend = pEvent->data.control.value + 8192;
+		nBend = (nBend < 0) ? 0 : (nBend > 0x3FFF) ? 0x3FFF : nBend;
+		pData[0] = 0xE0 | (pEvent->data.control.channel & 0x0F);
+		pData[1] = nBend & 0x7F;
+		pData[2] = nBend >> 7;
+		return 3;
+	case SND_SEQ_EVENT_CLOCK:
+		pData[0] = 0xF8;
+		return 1;
+	case SND_SEQ_EVENT_START:
+		pData[0] = 0xFA;
+		return 1;
+	case SND_SEQ_EVENT_CONTINUE:
+		pData[0] = 0xFB;
+		return 1;
+	case SND_SEQ_EVENT_STOP:
+		pData[0] = 0xFC;
+		return 1;
+	case SND_SEQ_EVENT_SENSING:
+		pData[0] = 0xFE;
+		return 1;
+	case SND_SEQ_EVENT_RESET:
+		pData[0] = 0xFF;
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/* Convert nBytes * 2 hex characters into pData. Returns -1 without
+ * trusting pData if any character is not a hex digit. */
+int32_t nMidiWireDecodeHex(const char* pHex, uint8_t* pData, int32_t nBytes)
+{
+	const uint8_t* pChar = (const uint8_t*)pHex;
+	uint8_t unHigh, unLow, unInvalid = 0;
+	int32_t nIndex;
+
+	for (nIndex = 0; nIndex < nBytes; nIndex++){
+		unHigh = MIDI_WIRE_HEX_NIBBLE[pChar[2 * nIndex]];
+		unLow = MIDI_WIRE_HEX_NIBBLE[pChar[2 * nIndex + 1]];
+		unInvalid |= unHigh | unLow;
+		pData[nIndex] = (uint8_t)((unHigh << 4) | (unLow & 0x0F));
+	}
+	return (unInvalid & 0xF0) ? (-1) : 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * midi_wire.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ *
+ *  Binary framing for the RFCOMM and UART links. A link starts in the
+ *  hex text mode. The client switches it by sending MIDI_WIRE_HELLO
+ *  followed by NOTE_FRAME_END_SYMBOL, the daemon answers with the single
+ *  MIDI_WIRE_HELLO byte. The client waits for that answer, from then on
+ *  the link carries frames of
+ *
+ *      [length 1..255][length bytes of raw MIDI]
+ *
+ *  The bytes inside the frames form one MIDI stream, see midi_stream.h.
+ *  Running status carries over from frame to frame, but a message must
+ *  complete inside its frame; a truncated tail is counted as malformed.
+ *  Only SysEx may span frames, a long one is sent in as many as it takes.
+ */
+
+#ifndef MIDI_WIRE_H_
+#define MIDI_WIRE_H_
+
+#include <stdint.h>
+
+#include "midi_stream.h"
+
+#define MIDI_WIRE_HELLO					((uint8_t)0xFD)	// undefined in MIDI, never valid hex
+
+typedef struct {
+	uint8_t unFrameLeft;		// bytes still to come in this frame, 0 means length byte is next
+	midi_stream_parser_t tStream;
+}midi_wire_parser_t;
+
+void midiWireParserInit(midi_wire_parser_t* pParser);
+
+int32_t nMidiWireDecode(midi_wire_parser_t* pParser, const uint8_t* pData, int32_t nLen,
+		snd_seq_event_t* pEvents, int32_t nMaxEvents, int32_t* pUsed);
+
+int32_t nMidiWireDataLength(uint8_t unStatus);
+
+void midiWireChannelEvent(snd_seq_event_t* pEvent, uint8_t unStatus, const uint8_t* pData);
+
+int32_t nMidiWireRealtimeEvent(snd_seq_event_t* pEvent, uint8_t unByte);
+
+int32_t nMidiWireEncode(const snd_seq_event_t* pEvent, uint8_t* pData);
+
+int32_t nMidiWireDecodeHex(const char* pHex, uint8_t* pData, int32_t nBytes);
+
+#endif /* MIDI_WIRE_H_ */
@@ -0,0 +1,130 @@
+/*
+ * reactor.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "log.h"
+#include "reactor.h"
+
+int32_t nSetNonBlocking(int32_t nFd)
+{
+	int32_t nFlags = fcntl(nFd, F_GETFL, 0);
+	if (nFlags < 0){
+		return (-1);
+	}
+	return fcntl(nFd, F_SETFL, nFlags | O_NONBLOCK);
+}
+
+int32_t nReactorInit(reactor_t* pReactor)
+{
+	struct epoll_event tEvent;
+
+	pReactor->nStop = 0;
+	pReactor->nEpollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (pReactor->nEpollFd < 0){
+		LOG_E("Create epoll instance failed: %m");
+		return (-1);
+	}
+
+	/* lets reactorStop() break epoll_wait() from any thread or signal handler */
+	pReactor->nWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (pReactor->nWakeFd < 0){
+		LOG_E("Create reactor wake fd failed: %m");
+		close(pReactor->nEpollFd);
+		return (-1);
+	}
+	memset(&tEvent, 0, sizeof(tEvent));
+	tEvent.events = EPOLLIN;
+	tEvent.data.ptr = NULL;
+	if (epoll_ctl(pReactor->nEpollFd, EPOLL_CTL_ADD, pReactor->nWakeFd, &tEvent) < 0){
+		LOG_E("Register reactor wake fd failed: %m");
+		close(pReactor->nWakeFd);
+		close(pReactor->nEpollFd);
+		return (-1);
+	}
+	return 0;
+}
+
+int32_t nReactorAdd(reactor_t* pReactor, reactor_handler_t* pHandler, uint32_t unEvents)
+{
+	struct epoll_event tEvent;
+
+	memset(&tEvent, 0, sizeof(tEvent));
+	tEvent.events = unEvents;
+	tEvent.data.ptr = pHandler;
+	if (epoll_ctl(pReactor->nEpollFd, EPOLL_CTL_ADD, pHandler->nFd, &tEvent) < 0){
+		LOG_E("Add fd to reactor failed: %m");
+		return (-1);
+	}
+	return 0;
+}
+
+int32_t nReactorRemove(reactor_t* pReactor, reactor_handler_t* pHandler)
+{
+	if (epoll_ctl(pReactor->nEpollFd, EPOLL_CTL_DEL, pHandler->nFd, NULL) < 0){
+		LOG_E("Remove fd from reactor failed: %m");
+		return (-1);
+	}
+	return 0;
+}
+
+/* Handlers may remove themselves or others while a batch is dispatched.
+ * Their owners must keep the memory and set nFd to -1, so a stale event
+ * later in the same batch is recognised and skipped here. */
+void reactorRun(reactor_t* pReactor)
+{
+	struct epoll_event tEvents[REACTOR_MAX_EVENTS];
+	reactor_handler_t* pHandler;
+	uint64_t ulWake;
+	int32_t nReady, nIndex;
+
+	while (0 == pReactor->nStop){
+		nReady = epoll_wait(pReactor->nEpollFd, tEvents, REACTOR_MAX_EVENTS, -1);
+		if (nReady < 0){
+			if (EINTR == errno){
+				continue;
+			}
+			LOG_E("Reactor wait failed: %m");
+			break;
+		}
+		for (nIndex = 0; nIndex < nReady; nIndex++){
+			pHandler = tEvents[nIndex].data.ptr;
+			if (NULL == pHandler){
+				if (read(pReactor->nWakeFd, &ulWake, sizeof(ulWake)) < 0){
+					/* already drained, nothing to do */
+				}
+				continue;
+			}
+			if (pHandler->nFd >= 0){
+				pHandler->pOnEvent(pHandler, tEvents[nIndex].events);
+			}
+		}
+	}
+}
+
+/* Async-signal-safe */
+void reactorStop(reactor_t* pReactor)
+{
+	uint64_t ulWake = 1;
+
+	pReactor->nStop = 1;
+	if (write(pReactor->nWakeFd, &ulWake, sizeof(ulWake)) < 0){
+		/* counter saturated, the reactor is being woken anyway */
+	}
+}
+
+void reactorRelease(reactor_t* pReactor)
+{
+	close(pReactor->nWakeFd);
+	close(pReactor->nEpollFd);
+}
@@ -0,0 +1,46 @@
+/*
+ * reactor.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#ifndef REACTOR_H_
+#define REACTOR_H_
+
+#include <stdint.h>
+
+#define REACTOR_MAX_EVENTS				32
+
+typedef struct reactor_handler reactor_handler_t;
+typedef void (*reactor_callback_t)(reactor_handler_t* pHandler, uint32_t unEvents);
+
+/* Embedded in whatever owns the fd, pContext points back to the owner */
+struct reactor_handler{
+	int32_t nFd;
+	reactor_callback_t pOnEvent;
+	void* pContext;
+};
+
+/* One epoll instance served by the thread calling reactorRun() */
+typedef struct {
+	int32_t nEpollFd;
+	int32_t nWakeFd;
+	volatile int32_t nStop;
+}reactor_t;
+
+int32_t nReactorInit(reactor_t* pReactor);
+
+int32_t nReactorAdd(reactor_t* pReactor, reactor_handler_t* pHandler, uint32_t unEvents);
+
+int32_t nReactorRemove(reactor_t* pReactor, reactor_handler_t* pHandler);
+
+void reactorRun(reactor_t* pReactor);
+
+void reactorStop(reactor_t* pReactor);
+
+void reactorRelease(reactor_t* pReactor);
+
+int32_t nSetNonBlocking(int32_t nFd);
+
+#endif /* REACTOR_H_ */
@@ -0,0 +1,428 @@
+/*
+ * seq_engine.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#define _GNU_SOURCE		// sem_clockwait()
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <alsa/asoundlib.h>
+
+#include "midi.h"
+#include "log.h"
+#include "seq_engine.h"
+
+/* nMaxSources: link slots that get a merge queue of their own */
+int32_t nSeqEngineInit(seq_engine_t* pEngine, midi_out_t* pOut, int32_t nMaxSources,
+		uint32_t unWindowUs, uint32_t unLatencyCapUs)
+{
+	memset(pEngine, 0, sizeof(seq_engine_t));
+	pEngine->pOut = pOut;
+	pEngine->unWindowUs = unWindowUs;
+	pEngine->unLatencyCapUs = (unLatencyCapUs < unWindowUs) ? unWindowUs : unLatencyCapUs;
+	pEngine->nQueue = SEQ_ENGINE_NO_QUEUE;
+
+	if (nEventMergeInit(&(pEngine->tMerge), nMaxSources) < 0){
+		return (-1);
+	}
+	if (nSysExPoolInit(&(pEngine->tSysEx), SYSEX_POOL_BUFFERS) < 0){
+		eventMergeRelease(&(pEngine->tMerge));
+		return (-1);
+	}
+	if (sem_init(&(pEngine->tDoorbell), 0, 0) < 0){
+		perror("Initialize sequencer engine doorbell failed");
+		sysExPoolRelease(&(pEngine->tSysEx));
+		eventMergeRelease(&(pEngine->tMerge));
+		return (-1);
+	}
+	return 0;
+}
+
+/* Ask for the high resolution timer, the default system timer ticks at HZ */
+static void useHighResolutionTimer(seq_engine_t* pEngine)
+{
+	snd_seq_queue_timer_t *pQueueTimer;
+	snd_timer_id_t *pTimerID;
+	int32_t err;
+
+	snd_seq_queue_timer_alloca(&pQueueTimer);
+	snd_timer_id_alloca(&pTimerID);
+	err = snd_seq_get_queue_timer(pEngine->pSeq, pEngine->nQueue, pQueueTimer);
+	if (nCheckSnd("get queue timer", err) < 0){
+		return;
+	}
+	snd_timer_id_set_class(pTimerID, SND_TIMER_CLASS_GLOBAL);
+	snd_timer_id_set_sclass(pTimerID, SND_TIMER_SCLASS_NONE);
+	snd_timer_id_set_card(pTimerID, -1);
+	snd_timer_id_set_device(pTimerID, SND_TIMER_GLOBAL_HRTIMER);
+	snd_timer_id_set_subdevice(pTimerID, 0);
+	snd_seq_queue_timer_set_id(pQueueTimer, pTimerID);
+	err = snd_seq_set_queue_timer(pEngine->pSeq, pEngine->nQueue, pQueueTimer);
+	if (nCheckSnd("use hrtimer for queue", err) < 0){
+		printf(", staying on the system timer.\n");
+	}
+}
+
+/* Call before the engine thread starts. Events stamped through
+ * seqEngineSchedule() are then played unPlayoutDelayUs after arrival.
+ * Needs the sequencer backend, pSeq is its handle. */
+int32_t nSeqEngineEnableQueue(seq_engine_t* pEngine, snd_seq_t *pSeq, uint32_t unPlayoutDelayUs)
+{
+	int32_t err;
+
+	if (NULL == pSeq){
+		printf("  Scheduled mode needs the sequencer output.\n");
+		return (-1);
+	}
+	pEngine->pSeq = pSeq;
+	pEngine->nQueue = snd_seq_alloc_named_queue(pEngine->pSeq, "midi daemon playout");
+	if (nCheckSnd("allocate queue", pEngine->nQueue) < 0){
+		pEngine->nQueue = SEQ_ENGINE_NO_QUEUE;
+		return (-1);
+	}
+	useHighResolutionTimer(pEngine);
+
+	err = snd_seq_start_queue(pEngine->pSeq, pEngine->nQueue, NULL);
+	if (err >= 0){
+		err = snd_seq_drain_output(pEngine->pSeq);
+	}
+	if (nCheckSnd("start queue", err) < 0){
+		snd_seq_free_queue(pEngine->pSeq, pEngine->nQueue);
+		pEngine->nQueue = SEQ_ENGINE_NO_QUEUE;
+		return (-1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &(pEngine->tQueueStart));
+	pEngine->unPlayoutDelayUs = unPlayoutDelayUs;
+	printf("  Playout queue %d started, delay %uus.\n", pEngine->nQueue, unPlayoutDelayUs);
+	return 0;
+}
+
+/* Queue clock estimate from CLOCK_MONOTONIC, no syscall into the sequencer */
+int64_t llSeqEngineQueueTimeUs(seq_engine_t* pEngine)
+{
+	struct timespec tNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	return (int64_t)(tNow.tv_sec - pEngine->tQueueStart.tv_sec) * 1000000 +
+			(tNow.tv_nsec - pEngine->tQueueStart.tv_nsec) / 1000;
+}
+
+/* Stamp pEvent to play at llPlayUs on the queue clock. Does nothing
+ * when no queue is enabled. Safe from any thread. */
+void seqEngineScheduleAt(seq_engine_t* pEngine, snd_seq_event_t* pEvent, int64_t llPlayUs)
+{
+	snd_seq_real_time_t tTime;
+
+	if (SEQ_ENGINE_NO_QUEUE == pEngine->nQueue){
+		return;
+	}
+	if (llPlayUs < 0){
+		llPlayUs = 0;
+	}
+	tTime.tv_sec = llPlayUs / 1000000;
+	tTime.tv_nsec = (llPlayUs % 1000000) * 1000;
+	snd_seq_ev_schedule_real(pEvent, pEngine->nQueue, 0, &tTime);
+}
+
+/* Stamp pEvent to play at llArrivalUs (queue clock) plus the playout delay */
+void seqEngineSchedule(seq_engine_t* pEngine, snd_seq_event_t* pEvent, int64_t llArrivalUs)
+{
+	seqEngineScheduleAt(pEngine, pEvent, llArrivalUs + pEngine->unPlayoutDelayUs);
+}
+
+/* Call before the engine thread starts */
+void seqEngineAttachStats(seq_engine_t* pEngine, daemon_stats_t* pStats)
+{
+	pEngine->pStats = pStats;
+	pEngine->tMerge.tOther.pStats = &(pStats->tOther);
+}
+
+/* Call before the engine thread starts */
+void seqEngineSetDropPolicy(seq_engine_t* pEngine, event_merge_policy_t tPolicy)
+{
+	pEngine->tMerge.tPolicy = tPolicy;
+}
+
+/* Call before the engine thread starts, after the recorder is open */
+void seqEngineAttachRecorder(seq_engine_t* pEngine, midi_recorder_t* pRecorder)
+{
+	pEngine->pRecorder = pRecorder;
+}
+
+/* Give link slot nSource its own merge queue, call from the thread that
+ * will queue its events and before the first one. nWeight is its share
+ * of the engine relative to the other sources. */
+int32_t nSeqEngineOpenSource(seq_engine_t* pEngine, int32_t nSource, int32_t nWeight)
+{
+	return nEventMergeOpenSource(&(pEngine->tMerge), nSource, nWeight,
+			(NULL == pEngine->pStats) ? NULL : pStatsForSource(pEngine->pStats, nSource));
+}
+
+/* Call before the engine thread starts */
+void seqEngineAttachParams(seq_engine_t* pEngine, midi_params_t* pParams)
+{
+	pEngine->pParams = pParams;
+}
+
+/* Call before the engine thread starts, the filter then belongs to it */
+void seqEngineAttachFilter(seq_engine_t* pEngine, midi_filter_t* pFilter)
+{
+	pEngine->pFilter = pFilter;
+}
+
+/* Make pEvent a SysEx event carrying a copy of nLen bytes, at most
+ * SYSEX_POOL_BUFFER_SIZE. The copy goes back to the pool once the engine
+ * sent the event, or right away when its queue refuses it, so the event
+ * must be queued. Safe from any thread. Fails when no buffer is free,
+ * the caller then drops the rest of the message. */
+int32_t nSeqEngineSysExEvent(seq_engine_t* pEngine, snd_seq_event_t* pEvent,
+		const uint8_t* pData, int32_t nLen)
+{
+	return nSysExPoolEvent(&(pEngine->tSysEx), pEvent, pData, nLen);
+}
+
+/* Queue one event without waking the engine. Ingest threads queue every
+ * event decoded from one read and then kick once. Safe from any thread.
+ * ullReadNs is when the read carrying the event returned, 0 if unknown.
+ * Fails when the source's queue refuses the event, see event_merge_policy_t. */
+int32_t nSeqEngineQueueFrom(seq_engine_t* pEngine, const snd_seq_event_t* pEvent,
+		int32_t nSource, uint64_t ullReadNs)
+{
+	if (nEventMergePush(&(pEngine->tMerge), pEvent, nSource, ullReadNs) < 0){
+		__atomic_add_fetch(&(pEngine->unDropped), 1, __ATOMIC_RELAXED);
+		if (SND_SEQ_EVENT_SYSEX == pEvent->type){
+			sysExPoolReturn(&(pEngine->tSysEx), pEvent);
+		}
+		return (-1);
+	}
+	return 0;
+}
+
+int32_t nSeqEngineQueue(seq_engine_t* pEngine, const snd_seq_event_t* pEvent)
+{
+	return nSeqEngineQueueFrom(pEngine, pEvent, EVENT_MERGE_SOURCE_OTHER, 0);
+}
+
+void seqEngineKick(seq_engine_t* pEngine)
+{
+	sem_post(&(pEngine->tDoorbell));
+}
+
+int32_t nSeqEngineSubmit(seq_engine_t* pEngine, const snd_seq_event_t* pEvent)
+{
+	if (nSeqEngineQueue(pEngine, pEvent) < 0){
+		return (-1);
+	}
+	seqEngineKick(pEngine);
+	return 0;
+}
+
+static void addMicroseconds(struct timespec* pTime, uint32_t unMicroseconds)
+{
+	pTime->tv_sec += unMicroseconds / 1000000;
+	pTime->tv_nsec += (unMicroseconds % 1000000) * 1000;
+	if (pTime->tv_nsec >= 1000000000){
+		pTime->tv_sec += 1;
+		pTime->tv_nsec -= 1000000000;
+	}
+}
+
+static int32_t nTimeBefore(const struct timespec* pA, const struct timespec* pB)
+{
+	return (pA->tv_sec < pB->tv_sec) ||
+			((pA->tv_sec == pB->tv_sec) && (pA->tv_nsec < pB->tv_nsec));
+}
+
+/* Ring or wait for the doorbell until pDeadline on CLOCK_MONOTONIC, so
+ * an NTP step cannot stretch the latency cap. Without sem_clockwait(),
+ * glibc before 2.30, the remaining time is waited on CLOCK_REALTIME;
+ * a step then only stretches the one wait it falls into. */
+static int32_t nDoorbellWait(seq_engine_t* pEngine, const struct timespec* pDeadline)
+{
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || ((2 == __GLIBC__) && (__GLIBC_MINOR__ >= 30)))
+	return sem_clockwait(&(pEngine->tDoorbell), CLOCK_MONOTONIC, pDeadline);
+#else
+	struct timespec tNow, tWait;
+	int64_t llLeftUs;
+
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	llLeftUs = (pDeadline->tv_sec - tNow.tv_sec) * 1000000LL + (pDeadline->tv_nsec - tNow.tv_nsec) / 1000;
+	clock_gettime(CLOCK_REALTIME, &tWait);
+	addMicroseconds(&tWait, (llLeftUs > 0) ? llLeftUs : 0);
+	return sem_timedwait(&(pEngine->tDoorbell), &tWait);
+#endif
+}
+
+/* Move everything queued into the batch, no syscall here.
+ * unFirst is how many events the current batch already holds. */
+static uint32_t unOutputQueued(seq_engine_t* pEngine, uint32_t unFirst)
+{
+	snd_seq_event_t* pEvent;
+	uint32_t unCount = 0;
+	uint32_t unSlot;
+	uint64_t ullNow = 0;
+
+	if (pEngine->pStats != NULL){
+		ullNow = ullStatsNowNs();
+	}
+	while (((unFirst + unCount) < SEQ_ENGINE_MAX_BATCH) &&
+			(pEngine->unBatchSysExBytes < SEQ_ENGINE_SYSEX_BURST) &&
+			(0 == nEventMergePop(&(pEngine->tMerge), pEngine->tBatch + unFirst + unCount,
+					pEngine->nBatchSource + unFirst + unCount,
+					pEngine->ullBatchStamp + unFirst + unCount))){
+		unSlot = unFirst + unCount;
+		pEvent = pEngine->tBatch + unSlot;
+		if ((pEngine->pStats != NULL) && (pEngine->ullBatchStamp[unSlot] != 0)){
+			statsRecord(pStatsForSource(pEngine->pStats, pEngine->nBatchSource[unSlot]),
+					STATS_STAGE_QUEUE, ullNow - pEngine->ullBatchStamp[unSlot]);
+		}
+		if (SND_SEQ_EVENT_SYSEX == pEvent->type){
+			pEngine->unBatchSysExBytes += pEvent->data.ext.len;
+		}
+		if ((pEngine->pFilter != NULL) && (0 == nMidiFilterPass(pEngine->pFilter, pEvent))){
+			if (pEngine->pStats != NULL){
+				statsCount(&(pEngine->pStats->unFiltered), 1);
+			}
+			continue;	// the slot is reused by the next event
+		}
+		if ((SEQ_ENGINE_NO_QUEUE == pEngine->nQueue) || (0 == (pEvent->flags & SND_SEQ_TIME_STAMP_REAL))){
+			snd_seq_ev_set_direct(pEvent);
+		}
+		unCount++;
+	}
+	return unCount;
+}
+
+static void drainBatch(seq_engine_t* pEngine, uint32_t unBatched)
+{
+	uint64_t ullStart = 0, ullEnd;
+	uint32_t unSlot;
+
+	if (pEngine->pStats != NULL){
+		ullStart = ullStatsNowNs();
+	}
+	if (pEngine->pParams != NULL){
+		// one parameter snapshot per channel for the whole batch
+		midiParamsApplyBatch(pEngine->pParams, &(pEngine->tNoteMap), pEngine->tBatch, unBatched);
+	}
+	nMidiOutSendBatch(pEngine->pOut, pEngine->tBatch, unBatched);
+	nMidiOutFlush(pEngine->pOut);
+	pEngine->unEvents += unBatched;
+	pEngine->unDrains += 1;
+
+	ullEnd = ((NULL == pEngine->pStats) && (NULL == pEngine->pRecorder)) ? 0 : ullStatsNowNs();
+	if (pEngine->pRecorder != NULL){
+		// the output is out already, recording only costs a copy, SysEx bytes included
+		midiRecorderBatch(pEngine->pRecorder, pEngine->tBatch, unBatched, ullEnd,
+				(SEQ_ENGINE_NO_QUEUE == pEngine->nQueue) ? 0 :
+				(uint64_t)pEngine->tQueueStart.tv_sec * 1000000000ULL + pEngine->tQueueStart.tv_nsec);
+	}
+	if (pEngine->unBatchSysExBytes > 0){
+		// the backend and the recorder copied them, the buffers are free for the next chunks
+		for (unSlot = 0; unSlot < unBatched; unSlot++){
+			if (SND_SEQ_EVENT_SYSEX == pEngine->tBatch[unSlot].type){
+				sysExPoolReturn(&(pEngine->tSysEx), pEngine->tBatch + unSlot);
+			}
+		}
+		pEngine->unBatchSysExBytes = 0;
+	}
+	if (NULL == pEngine->pStats){
+		return;
+	}
+	statsRecord(&(pEngine->pStats->tOther), STATS_STAGE_DRAIN, ullEnd - ullStart);
+	for (unSlot = 0; unSlot < unBatched; unSlot++){
+		if (pEngine->ullBatchStamp[unSlot] != 0){
+			statsRecord(pStatsForSource(pEngine->pStats, pEngine->nBatchSource[unSlot]),
+					STATS_STAGE_TOTAL, ullEnd - pEngine->ullBatchStamp[unSlot]);
+		}
+	}
+}
+
+void* seqEngineService(void* pEngine)
+{
+	seq_engine_t* pThis = (seq_engine_t*)pEngine;
+	struct timespec tNow, tWindowEnd, tCapEnd;
+	uint32_t unBatched;
+
+	LOG_I("Sequencer engine start, window %uus, latency cap %uus.",
+			pThis->unWindowUs, pThis->unLatencyCapUs);
+	while (0 == pThis->nStop){
+		if (sem_wait(&(pThis->tDoorbell)) < 0){
+			if (EINTR == errno){
+				continue;
+			}
+			LOG_E("Sequencer engine wait failed: %m");
+			break;
+		}
+
+		unBatched = unOutputQueued(pThis, 0);
+		if ((pThis->unWindowUs > 0) && (unBatched > 0)){
+			clock_gettime(CLOCK_MONOTONIC, &tCapEnd);
+			addMicroseconds(&tCapEnd, pThis->unLatencyCapUs);
+			while ((unBatched < SEQ_ENGINE_MAX_BATCH) && (0 == pThis->nStop)){
+				clock_gettime(CLOCK_MONOTONIC, &tNow);
+				tWindowEnd = tNow;
+				addMicroseconds(&tWindowEnd, pThis->unWindowUs);
+				if (nTimeBefore(&tCapEnd, &tWindowEnd)){
+					tWindowEnd = tCapEnd;
+				}
+				if (!nTimeBefore(&tNow, &tWindowEnd)){
+					break;
+				}
+				if (nDoorbellWait(pThis, &tWindowEnd) < 0){
+					if (EINTR == errno){
+						continue;
+					}
+					break;	// window closed with nothing new
+				}
+				unBatched += unOutputQueued(pThis, unBatched);
+			}
+		}
+
+		if ((unBatched >= SEQ_ENGINE_MAX_BATCH) || (pThis->unBatchSysExBytes >= SEQ_ENGINE_SYSEX_BURST)){
+			seqEngineKick(pThis);	// its doorbell may be eaten already, come back for the rest
+		}
+		if (unBatched > 0){
+			drainBatch(pThis, unBatched);
+		}
+	}
+	LOG_I("Sequencer engine end, %u events in %u drains, %u dropped by drop policy %s.",
+			pThis->unEvents, pThis->unDrains, pThis->unDropped,
+			EVENT_MERGE_POLICY_NAME[pThis->tMerge.tPolicy]);
+	if (pThis->tSysEx.unExhausted > 0){
+		LOG_I("%u SysEx chunks lost, all %d buffers in flight.",
+				pThis->tSysEx.unExhausted, SYSEX_POOL_BUFFERS);
+	}
+	if (pThis->pFilter != NULL){
+		LOG_I("Filter dropped %u note offs, %u controllers, %u program changes.",
+				pThis->pFilter->unDropped[MIDI_FILTER_NOTE_OFF],
+				pThis->pFilter->unDropped[MIDI_FILTER_CONTROL],
+				pThis->pFilter->unDropped[MIDI_FILTER_PROGRAM]);
+	}
+	return NULL;
+}
+
+void seqEngineStop(seq_engine_t* pEngine)
+{
+	pEngine->nStop = 1;
+	sem_post(&(pEngine->tDoorbell));
+}
+
+void seqEngineRelease(seq_engine_t* pEngine)
+{
+	if (pEngine->nQueue != SEQ_ENGINE_NO_QUEUE){
+		snd_seq_stop_queue(pEngine->pSeq, pEngine->nQueue, NULL);
+		snd_seq_drain_output(pEngine->pSeq);
+		snd_seq_free_queue(pEngine->pSeq, pEngine->nQueue);
+	}
+	sem_destroy(&(pEngine->tDoorbell));
+	sysExPoolRelease(&(pEngine->tSysEx));
+	eventMergeRelease(&(pEngine->tMerge));
+}
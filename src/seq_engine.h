@@ -0,0 +1,109 @@
+/*
+ * seq_engine.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#ifndef SEQ_ENGINE_H_
+#define SEQ_ENGINE_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <semaphore.h>
+
+#include "event_merge.h"
+#include "stats.h"
+#include "midi_out.h"
+#include "midi_params.h"
+#include "midi_filter.h"
+#include "midi_recorder.h"
+#include "sysex_pool.h"
+
+#define SEQ_ENGINE_MAX_BATCH			256
+#define SEQ_ENGINE_DEFAULT_WINDOW_US	0		// drain as soon as the burst is out
+#define SEQ_ENGINE_DEFAULT_CAP_US		2000
+#define SEQ_ENGINE_NO_QUEUE				(-1)
+#define SEQ_ENGINE_SYSEX_BURST			4096	// SysEx bytes per batch, the rest goes in the next
+
+/* The one and only MIDI writer. Ingest threads submit events into their
+ * source's merge queue, the engine thread takes them round-robin, hands
+ * them to the output backend and flushes it once per batch. A batch ends when the
+ * queue runs dry and no more events arrive within unWindowUs, or when the
+ * first event of the batch has waited unLatencyCapUs, whichever is first.
+ * With a queue enabled, events carrying a real time stamp are scheduled
+ * on it, everything else still goes out direct. With a filter attached,
+ * events that would not change the synth's state are dropped as they are
+ * taken from the queue. With parameters attached, notes are transposed
+ * and velocity shaped on the way out. With a recorder attached, every
+ * batch is copied to it once it is flushed. SysEx travels in chunks held
+ * by the engine's buffer pool, a batch carries at most
+ * SEQ_ENGINE_SYSEX_BURST bytes of it so a dump never holds up one drain. */
+typedef struct {
+	midi_out_t* pOut;
+	snd_seq_t *pSeq;		// only for the playout queue
+	uint32_t unWindowUs;
+	uint32_t unLatencyCapUs;
+	int32_t nQueue;
+	uint32_t unPlayoutDelayUs;
+	struct timespec tQueueStart;
+	event_merge_t tMerge;
+	sem_t tDoorbell;
+	volatile int32_t nStop;
+	uint32_t unDropped;
+	uint32_t unEvents;
+	uint32_t unDrains;
+	daemon_stats_t* pStats;
+	midi_params_t* pParams;
+	midi_filter_t* pFilter;
+	midi_recorder_t* pRecorder;
+	midi_note_map_t tNoteMap;
+	sysex_pool_t tSysEx;
+	uint32_t unBatchSysExBytes;
+	snd_seq_event_t tBatch[SEQ_ENGINE_MAX_BATCH];
+	int32_t nBatchSource[SEQ_ENGINE_MAX_BATCH];
+	uint64_t ullBatchStamp[SEQ_ENGINE_MAX_BATCH];
+}seq_engine_t;
+
+int32_t nSeqEngineInit(seq_engine_t* pEngine, midi_out_t* pOut, int32_t nMaxSources,
+		uint32_t unWindowUs, uint32_t unLatencyCapUs);
+
+void seqEngineSetDropPolicy(seq_engine_t* pEngine, event_merge_policy_t tPolicy);
+
+int32_t nSeqEngineOpenSource(seq_engine_t* pEngine, int32_t nSource, int32_t nWeight);
+
+int32_t nSeqEngineEnableQueue(seq_engine_t* pEngine, snd_seq_t *pSeq, uint32_t unPlayoutDelayUs);
+
+int64_t llSeqEngineQueueTimeUs(seq_engine_t* pEngine);
+
+void seqEngineScheduleAt(seq_engine_t* pEngine, snd_seq_event_t* pEvent, int64_t llPlayUs);
+
+void seqEngineSchedule(seq_engine_t* pEngine, snd_seq_event_t* pEvent, int64_t llArrivalUs);
+
+void seqEngineAttachStats(seq_engine_t* pEngine, daemon_stats_t* pStats);
+
+void seqEngineAttachParams(seq_engine_t* pEngine, midi_params_t* pParams);
+
+void seqEngineAttachFilter(seq_engine_t* pEngine, midi_filter_t* pFilter);
+
+void seqEngineAttachRecorder(seq_engine_t* pEngine, midi_recorder_t* pRecorder);
+
+int32_t nSeqEngineSysExEvent(seq_engine_t* pEngine, snd_seq_event_t* pEvent,
+		const uint8_t* pData, int32_t nLen);
+
+int32_t nSeqEngineQueue(seq_engine_t* pEngine, const snd_seq_event_t* pEvent);
+
+int32_t nSeqEngineQueueFrom(seq_engine_t* pEngine, const snd_seq_event_t* pEvent,
+		int32_t nSource, uint64_t ullReadNs);
+
+void seqEngineKick(seq_engine_t* pEngine);
+
+int32_t nSeqEngineSubmit(seq_engine_t* pEngine, const snd_seq_event_t* pEvent);
+
+void* seqEngineService(void* pEngine);
+
+void seqEngineStop(seq_engine_t* pEngine);
+
+void seqEngineRelease(seq_engine_t* pEngine);
+
+#endif /* SEQ_ENGINE_H_ */
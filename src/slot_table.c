@@ -0,0 +1,156 @@
+/*
+ * slot_table.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "slot_table.h"
+
+int32_t nSlotTableInit(slot_table_t* pTable, size_t ulSlotSize, int32_t nMaxSlots)
+{
+	memset(pTable, 0, sizeof(slot_table_t));
+	if (nMaxSlots < 1){
+		LOG_E("Slot table needs at least one slot.");
+		return (-1);
+	}
+	pTable->pChunks = calloc((nMaxSlots + SLOT_TABLE_CHUNK_SLOTS - 1) / SLOT_TABLE_CHUNK_SLOTS,
+			sizeof(uint8_t*));
+	pTable->pNextFree = calloc(nMaxSlots, sizeof(uint32_t));
+	if ((NULL == pTable->pChunks) || (NULL == pTable->pNextFree)){
+		LOG_E("Allocate slot table failed: %m");
+		free(pTable->pChunks);
+		free(pTable->pNextFree);
+		return (-1);
+	}
+	pTable->ulSlotSize = ulSlotSize;
+	pTable->nMaxSlots = nMaxSlots;
+	pthread_mutex_init(&(pTable->tGrowLock), NULL);
+	return 0;
+}
+
+static void pushFree(slot_table_t* pTable, int32_t nSlot)
+{
+	uint64_t ullOld, ullNew;
+
+	ullOld = __atomic_load_n(&(pTable->ullFreeHead), __ATOMIC_RELAXED);
+	do{
+		__atomic_store_n(pTable->pNextFree + nSlot, (uint32_t)ullOld, __ATOMIC_RELAXED);
+		ullNew = (((ullOld >> 32) + 1) << 32) | (uint32_t)(nSlot + 1);
+	}while (0 == __atomic_compare_exchange_n(&(pTable->ullFreeHead), &ullOld, ullNew, 1,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static int32_t nPopFree(slot_table_t* pTable)
+{
+	uint64_t ullOld, ullNew;
+	uint32_t unTop;
+
+	ullOld = __atomic_load_n(&(pTable->ullFreeHead), __ATOMIC_ACQUIRE);
+	do{
+		unTop = (uint32_t)ullOld;
+		if (0 == unTop){
+			return SLOT_TABLE_NO_SLOT;
+		}
+		// the tag makes a stale next value fail the exchange below
+		ullNew = (((ullOld >> 32) + 1) << 32) |
+				__atomic_load_n(pTable->pNextFree + unTop - 1, __ATOMIC_RELAXED);
+	}while (0 == __atomic_compare_exchange_n(&(pTable->ullFreeHead), &ullOld, ullNew, 1,
+			__ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+	return unTop - 1;
+}
+
+/* New slots are zeroed and go on the free stack, lowest index on top.
+ * Returns the number of slots now allocated. */
+int32_t nSlotTableGrowTo(slot_table_t* pTable, int32_t nSlots)
+{
+	uint8_t* pChunk;
+	int32_t nFirst, nLast, nSlot;
+
+	if (nSlots > pTable->nMaxSlots){
+		nSlots = pTable->nMaxSlots;
+	}
+	pthread_mutex_lock(&(pTable->tGrowLock));
+	while (pTable->nSlots < nSlots){
+		pChunk = calloc(SLOT_TABLE_CHUNK_SLOTS, pTable->ulSlotSize);
+		if (NULL == pChunk){
+			LOG_E("Grow slot table failed: %m");
+			break;
+		}
+		nFirst = pTable->nSlots;
+		nLast = nFirst + SLOT_TABLE_CHUNK_SLOTS;
+		if (nLast > pTable->nMaxSlots){
+			nLast = pTable->nMaxSlots;
+		}
+		__atomic_store_n(pTable->pChunks + (nFirst / SLOT_TABLE_CHUNK_SLOTS), pChunk, __ATOMIC_RELEASE);
+		__atomic_store_n(&(pTable->nSlots), nLast, __ATOMIC_RELEASE);
+		for (nSlot = nLast - 1; nSlot >= nFirst; nSlot--){
+			pushFree(pTable, nSlot);
+		}
+	}
+	nSlots = pTable->nSlots;
+	pthread_mutex_unlock(&(pTable->tGrowLock));
+	return nSlots;
+}
+
+/* The caller owns the slot until it hands it back with slotTableFree().
+ * Returns SLOT_TABLE_NO_SLOT when nMaxSlots are taken. */
+int32_t nSlotTableAcquire(slot_table_t* pTable)
+{
+	int32_t nSlot, nSlots;
+
+	while (SLOT_TABLE_NO_SLOT == (nSlot = nPopFree(pTable))){
+		nSlots = __atomic_load_n(&(pTable->nSlots), __ATOMIC_ACQUIRE);
+		if ((nSlots >= pTable->nMaxSlots) ||
+				(nSlotTableGrowTo(pTable, nSlots + SLOT_TABLE_CHUNK_SLOTS) <= nSlots)){
+			return SLOT_TABLE_NO_SLOT;
+		}
+	}
+	__atomic_add_fetch(&(pTable->nInUse), 1, __ATOMIC_RELAXED);
+	return nSlot;
+}
+
+void slotTableFree(slot_table_t* pTable, int32_t nSlot)
+{
+	__atomic_sub_fetch(&(pTable->nInUse), 1, __ATOMIC_RELAXED);
+	pushFree(pTable, nSlot);
+}
+
+/* NULL for a slot that was never allocated */
+void* pSlotTableGet(slot_table_t* pTable, int32_t nSlot)
+{
+	uint8_t* pChunk;
+
+	if ((nSlot < 0) || (nSlot >= __atomic_load_n(&(pTable->nSlots), __ATOMIC_ACQUIRE))){
+		return NULL;
+	}
+	pChunk = __atomic_load_n(pTable->pChunks + (nSlot / SLOT_TABLE_CHUNK_SLOTS), __ATOMIC_ACQUIRE);
+	return pChunk + (nSlot % SLOT_TABLE_CHUNK_SLOTS) * pTable->ulSlotSize;
+}
+
+/* Iteration bound, every index below it has memory */
+int32_t nSlotTableSlots(slot_table_t* pTable)
+{
+	return __atomic_load_n(&(pTable->nSlots), __ATOMIC_ACQUIRE);
+}
+
+void slotTableRelease(slot_table_t* pTable)
+{
+	int32_t nChunk;
+
+	if (NULL == pTable->pChunks){
+		return;
+	}
+	for (nChunk = 0; (nChunk * SLOT_TABLE_CHUNK_SLOTS) < pTable->nSlots; nChunk++){
+		free(pTable->pChunks[nChunk]);
+	}
+	free(pTable->pChunks);
+	free(pTable->pNextFree);
+	pthread_mutex_destroy(&(pTable->tGrowLock));
+	memset(pTable, 0, sizeof(slot_table_t));
+}
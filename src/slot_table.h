@@ -0,0 +1,48 @@
+/*
+ * slot_table.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#ifndef SLOT_TABLE_H_
+#define SLOT_TABLE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define SLOT_TABLE_CHUNK_SLOTS			16
+#define SLOT_TABLE_NO_SLOT				(-1)
+
+/* Fixed size slots, indexed from 0, allocated a chunk at a time up to
+ * nMaxSlots. Chunks never move or go away before slotTableRelease(), so
+ * a slot pointer or index stays valid for any thread while the table
+ * grows. Free slots sit on a lock-free stack: taking or returning one is
+ * a single compare-and-swap, only growing takes tGrowLock. */
+typedef struct {
+	uint8_t** pChunks;
+	size_t ulSlotSize;
+	int32_t nMaxSlots;
+	int32_t nSlots;				// slots in allocated chunks, only grows
+	int32_t nInUse;
+	uint64_t ullFreeHead;		// ABA tag << 32 | (index + 1), 0 when empty
+	uint32_t* pNextFree;		// per slot, index + 1 of the next free one
+	pthread_mutex_t tGrowLock;
+}slot_table_t;
+
+int32_t nSlotTableInit(slot_table_t* pTable, size_t ulSlotSize, int32_t nMaxSlots);
+
+int32_t nSlotTableAcquire(slot_table_t* pTable);
+
+void slotTableFree(slot_table_t* pTable, int32_t nSlot);
+
+int32_t nSlotTableGrowTo(slot_table_t* pTable, int32_t nSlots);
+
+void* pSlotTableGet(slot_table_t* pTable, int32_t nSlot);
+
+int32_t nSlotTableSlots(slot_table_t* pTable);
+
+void slotTableRelease(slot_table_t* pTable);
+
+#endif /* SLOT_TABLE_H_ */
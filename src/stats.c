@@ -0,0 +1,320 @@
+/*
+ * stats.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+static const char* STATS_STAGE_NAME[STATS_STAGE_CNT] = {
+	"frame", "decode", "queue", "drain", "total"
+};
+
+uint64_t ullStatsNowNs(void)
+{
+	struct timespec tNow;
+	clock_gettime(CLOCK_MONOTONIC, &tNow);
+	return (uint64_t)tNow.tv_sec * 1000000000ULL + tNow.tv_nsec;
+}
+
+int32_t nStatsInit(daemon_stats_t* pStats, int32_t nCapacity)
+{
+	memset(pStats, 0, sizeof(daemon_stats_t));
+	if (nSlotTableInit(&(pStats->tLinks), sizeof(link_stats_t), nCapacity) < 0){
+		return (-1);
+	}
+	pStats->ullStartNs = ullStatsNowNs();
+	snprintf(pStats->tOther.cName, STATS_NAME_LENGTH, "other");
+	return 0;
+}
+
+void statsRelease(daemon_stats_t* pStats)
+{
+	slotTableRelease(&(pStats->tLinks));
+}
+
+link_stats_t* pStatsForSource(daemon_stats_t* pStats, int32_t nSource)
+{
+	link_stats_t* pLink;
+
+	if (NULL == pStats){
+		return NULL;
+	}
+	pLink = pSlotTableGet(&(pStats->tLinks), nSource);
+	return (NULL == pLink) ? &(pStats->tOther) : pLink;
+}
+
+static int32_t nBucketOf(uint64_t ullValue)
+{
+	int32_t nExponent;
+
+	if (ullValue < STATS_SUB_BUCKETS){
+		return (int32_t)ullValue;
+	}
+	nExponent = 63 - __builtin_clzll(ullValue);
+	if (nExponent > STATS_MAX_EXPONENT){
+		return STATS_HISTOGRAM_BUCKETS - 1;
+	}
+	return (nExponent - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS +
+			(int32_t)((ullValue >> (nExponent - STATS_SUB_BITS)) & (STATS_SUB_BUCKETS - 1));
+}
+
+/* Upper edge of a bucket, what a percentile falling into it reports */
+static uint64_t ullBucketTop(int32_t nBucket)
+{
+	int32_t nExponent;
+
+	if (nBucket < STATS_SUB_BUCKETS){
+		return nBucket;
+	}
+	nExponent = nBucket / STATS_SUB_BUCKETS + STATS_SUB_BITS - 1;
+	return ((uint64_t)(STATS_SUB_BUCKETS + (nBucket % STATS_SUB_BUCKETS) + 1) << (nExponent - STATS_SUB_BITS)) - 1;
+}
+
+void statsHistogramRecord(stats_histogram_t* pHistogram, uint64_t ullNs)
+{
+	__atomic_add_fetch(&(pHistogram->unCount[nBucketOf(ullNs)]), 1, __ATOMIC_RELAXED);
+}
+
+void statsRecord(link_stats_t* pLink, stats_stage_t tStage, uint64_t ullNs)
+{
+	if (NULL == pLink){
+		return;
+	}
+	statsHistogramRecord(pLink->tStage + tStage, ullNs);
+}
+
+void statsCount(uint32_t* pCounter, uint32_t unAmount)
+{
+	__atomic_add_fetch(pCounter, unAmount, __ATOMIC_RELAXED);
+}
+
+/* Zeroes a slot word by word, the engine may still be recording late
+ * events of the link that had it before */
+static void clearLink(link_stats_t* pLink)
+{
+	int32_t nStage, nBucket;
+
+	for (nStage = 0; nStage < STATS_STAGE_CNT; nStage++){
+		for (nBucket = 0; nBucket < STATS_HISTOGRAM_BUCKETS; nBucket++){
+			__atomic_store_n(&(pLink->tStage[nStage].unCount[nBucket]), 0, __ATOMIC_RELAXED);
+		}
+	}
+	__atomic_store_n(&(pLink->unFrames), 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&(pLink->unMalformed), 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&(pLink->ullBytes), 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&(pLink->unShed), 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&(pLink->unThrottled), 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&(pLink->unQueuePeak), 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&(pLink->unSysEx), 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&(pLink->nClassic), 0, __ATOMIC_RELAXED);
+	pLink->nProfileApplied = 0;
+	pLink->nMaster = 0;
+	pLink->unLinkPolicy = 0;
+	pLink->unSupervision = 0;
+}
+
+static void addHistogram(stats_histogram_t* pTo, const stats_histogram_t* pFrom)
+{
+	int32_t nBucket;
+	for (nBucket = 0; nBucket < STATS_HISTOGRAM_BUCKETS; nBucket++){
+		pTo->unCount[nBucket] += __atomic_load_n(&(pFrom->unCount[nBucket]), __ATOMIC_RELAXED);
+	}
+}
+
+static void addLink(link_stats_t* pTo, const link_stats_t* pFrom)
+{
+	uint32_t unQueuePeak = __atomic_load_n(&(pFrom->unQueuePeak), __ATOMIC_RELAXED);
+	int32_t nStage;
+	for (nStage = 0; nStage < STATS_STAGE_CNT; nStage++){
+		addHistogram(pTo->tStage + nStage, pFrom->tStage + nStage);
+	}
+	pTo->unFrames += __atomic_load_n(&(pFrom->unFrames), __ATOMIC_RELAXED);
+	pTo->unMalformed += __atomic_load_n(&(pFrom->unMalformed), __ATOMIC_RELAXED);
+	pTo->ullBytes += __atomic_load_n(&(pFrom->ullBytes), __ATOMIC_RELAXED);
+	pTo->unShed += __atomic_load_n(&(pFrom->unShed), __ATOMIC_RELAXED);
+	pTo->unThrottled += __atomic_load_n(&(pFrom->unThrottled), __ATOMIC_RELAXED);
+	pTo->unSysEx += __atomic_load_n(&(pFrom->unSysEx), __ATOMIC_RELAXED);
+	if (pTo->unQueuePeak < unQueuePeak){
+		pTo->unQueuePeak = unQueuePeak;
+	}
+}
+
+/* addLink() into a total the report reads at the same time */
+static void foldLink(link_stats_t* pTo, const link_stats_t* pFrom)
+{
+	uint32_t unQueuePeak = __atomic_load_n(&(pFrom->unQueuePeak), __ATOMIC_RELAXED);
+	int32_t nStage, nBucket;
+
+	for (nStage = 0; nStage < STATS_STAGE_CNT; nStage++){
+		for (nBucket = 0; nBucket < STATS_HISTOGRAM_BUCKETS; nBucket++){
+			__atomic_add_fetch(&(pTo->tStage[nStage].unCount[nBucket]),
+					__atomic_load_n(&(pFrom->tStage[nStage].unCount[nBucket]), __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+		}
+	}
+	__atomic_add_fetch(&(pTo->unFrames), __atomic_load_n(&(pFrom->unFrames), __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+	__atomic_add_fetch(&(pTo->unMalformed), __atomic_load_n(&(pFrom->unMalformed), __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+	__atomic_add_fetch(&(pTo->ullBytes), __atomic_load_n(&(pFrom->ullBytes), __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+	__atomic_add_fetch(&(pTo->unShed), __atomic_load_n(&(pFrom->unShed), __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+	__atomic_add_fetch(&(pTo->unThrottled), __atomic_load_n(&(pFrom->unThrottled), __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+	__atomic_add_fetch(&(pTo->unSysEx), __atomic_load_n(&(pFrom->unSysEx), __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+	if (__atomic_load_n(&(pTo->unQueuePeak), __ATOMIC_RELAXED) < unQueuePeak){
+		__atomic_store_n(&(pTo->unQueuePeak), unQueuePeak, __ATOMIC_RELAXED);	// only the closing thread writes it
+	}
+}
+
+/* Slots are only looked up by link index here, never acquired */
+void statsLinkOpen(daemon_stats_t* pStats, int32_t nSource, const char* pName)
+{
+	link_stats_t* pLink;
+
+	nSlotTableGrowTo(&(pStats->tLinks), nSource + 1);
+	pLink = pStatsForSource(pStats, nSource);
+
+	if ((NULL == pLink) || (pLink == &(pStats->tOther))){
+		return;
+	}
+	clearLink(pLink);
+	snprintf(pLink->cName, STATS_NAME_LENGTH, "%s", pName);
+	__atomic_store_n(&(pLink->ullOpenedNs), ullStatsNowNs(), __ATOMIC_RELAXED);
+	__atomic_store_n(&(pLink->nActive), 1, __ATOMIC_RELEASE);
+}
+
+/* Runs on the thread owning the link; the engine may still record a few
+ * late events into the slot, those are not counted. The fold and the end
+ * of nActive are one step for the report, see nStatsReport(). */
+void statsLinkClose(daemon_stats_t* pStats, int32_t nSource)
+{
+	link_stats_t* pLink = pStatsForSource(pStats, nSource);
+
+	if ((NULL == pLink) || (pLink == &(pStats->tOther))){
+		return;
+	}
+	__atomic_add_fetch(&(pStats->unRetireSeq), 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	foldLink(&(pStats->tRetired), pLink);
+	__atomic_store_n(&(pLink->nActive), 0, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&(pStats->unRetireSeq), 1, __ATOMIC_RELEASE);
+}
+
+/* What the controller reported for an RFCOMM link after its latency
+ * profile was applied. Set once, right after the link opened. */
+void statsLinkMode(link_stats_t* pLink, int32_t nApplied, int32_t nMaster,
+		uint16_t unPolicy, uint16_t unSupervision)
+{
+	if (NULL == pLink){
+		return;
+	}
+	pLink->nProfileApplied = nApplied;
+	pLink->nMaster = nMaster;
+	pLink->unLinkPolicy = unPolicy;
+	pLink->unSupervision = unSupervision;
+	__atomic_store_n(&(pLink->nClassic), 1, __ATOMIC_RELEASE);
+}
+
+static uint64_t ullPercentile(const stats_histogram_t* pHistogram, uint64_t ullTotal, double dRank)
+{
+	uint64_t ullWanted = (uint64_t)(ullTotal * dRank), ullSeen = 0;
+	int32_t nBucket;
+
+	for (nBucket = 0; nBucket < STATS_HISTOGRAM_BUCKETS; nBucket++){
+		ullSeen += pHistogram->unCount[nBucket];
+		if (ullSeen > ullWanted){
+			return ullBucketTop(nBucket);
+		}
+	}
+	return 0;
+}
+
+/* One line "  name count:.. p50_us:..", for histograms kept outside the
+ * link statistics as well */
+int32_t nStatsReportHistogram(char* pBuff, int32_t nBuffLen, const char* pName,
+		const stats_histogram_t* pHistogram)
+{
+	uint64_t ullTotal = 0;
+	int32_t nBucket;
+
+	for (nBucket = 0; nBucket < STATS_HISTOGRAM_BUCKETS; nBucket++){
+		ullTotal += pHistogram->unCount[nBucket];
+	}
+	return snprintf(pBuff, nBuffLen, "  %-7s count:%llu p50_us:%.1f p99_us:%.1f p999_us:%.1f\n",
+			pName, (unsigned long long)ullTotal,
+			ullPercentile(pHistogram, ullTotal, 0.5) / 1000.0,
+			ullPercentile(pHistogram, ullTotal, 0.99) / 1000.0,
+			ullPercentile(pHistogram, ullTotal, 0.999) / 1000.0);
+}
+
+#define STATS_APPEND(expr)	do { nLen += (expr); if (nLen >= nBuffLen) return nBuffLen - 1; } while (0)
+
+/* Human readable snapshot for the "stats" control command */
+int32_t nStatsReport(daemon_stats_t* pStats, char* pBuff, int32_t nBuffLen)
+{
+	link_stats_t tAll;
+	link_stats_t* pLink;
+	uint64_t ullNow = ullStatsNowNs();
+	double dSeconds;
+	uint32_t unSeq;
+	int32_t nLen = 0, nIndex, nStage;
+
+	// a link closing meanwhile would be missed or counted twice, take the sum again
+	do{
+		while ((unSeq = __atomic_load_n(&(pStats->unRetireSeq), __ATOMIC_ACQUIRE)) & 1);
+		memset(&tAll, 0, sizeof(tAll));
+		addLink(&tAll, &(pStats->tRetired));
+		addLink(&tAll, &(pStats->tOther));
+		for (nIndex = 0; nIndex < nSlotTableSlots(&(pStats->tLinks)); nIndex++){
+			pLink = pSlotTableGet(&(pStats->tLinks), nIndex);
+			if (__atomic_load_n(&(pLink->nActive), __ATOMIC_RELAXED)){
+				addLink(&tAll, pLink);
+			}
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	}while (unSeq != __atomic_load_n(&(pStats->unRetireSeq), __ATOMIC_RELAXED));
+
+	dSeconds = (ullNow - pStats->ullStartNs) / 1e9;
+	STATS_APPEND(snprintf(pBuff + nLen, nBuffLen - nLen,
+			"uptime_s:%.1f frames:%u malformed:%u frames_per_s:%.1f rejected:%u dropped:%u filtered:%u\n",
+			dSeconds, tAll.unFrames, tAll.unMalformed,
+			(dSeconds > 0) ? tAll.unFrames / dSeconds : 0.0,
+			pStats->unRejected, pStats->unDropped, pStats->unFiltered));
+	STATS_APPEND(snprintf(pBuff + nLen, nBuffLen - nLen,
+			"merge shed:%u throttled:%u queue_peak:%u other_shed:%u other_queue_peak:%u\n",
+			tAll.unShed, tAll.unThrottled, tAll.unQueuePeak,
+			pStats->tOther.unShed, pStats->tOther.unQueuePeak));
+	STATS_APPEND(snprintf(pBuff + nLen, nBuffLen - nLen,
+			"sysex chunks:%u lost_messages:%u\n", tAll.unSysEx, pStats->unSysExLost));
+	for (nStage = 0; nStage < STATS_STAGE_CNT; nStage++){
+		STATS_APPEND(nStatsReportHistogram(pBuff + nLen, nBuffLen - nLen,
+				STATS_STAGE_NAME[nStage], tAll.tStage + nStage));
+	}
+
+	for (nIndex = 0; nIndex < nSlotTableSlots(&(pStats->tLinks)); nIndex++){
+		pLink = pSlotTableGet(&(pStats->tLinks), nIndex);
+		if (0 == __atomic_load_n(&(pLink->nActive), __ATOMIC_RELAXED)){
+			continue;
+		}
+		dSeconds = (ullNow - pLink->ullOpenedNs) / 1e9;
+		STATS_APPEND(snprintf(pBuff + nLen, nBuffLen - nLen,
+				"link:%s frames:%u malformed:%u bytes:%llu frames_per_s:%.1f shed:%u throttled:%u queue_peak:%u sysex:%u\n",
+				pLink->cName, pLink->unFrames, pLink->unMalformed,
+				(unsigned long long)pLink->ullBytes,
+				(dSeconds > 0) ? pLink->unFrames / dSeconds : 0.0,
+				pLink->unShed, pLink->unThrottled, pLink->unQueuePeak, pLink->unSysEx));
+		if (1 == __atomic_load_n(&(pLink->nClassic), __ATOMIC_ACQUIRE)){
+			STATS_APPEND(snprintf(pBuff + nLen, nBuffLen - nLen,
+					"  rfcomm  profile:%s role:%s policy:%04X supervision_ms:%u\n",
+					(1 == pLink->nProfileApplied) ? "applied" : "partial",
+					(1 == pLink->nMaster) ? "master" : "slave", pLink->unLinkPolicy,
+					pLink->unSupervision * 5 / 8));
+		}
+		STATS_APPEND(nStatsReportHistogram(pBuff + nLen, nBuffLen - nLen,
+				STATS_STAGE_NAME[STATS_STAGE_TOTAL], pLink->tStage + STATS_STAGE_TOTAL));
+	}
+	return nLen;
+}
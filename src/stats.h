@@ -0,0 +1,97 @@
+/*
+ * stats.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdint.h>
+
+#include "slot_table.h"
+
+#define STATS_SUB_BITS					3
+#define STATS_SUB_BUCKETS				(1 << STATS_SUB_BITS)
+#define STATS_MAX_EXPONENT				40		// 2^40 ns, about 18 minutes
+#define STATS_HISTOGRAM_BUCKETS			((STATS_MAX_EXPONENT - STATS_SUB_BITS + 2) * STATS_SUB_BUCKETS)
+#define STATS_NAME_LENGTH				32
+#define STATS_SOURCE_OTHER				(-1)	// control socket, jingles, anything not a link
+#define STATS_REPORT_SIZE				4096
+
+/* Where the time of an event goes, all measured from the same clock */
+typedef enum {
+	STATS_STAGE_FRAME = 0,		// first byte read -> frame complete
+	STATS_STAGE_DECODE,			// read returned -> all events of the read queued
+	STATS_STAGE_QUEUE,			// read returned -> engine takes event into its batch
+	STATS_STAGE_DRAIN,			// one batch through the output backend
+	STATS_STAGE_TOTAL,			// read returned -> flushed to the kernel
+	STATS_STAGE_CNT
+}stats_stage_t;
+
+/* Log-linear histogram: 8 buckets per power of two, so every bucket is
+ * within 12.5% of its value. Counters are bumped with relaxed atomics,
+ * readers take a snapshot without stopping the writers. */
+typedef struct {
+	uint32_t unCount[STATS_HISTOGRAM_BUCKETS];
+}stats_histogram_t;
+
+typedef struct {
+	stats_histogram_t tStage[STATS_STAGE_CNT];
+	uint32_t unFrames;
+	uint32_t unMalformed;
+	uint64_t ullBytes;
+	uint32_t unShed;			// refused by its merge queue, full or drop policy
+	uint32_t unThrottled;		// turns that ended with events still queued
+	uint32_t unQueuePeak;		// deepest its merge queue got
+	uint32_t unSysEx;			// SysEx chunks handed to the engine
+	int32_t nClassic;			// an RFCOMM link, its mode below is known
+	int32_t nProfileApplied;	// latency profile fully in place
+	int32_t nMaster;
+	uint16_t unLinkPolicy;		// HCI_LP_* bits
+	uint16_t unSupervision;		// 0.625 ms slots
+	uint64_t ullOpenedNs;
+	int32_t nActive;
+	char cName[STATS_NAME_LENGTH];
+}link_stats_t;
+
+typedef struct {
+	slot_table_t tLinks;		// of link_stats_t, indexed by link slot, grows with it
+	link_stats_t tRetired;		// closed links are folded in here
+	uint32_t unRetireSeq;		// odd while a link is being folded into tRetired
+	link_stats_t tOther;
+	uint32_t unRejected;		// turned away, no free slot
+	uint32_t unDropped;			// closed because of an error
+	uint32_t unFiltered;		// redundant events the engine did not send
+	uint32_t unSysExLost;		// SysEx messages cut short, a chunk found no buffer or queue room
+	uint64_t ullStartNs;
+}daemon_stats_t;
+
+uint64_t ullStatsNowNs(void);
+
+int32_t nStatsInit(daemon_stats_t* pStats, int32_t nCapacity);
+
+void statsRelease(daemon_stats_t* pStats);
+
+link_stats_t* pStatsForSource(daemon_stats_t* pStats, int32_t nSource);
+
+void statsHistogramRecord(stats_histogram_t* pHistogram, uint64_t ullNs);
+
+void statsRecord(link_stats_t* pLink, stats_stage_t tStage, uint64_t ullNs);
+
+void statsCount(uint32_t* pCounter, uint32_t unAmount);
+
+void statsLinkOpen(daemon_stats_t* pStats, int32_t nSource, const char* pName);
+
+void statsLinkClose(daemon_stats_t* pStats, int32_t nSource);
+
+void statsLinkMode(link_stats_t* pLink, int32_t nApplied, int32_t nMaster,
+		uint16_t unPolicy, uint16_t unSupervision);
+
+int32_t nStatsReport(daemon_stats_t* pStats, char* pBuff, int32_t nBuffLen);
+
+int32_t nStatsReportHistogram(char* pBuff, int32_t nBuffLen, const char* pName,
+		const stats_histogram_t* pHistogram);
+
+#endif /* STATS_H_ */
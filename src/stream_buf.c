@@ -0,0 +1,86 @@
+/*
+ * stream_buf.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stream_buf.h"
+
+void streamBufInit(stream_buf_t* pStream, char cEndSymbol)
+{
+	pStream->nHead = 0;
+	pStream->nScanned = 0;
+	pStream->nTail = 0;
+	pStream->cEndSymbol = cEndSymbol;
+	pStream->unOverflow = 0;
+}
+
+/* Read whatever the peer has sent into the free space. Returns what read()
+ * returned, so 0 means the peer closed the connection. */
+int32_t nStreamBufRecv(stream_buf_t* pStream, int32_t nFd)
+{
+	int32_t nPartial = pStream->nTail - pStream->nHead;
+	int32_t nBytesRead;
+
+	if (pStream->nHead > 0){
+		if (nPartial > 0){
+			memmove(pStream->cData, pStream->cData + pStream->nHead, nPartial);
+		}
+		pStream->nHead = 0;
+		pStream->nTail = nPartial;
+	}else if (nPartial == STREAM_BUF_SIZE){
+		/* a whole buffer without any end symbol is garbage, start over */
+		pStream->unOverflow++;
+		pStream->nTail = 0;
+		pStream->nScanned = 0;
+	}
+
+	nBytesRead = read(nFd, pStream->cData + pStream->nTail, STREAM_BUF_SIZE - pStream->nTail);
+	if (nBytesRead > 0){
+		pStream->nTail += nBytesRead;
+	}
+	return nBytesRead;
+}
+
+/* Next complete frame, terminated in place by '\0' instead of the end
+ * symbol. The pointer stays valid until the next nStreamBufRecv(). */
+char* pStreamBufNextFrame(stream_buf_t* pStream, int32_t* pFrameLen)
+{
+	char* pStart = pStream->cData + pStream->nHead;
+	char* pEnd;
+
+	pEnd = memchr(pStart + pStream->nScanned, pStream->cEndSymbol,
+			pStream->nTail - pStream->nHead - pStream->nScanned);
+	if (NULL == pEnd){
+		pStream->nScanned = pStream->nTail - pStream->nHead;
+		return NULL;
+	}
+
+	*pEnd = '\0';
+	*pFrameLen = pEnd - pStart;
+	pStream->nHead += *pFrameLen + 1;
+	pStream->nScanned = 0;
+	return pStart;
+}
+
+/* Bytes received but not handed out as frames yet */
+char* pStreamBufPending(stream_buf_t* pStream, int32_t* pLen)
+{
+	*pLen = pStream->nTail - pStream->nHead;
+	return pStream->cData + pStream->nHead;
+}
+
+/* Hand out nLen pending bytes without framing, for links in binary mode */
+void streamBufConsume(stream_buf_t* pStream, int32_t nLen)
+{
+	pStream->nHead += nLen;
+	if (pStream->nHead > pStream->nTail){
+		pStream->nHead = pStream->nTail;
+	}
+	pStream->nScanned = 0;
+}
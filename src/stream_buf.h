@@ -0,0 +1,38 @@
+/*
+ * stream_buf.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#ifndef STREAM_BUF_H_
+#define STREAM_BUF_H_
+
+#include <stdint.h>
+
+#define STREAM_BUF_SIZE					1024
+
+/* Per connection receive buffer for symbol terminated frames. One recv()
+ * fills all free space, complete frames are handed out in place and only
+ * an incomplete tail is ever moved, back to the front before the next
+ * recv(). Owned by exactly one connection, so it needs no locking. */
+typedef struct {
+	char cData[STREAM_BUF_SIZE];
+	int32_t nHead;			// first byte not handed out yet
+	int32_t nScanned;		// bytes from nHead already known to hold no end symbol
+	int32_t nTail;			// end of received data
+	char cEndSymbol;
+	uint32_t unOverflow;
+}stream_buf_t;
+
+void streamBufInit(stream_buf_t* pStream, char cEndSymbol);
+
+int32_t nStreamBufRecv(stream_buf_t* pStream, int32_t nFd);
+
+char* pStreamBufNextFrame(stream_buf_t* pStream, int32_t* pFrameLen);
+
+char* pStreamBufPending(stream_buf_t* pStream, int32_t* pLen);
+
+void streamBufConsume(stream_buf_t* pStream, int32_t nLen);
+
+#endif /* STREAM_BUF_H_ */
@@ -0,0 +1,103 @@
+/*
+ * sysex_pool.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <alsa/asoundlib.h>
+
+#include "log.h"
+#include "sysex_pool.h"
+
+int32_t nSysExPoolInit(sysex_pool_t* pPool, int32_t nBuffers)
+{
+	sysex_pool_buffer_t* pBuffer;
+	int32_t nSlot;
+
+	memset(pPool, 0, sizeof(sysex_pool_t));
+	if (nSlotTableInit(&(pPool->tBuffers), sizeof(sysex_pool_buffer_t), nBuffers) < 0){
+		return (-1);
+	}
+	// every buffer now, nothing is allocated while a dump streams through
+	if (nSlotTableGrowTo(&(pPool->tBuffers), nBuffers) < nBuffers){
+		slotTableRelease(&(pPool->tBuffers));
+		return (-1);
+	}
+	for (nSlot = 0; nSlot < nBuffers; nSlot++){
+		pBuffer = pSlotTableGet(&(pPool->tBuffers), nSlot);
+		pBuffer->nSlot = nSlot;
+	}
+	return 0;
+}
+
+/* Copy a chunk into a free buffer and make pEvent the SysEx event
+ * carrying it. Returns -1, counted, when every buffer is in flight. */
+int32_t nSysExPoolEvent(sysex_pool_t* pPool, snd_seq_event_t* pEvent, const uint8_t* pData, int32_t nLen)
+{
+	sysex_pool_buffer_t* pBuffer;
+	int32_t nSlot;
+
+	if ((nLen < 1) || (nLen > SYSEX_POOL_BUFFER_SIZE)){
+		return (-1);
+	}
+	nSlot = nSlotTableAcquire(&(pPool->tBuffers));
+	if (SLOT_TABLE_NO_SLOT == nSlot){
+		__atomic_add_fetch(&(pPool->unExhausted), 1, __ATOMIC_RELAXED);
+		return (-1);
+	}
+	pBuffer = pSlotTableGet(&(pPool->tBuffers), nSlot);
+	memcpy(pBuffer->unData, pData, nLen);
+	snd_seq_ev_clear(pEvent);
+	snd_seq_ev_set_sysex(pEvent, nLen, pBuffer->unData);
+	return 0;
+}
+
+/* Slot of the buffer whose data starts at pData, SLOT_TABLE_NO_SLOT if
+ * pData is no buffer of this pool */
+static int32_t nSlotOf(sysex_pool_t* pPool, const uint8_t* pData)
+{
+	sysex_pool_buffer_t* pBuffer;
+	int32_t nSlot, nSlots = nSlotTableSlots(&(pPool->tBuffers));
+
+	for (nSlot = 0; nSlot < nSlots; nSlot += SLOT_TABLE_CHUNK_SLOTS){
+		pBuffer = pSlotTableGet(&(pPool->tBuffers), nSlot);
+		if ((pData < pBuffer->unData) || (pData >= (uint8_t*)(pBuffer + SLOT_TABLE_CHUNK_SLOTS))){
+			continue;
+		}
+		if ((pData - pBuffer->unData) % sizeof(sysex_pool_buffer_t) != 0){
+			break;
+		}
+		nSlot += (pData - pBuffer->unData) / sizeof(sysex_pool_buffer_t);
+		return (nSlot < nSlots) ? nSlot : SLOT_TABLE_NO_SLOT;
+	}
+	return SLOT_TABLE_NO_SLOT;
+}
+
+/* The buffer behind a SysEx event from nSysExPoolEvent(), once it is
+ * out or refused. An event that points anywhere else is counted and
+ * left alone, freeing it would corrupt the free stack. */
+void sysExPoolReturn(sysex_pool_t* pPool, const snd_seq_event_t* pEvent)
+{
+	int32_t nSlot = nSlotOf(pPool, pEvent->data.ext.ptr);
+
+	if (SLOT_TABLE_NO_SLOT == nSlot){
+		__atomic_add_fetch(&(pPool->unForeign), 1, __ATOMIC_RELAXED);
+		return;
+	}
+	slotTableFree(&(pPool->tBuffers), nSlot);
+}
+
+void sysExPoolRelease(sysex_pool_t* pPool)
+{
+	if (pPool->unForeign > 0){
+		LOG_W("%u SysEx events pointed at no pool buffer.", pPool->unForeign);
+	}
+	if (pPool->tBuffers.nInUse > 0){
+		LOG_D("%d SysEx buffers still in flight.", pPool->tBuffers.nInUse);
+	}
+	slotTableRelease(&(pPool->tBuffers));
+}
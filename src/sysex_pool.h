@@ -0,0 +1,42 @@
+/*
+ * sysex_pool.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: zulolo
+ */
+
+#ifndef SYSEX_POOL_H_
+#define SYSEX_POOL_H_
+
+#include <stdint.h>
+
+#include "slot_table.h"
+#include "midi_stream.h"
+
+#define SYSEX_POOL_BUFFER_SIZE			MIDI_STREAM_SYSEX_CHUNK
+#define SYSEX_POOL_BUFFERS				256		// a whole 64 KB dump can be in flight
+
+typedef struct {
+	int32_t nSlot;
+	uint8_t unData[SYSEX_POOL_BUFFER_SIZE];
+}sysex_pool_buffer_t;
+
+/* SysEx chunks travel through the merge queues as SND_SEQ_EVENT_SYSEX
+ * events pointing into one of these buffers. All of them are allocated
+ * up front; any thread takes one, the engine thread gives it back once
+ * the event is out, both a single compare-and-swap. */
+typedef struct {
+	slot_table_t tBuffers;		// of sysex_pool_buffer_t
+	uint32_t unExhausted;		// chunks dropped for want of a buffer
+	uint32_t unForeign;			// returned events that pointed at no buffer of ours
+}sysex_pool_t;
+
+int32_t nSysExPoolInit(sysex_pool_t* pPool, int32_t nBuffers);
+
+int32_t nSysExPoolEvent(sysex_pool_t* pPool, snd_seq_event_t* pEvent, const uint8_t* pData, int32_t nLen);
+
+void sysExPoolReturn(sysex_pool_t* pPool, const snd_seq_event_t* pEvent);
+
+void sysExPoolRelease(sysex_pool_t* pPool);
+
+#endif /* SYSEX_POOL_H_ */